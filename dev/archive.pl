@@ -10,6 +10,8 @@ use warnings;
 use XML::Simple;
 use Switch;
 use Fcntl;
+use FindBin;
+require "$FindBin::Bin/cappipe.pl"; # cap_pipe_send()
 
 # global variables
 my $xmlref;
@@ -156,7 +158,8 @@ while( $errcount_rd < $readerr_max ) {
 
 	    # send message back to Master Program
 	    pipe_out_open();
-	    print $p_out "MSG_ARCHIVED\n0\n";
+	    cap_pipe_send($p_out, "MSG_ARCHIVED", "") or
+		err("failed to send message to Master Program: $!",'E');
 	    pipe_out_close();
 	}
 	else {
@@ -1,6 +1,6 @@
 /* File Name: buffer.cpp
    Author: Grant Gipson
-   Date Last Edited: April 16, 2011
+   Date Last Edited: October 16, 2026
    Description: Implements CAP_PipeBuffer class
 */
 
@@ -11,18 +11,19 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 
 /* CAP_PipeBuffer::CAP_PipeBuffer()
    Class constructor */
 CAP_PipeBuffer::CAP_PipeBuffer(int _size, CAP_Log* _errlog, string _pipename)
-  : data(NULL),curr(NULL),used(0),pipename(_pipename)
+  : data(NULL),curr(NULL),used(0),refs(0),pipename(_pipename)
 {
   /* check parameters */
   if( !_errlog ) { throw CAP_PipeException(EXCPIPE_NOERRLOG); }
   else { errlog=_errlog; }
   
   if( !_size ) { throw CAP_PipeException(EXCPIPE_BUFFEREMPTY); }
-  else { size=_size; }
+  else { size=_size; limit=PIPE_BUFFER_MAX; }
   
   /* allocate data buffer */
   if( !(data=(char*)malloc(size)) ) {
@@ -39,51 +40,202 @@ CAP_PipeBuffer::CAP_PipeBuffer(int _size, CAP_Log* _errlog, string _pipename)
    Class destructor */
 CAP_PipeBuffer::~CAP_PipeBuffer() {
   /* free data buffer */
+  if( refs ) {
+    errlog->writef("Pipe %s buffer freed while %d messages refer to it", 
+		   LOG_ERROR, pipename.c_str(), refs);
+  }
   if( data ) { free(data); }
 }
 
-/* CAP_PipeBuffer::next()
-   Returns next character in buffer */
-char CAP_PipeBuffer::next() {
-  char ret='\0';
-  
-  /* check for end of buffer */
-  if( curr-data >= used ) {
-    throw CAP_PipeException(EXCPIPE_BUFFEREMPTY);
+/* CAP_PipeBuffer::getLine()
+   Appends buffered characters up to *delim* onto dest. Returns true once 
+   delimiter has been consumed or dest holds *max* characters; false means 
+   buffer ran dry and more must be read. Search uses memchr(), which libc 
+   implements with SSE2/AVX2 so a line costs a few vector compares. */
+bool CAP_PipeBuffer::getLine(string& dest, int max, char delim) {
+  int avail = used-(curr-data);
+  int room = max-dest.length();
+  if( room <= 0 ) { return true; }
+  if( avail > room ) { avail = room; }
+
+  char* end = (char*)memchr(curr, delim, avail);
+  if( end ) {
+    dest.append(curr, end-curr);
+    curr = end+1; /* skip delimiter */
+    return true;
   }
-  else {
-    ret = *curr; /* return character */
-    curr++;      /* advance pointer */
+
+  dest.append(curr, avail);
+  curr += avail;
+  return (int)dest.length() >= max;
+}
+
+/* CAP_PipeBuffer::get()
+   Appends up to *length* buffered characters onto dest; returns number of 
+   characters taken */
+int CAP_PipeBuffer::get(string& dest, int length) {
+  int avail = used-(curr-data);
+  if( avail > length ) { avail = length; }
+  if( avail <= 0 ) { return 0; }
+
+  dest.append(curr, avail);
+  curr += avail;
+  return avail;
+}
+
+/* CAP_PipeBuffer::findLine()
+   Looks for *delim* within unread data starting *offset* characters ahead 
+   without consuming anything. Returns true and length of line (excluding 
+   delimiter) if found within *max* characters. */
+bool CAP_PipeBuffer::findLine(int offset, int max, char delim, 
+  int& len) const
+{
+  int avail = pending()-offset;
+  if( avail <= 0 ) { return false; }
+  if( avail > max ) { avail = max; }
+
+  const char* end = (const char*)memchr(curr+offset, delim, avail);
+  if( !end ) { return false; }
+
+  len = end-(curr+offset);
+  return true;
+}
+
+/* CAP_PipeBuffer::makeRoom()
+   Frees at least *want* characters at end of buffer, if limit allows. 
+   Unread data is moved to the front when that is enough; otherwise buffer 
+   grows and unread data is moved in the same copy. */
+void CAP_PipeBuffer::makeRoom(int want) {
+  /* moving data would invalidate messages referring to it */
+  if( refs ) {
+    errlog->writef("Pipe %s buffer is full while %d messages refer to it", 
+		   LOG_ERROR, pipename.c_str(), refs);
+    throw CAP_PipeException(EXCPIPE_BUFFERFAIL);
+  }
+
+  int unread = pending();
+  int newsize = size;
+  while( newsize < unread+want && newsize < limit ) {
+    newsize *= 2;
+  }
+  if( newsize > limit ) { newsize = limit; }
+  if( newsize <= unread ) {
+    errlog->writef("Pipe %s buffer has reached its limit of %d bytes", 
+		   LOG_ERROR, pipename.c_str(), limit);
+    throw CAP_PipeException(EXCPIPE_BUFFERFAIL);
+  }
+
+  /* move unread data to the front first so realloc() copies only that */
+  if( curr > data ) {
+    memmove(data, curr, unread);
+    curr = data;
+    used = unread;
+  }
+
+  if( newsize != size ) {
+    char* grown = (char*)realloc(data, newsize);
+    if( !grown ) {
+      errlog->writef("Pipe %s failed to grow data buffer", LOG_ERROR, 
+		     pipename.c_str());
+      throw CAP_PipeException(EXCPIPE_BUFFERFAIL);
+    }
+    data = grown;
+    curr = data;
+    size = newsize;
   }
-  return ret;
+}
+
+/* CAP_PipeBuffer::setLimit()
+   Sets the size buffer may grow to */
+void CAP_PipeBuffer::setLimit(int _limit) {
+  limit = _limit < size ? size : _limit;
 }
 
 /* CAP_PipeBuffer::read()
-   Reads data into buffer */
-void CAP_PipeBuffer::read(int fileD) {
-  /* check buffer and make sure it's empty */
-  if( curr-data < used ) {
-    errlog->writef("Pipe %s attempted read into non-empty buffer", 
-		   LOG_ERROR, pipename.c_str());
-    throw CAP_PipeException(EXCPIPE_READFAIL);
-  }
-  
-  /* check file descriptor */
-  if( !fileD ) { 
+   Reads everything transport has available onto end of any unread data. 
+   *need* is the number of unread characters caller knows it is waiting 
+   for. Returns number of characters read, zero at end-of-file, or -1 if 
+   nothing had arrived. */
+int CAP_PipeBuffer::read(CAP_Transport* transport, int need) {
+  /* check transport */
+  if( !transport || !transport->isOpen() ) { 
     errlog->writef("Pipe %s attempted to read into buffer without a "
 		   "file descriptor", LOG_ERROR, pipename.c_str());
     throw CAP_PipeException(EXCPIPE_READFAIL);
   }
-  
+
+  /* start from the front whenever everything has been read */
+  if( !pending() && !refs ) {
+    curr=data;
+    used=0;
+  }
+
+  /* make room for whatever kernel is holding (at least an atomic write), 
+     or for the rest of a message known to be incomplete, so one read 
+     takes it all */
+  int avail = transport->available();
+  if( avail <= 0 ) { avail = PIPE_BUF; }
+  if( avail > PIPE_READ_MAX ) { avail = PIPE_READ_MAX; }
+  if( need-pending() > avail ) { avail = need-pending(); }
+  if( size-used < avail ) {
+    makeRoom(avail);
+  }
+
   /* read data into buffer */
-  curr=data;
-  if( (used=::read(fileD, data, size)) == -1 ) { /* error */
+  int n;
+  if( (n=transport->read(data+used, size-used)) == -1 ) { /* error */
+    if( errno == EAGAIN ) { return -1; }
     errlog->writef("Pipe %s failed to read data into buffer: %d", 
 		   LOG_ERROR, pipename.c_str(), errno);
-    used=0;
     throw CAP_PipeException(EXCPIPE_READFAIL);
   }
-  
-  errlog->writef("Pipe %s read %d bytes into buffer", LOG_INFO, 
-		 pipename.c_str(), used);
+  used += n;
+  return n;
+}
+
+/* CAP_PipeMessageRef::CAP_PipeMessageRef()
+   Copy constructor; copy shares buffer space with original */
+CAP_PipeMessageRef::CAP_PipeMessageRef(const CAP_PipeMessageRef& ref)
+  : owner(ref.owner), type(ref.type), command(ref.command), body(ref.body)
+{
+  if( owner ) { owner->hold(); }
+}
+
+/* CAP_PipeMessageRef::operator=()
+   Assignment; releases space held before taking a share of ref's */
+CAP_PipeMessageRef& CAP_PipeMessageRef::operator=(
+  const CAP_PipeMessageRef& ref)
+{
+  if( ref.owner ) { ref.owner->hold(); }
+  release();
+  owner = ref.owner;
+  type = ref.type;
+  command = ref.command;
+  body = ref.body;
+  return *this;
+}
+
+/* CAP_PipeMessageRef::attach()
+   Points message at buffer space; caller has already consumed it */
+void CAP_PipeMessageRef::attach(CAP_PipeBuffer* buf, int _type, 
+  CAP_StrRef _command, CAP_StrRef _body)
+{
+  release();
+  owner = buf;
+  if( owner ) { owner->hold(); }
+  type = _type;
+  command = _command;
+  body = _body;
+}
+
+/* CAP_PipeMessageRef::release()
+   Gives up message's claim on buffer space */
+void CAP_PipeMessageRef::release() {
+  if( owner ) {
+    owner->release();
+    owner = NULL;
+  }
+  type = MSGT_NAMED;
+  command = CAP_StrRef();
+  body = CAP_StrRef();
 }
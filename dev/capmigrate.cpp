@@ -0,0 +1,464 @@
+/*******************************************************************************
+  File Name: capmigrate.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Brings the database named in the configuration file up to
+    the schema version this Master Program expects, and measures the queue
+    queries against a table seeded with history.
+    Usage: capmigrate <capconf.xml> status
+           capmigrate <capconf.xml> up
+           capmigrate <capconf.xml> seed [jobs]
+           capmigrate <capconf.xml> bench [loops]
+*******************************************************************************/
+#include "xml.h"
+#include "store.h"
+#include <mysql_driver.h>
+#include <mysql_connection.h>
+#include <cppconn/exception.h>
+#include <cppconn/statement.h>
+#include <cppconn/resultset.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#define SEED_BATCH 1000     /* rows per insert statement while seeding */
+#define SEED_PENDING 100    /* waiting jobs seeded behind the history */
+
+/* one step of schema. Index steps name their index so one already made
+   by hand is recorded rather than made again. */
+struct Migration {
+  int version;         /* applied in this order */
+  const char* desc;    /* recorded with version */
+  const char* table;   /* table an index step adds to; NULL otherwise */
+  const char* index;   /* index an index step adds; NULL otherwise */
+  const char* mysql;   /* statement for MySQL */
+  const char* sqlite;  /* statement for SQLite */
+};
+
+static const Migration migrations[] = {
+  { 1, "job queue index", "job", "job_status_id",
+    "create index job_status_id on job (status, id)",
+    "create index if not exists job_status_id on job (status, id)" },
+  { 2, "pending archive index", "archive", "archive_pending",
+    "create index archive_pending on archive (cmpl_date)",
+    "create index if not exists archive_pending on archive (cmpl_date)" },
+  { 3, "archive items index", "archive_content", "archive_content_archive",
+    "create index archive_content_archive on archive_content "
+      "(archive_id, content_id)",
+    "create index if not exists archive_content_archive on archive_content "
+      "(archive_id, content_id)" },
+  { 4, "finished job history", NULL, NULL,
+    "create table if not exists job_history like job",
+    "create table if not exists job_history ("
+      "id integer primary key, user_id integer not null, "
+      "type char(2) not null, status char(1) not null, url text not null, "
+      "cmpl_date datetime)" },
+  { 5, "spooled request keys", NULL, NULL,
+    "create table if not exists request_key ("
+      "id bigint unsigned not null primary key)",
+    "create table if not exists request_key (id integer primary key)" }
+};
+static const int nMigrations = sizeof(migrations)/sizeof(migrations[0]);
+
+/* queries master polls with; timed by bench */
+static const char* const bench_sql[] = {
+  "select id, user_id, type, url from job where status='P' "
+  "order by id limit 8",
+  "select pending.id, pending.user_id, item.id, item.title "
+  "from (select archive.id, content.user_id "
+    "from archive inner join content on content.id=archive.id "
+    "where archive.cmpl_date is null limit 1) pending "
+  "left join archive_content on archive_content.archive_id=pending.id "
+  "left join content item on item.id=archive_content.content_id"
+};
+static const char* const bench_names[] = { "job claim", "archive select" };
+
+/* now()
+   Returns monotonic time in seconds */
+static double now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/* database being migrated; statements either run or throw a message */
+class SchemaDb {
+ public:
+  virtual ~SchemaDb() {}
+  virtual bool isMysql() const = 0;
+  virtual void exec(const string& sql) = 0;
+  virtual long scalar(const string& sql) = 0;  /* -1 if NULL or no row */
+  virtual void plan(const string& sql) = 0;    /* prints query plan */
+  virtual bool hasIndex(const char* table, const char* index) = 0;
+};
+
+/* MySQL through Connector/C++ */
+class MysqlSchemaDb : public SchemaDb {
+ protected:
+  sql::Connection* conn;
+
+ public:
+  MysqlSchemaDb(const string& connect, const string& user,
+    const string& passwd) : conn(NULL)
+  {
+    try {
+      conn = sql::mysql::get_driver_instance()->connect(connect.c_str(),
+        user.c_str(), passwd.c_str());
+    }
+    catch( sql::SQLException& err ) {
+      throw string("failed to connect to database: ") + err.what();
+    }
+  }
+  ~MysqlSchemaDb() { delete conn; }
+
+  bool isMysql() const { return true; }
+
+  void exec(const string& sql) {
+    sql::Statement* stmt=NULL;
+    try {
+      stmt = conn->createStatement();
+      stmt->execute(sql);
+    }
+    catch( sql::SQLException& err ) {
+      delete stmt;
+      throw sql + ": " + err.what();
+    }
+    delete stmt;
+  }
+
+  long scalar(const string& sql) {
+    sql::Statement* stmt=NULL;
+    sql::ResultSet* res=NULL;
+    long value=-1;
+    try {
+      stmt = conn->createStatement();
+      res = stmt->executeQuery(sql);
+      if( res->next() && !res->isNull(1) ) { value = res->getInt(1); }
+    }
+    catch( sql::SQLException& err ) {
+      delete res;
+      delete stmt;
+      throw sql + ": " + err.what();
+    }
+    delete res;
+    delete stmt;
+    return value;
+  }
+
+  void plan(const string& sql) {
+    sql::Statement* stmt=NULL;
+    sql::ResultSet* res=NULL;
+    try {
+      stmt = conn->createStatement();
+      res = stmt->executeQuery("explain " + sql);
+      while( res->next() ) {
+        cout << "    table " << res->getString("table")
+             << ", type " << res->getString("type")
+             << ", key " << res->getString("key")
+             << ", rows " << res->getString("rows") << endl;
+      }
+    }
+    catch( sql::SQLException& err ) {
+      delete res;
+      delete stmt;
+      throw sql + ": " + err.what();
+    }
+    delete res;
+    delete stmt;
+  }
+
+  bool hasIndex(const char* table, const char* index) {
+    return scalar(string("select count(*) from information_schema.statistics "
+      "where table_schema=database() and table_name='") + table +
+      "' and index_name='" + index + "'") > 0;
+  }
+};
+
+/* SQLite database file */
+class SqliteSchemaDb : public SchemaDb {
+ protected:
+  sqlite3* db;
+
+ public:
+  SqliteSchemaDb(const string& file) : db(NULL) {
+    if( sqlite3_open_v2(file.c_str(), &db, SQLITE_OPEN_READWRITE, NULL) !=
+        SQLITE_OK ) {
+      string msg = "failed to open database file " + file + ": " +
+        (db ? sqlite3_errmsg(db) : "out of memory");
+      sqlite3_close(db);
+      throw msg;
+    }
+    sqlite3_busy_timeout(db, 5000);
+  }
+  ~SqliteSchemaDb() { sqlite3_close(db); }
+
+  bool isMysql() const { return false; }
+
+  void exec(const string& sql) {
+    char* err=NULL;
+    if( sqlite3_exec(db, sql.c_str(), NULL, NULL, &err) != SQLITE_OK ) {
+      string msg = sql + ": " + (err ? err : "");
+      sqlite3_free(err);
+      throw msg;
+    }
+  }
+
+  long scalar(const string& sql) {
+    sqlite3_stmt* stmt=NULL;
+    if( sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK ) {
+      throw sql + ": " + sqlite3_errmsg(db);
+    }
+    long value=-1;
+    int rc = sqlite3_step(stmt);
+    if( rc == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL ) {
+      value = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if( rc != SQLITE_ROW && rc != SQLITE_DONE ) {
+      throw sql + ": " + sqlite3_errmsg(db);
+    }
+    return value;
+  }
+
+  void plan(const string& sql) {
+    sqlite3_stmt* stmt=NULL;
+    string explain = "explain query plan " + sql;
+    if( sqlite3_prepare_v2(db, explain.c_str(), -1, &stmt, NULL) !=
+        SQLITE_OK ) {
+      throw sql + ": " + sqlite3_errmsg(db);
+    }
+    while( sqlite3_step(stmt) == SQLITE_ROW ) {
+      cout << "    " << (const char*)sqlite3_column_text(stmt, 3) << endl;
+    }
+    sqlite3_finalize(stmt);
+  }
+
+  bool hasIndex(const char* table, const char* index) {
+    return scalar(string("select count(*) from sqlite_master "
+      "where type='index' and tbl_name='") + table + "' and name='" +
+      index + "'") > 0;
+  }
+};
+
+/* openDb()
+   Connects to database configured under database in *xml* */
+static SchemaDb* openDb(CAP_XML& xml) {
+  string strBackend;
+  if( xml.getValue("database.backend", strBackend) && strBackend == "sqlite" ) {
+    string strFile;
+    if( !xml.getValue("database.sqlite_file", strFile) ) {
+      throw string("failed to read SQLite database file from XML");
+    }
+    return new SqliteSchemaDb(strFile);
+  }
+  if( !strBackend.empty() && strBackend != "mysql" ) {
+    throw "database backend " + strBackend + " has no schema";
+  }
+
+  string strConnect, strUser, strPasswd;
+  if( !xml.getValue("database.connect", strConnect) ||
+      !xml.getValue("database.master_user", strUser) ||
+      !xml.getValue("database.master_password", strPasswd) ) {
+    throw string("failed to read database connection from XML");
+  }
+  return new MysqlSchemaDb(strConnect, strUser, strPasswd);
+}
+
+/* currentVersion()
+   Newest version applied; zero for a database never migrated */
+static int currentVersion(SchemaDb& db) {
+  db.exec("create table if not exists schema_version ("
+    "version int not null primary key, applied datetime not null, "
+    "description varchar(128) not null)");
+  long version = db.scalar("select max(version) from schema_version");
+  return version < 0 ? 0 : (int)version;
+}
+
+/* status()
+   Prints version database is at and steps not yet applied */
+static int status(SchemaDb& db) {
+  int version = currentVersion(db);
+  cout << "schema version " << version << " of "
+       << migrations[nMigrations-1].version << endl;
+  for( int i=0; i<nMigrations; i++ ) {
+    if( migrations[i].version > version ) {
+      cout << "  pending " << migrations[i].version << ": "
+           << migrations[i].desc << endl;
+    }
+  }
+  return 0;
+}
+
+/* up()
+   Applies every step newer than database's version, in order; each is
+   recorded as soon as it has been applied */
+static int up(SchemaDb& db) {
+  int version = currentVersion(db);
+  for( int i=0; i<nMigrations; i++ ) {
+    const Migration& m = migrations[i];
+    if( m.version <= version ) { continue; }
+
+    double start = now();
+    if( m.index && db.hasIndex(m.table, m.index) ) {
+      cout << "  " << m.version << ": " << m.desc << " (already there)"
+           << endl;
+    }
+    else {
+      db.exec(db.isMysql() ? m.mysql : m.sqlite);
+      printf("  %d: %s (%.2f sec)\n", m.version, m.desc, now()-start);
+    }
+
+    char sz[256];
+    sprintf(sz, "insert into schema_version (version, applied, description) "
+      "values (%d, %s, '%s')", m.version,
+      db.isMysql() ? "now()" : "datetime('now')", m.desc);
+    db.exec(sz);
+  }
+  cout << "schema version " << migrations[nMigrations-1].version << endl;
+  return 0;
+}
+
+/* seed()
+   Adds *count* finished jobs and a tenth as many finished archives of
+   one item each, then a few waiting jobs and one waiting archive at the
+   end, as a long-running install would have */
+static int seed(SchemaDb& db, long count) {
+  const char* date = db.isMysql() ? "now()" : "datetime('now')";
+  long base = db.scalar("select max(id) from content");
+  if( base < 0 ) { base = 0; }
+  double start = now();
+  char sz[128];
+
+  string sql;
+  for( long i=0; i<count; i+=SEED_BATCH ) {
+    db.exec("begin");
+    sql.assign("insert into job (user_id,type,status,url,cmpl_date) values ");
+    for( long j=i; j<i+SEED_BATCH && j<count; j++ ) {
+      sprintf(sz, "%s(1,'dS','%c','http://seed/%ld',%s)", j>i ? "," : "",
+        j%20 ? 'C' : 'F', j, date);
+      sql.append(sz);
+    }
+    db.exec(sql);
+    db.exec("commit");
+  }
+
+  /* every archive is its own content item too */
+  long archives = count/10;
+  for( long i=0; i<archives; i+=SEED_BATCH ) {
+    long n = i+SEED_BATCH < archives ? SEED_BATCH : archives-i;
+    db.exec("begin");
+    string content("insert into content (id,user_id,folder_id,add_date,"
+      "status,title) values ");
+    string archive("insert into archive (id,cmpl_date) values ");
+    string items("insert into archive_content (archive_id,content_id) "
+      "values ");
+    for( long j=0; j<n; j++ ) {
+      long id = base + 2*(i+j) + 1;
+      sprintf(sz, "%s(%ld,1,1,%s,'A','seed %ld')", j ? "," : "", id, date,
+        id);
+      content.append(sz);
+      sprintf(sz, "%s(%ld,1,1,%s,'A','seed %ld')", ",", id+1, date, id+1);
+      content.append(sz);
+      sprintf(sz, "%s(%ld,%s)", j ? "," : "", id, date);
+      archive.append(sz);
+      sprintf(sz, "%s(%ld,%ld)", j ? "," : "", id, id+1);
+      items.append(sz);
+    }
+    db.exec(content);
+    db.exec(archive);
+    db.exec(items);
+    db.exec("commit");
+  }
+
+  db.exec("begin");
+  sql.assign("insert into job (user_id,type,status,url) values ");
+  for( int j=0; j<SEED_PENDING; j++ ) {
+    sprintf(sz, "%s(1,'dS','P','http://seed/pending/%d')", j ? "," : "", j);
+    sql.append(sz);
+  }
+  db.exec(sql);
+  long id = base + 2*archives + 1;
+  sprintf(sz, "insert into content (id,user_id,folder_id,add_date,status,"
+    "title) values (%ld,1,1,%s,'A','seed pending')", id, date);
+  db.exec(sz);
+  sprintf(sz, "insert into archive (id) values (%ld)", id);
+  db.exec(sz);
+  db.exec("commit");
+
+  printf("seeded %ld jobs and %ld archives in %.1f sec\n", count+SEED_PENDING,
+    archives+1, now()-start);
+  return 0;
+}
+
+/* bench()
+   Times each query master polls with over *loops* runs and prints its
+   plan; an index scan takes about the same time whatever the history */
+static int bench(SchemaDb& db, long loops) {
+  cout << "schema version " << currentVersion(db) << ", "
+       << db.scalar("select count(*) from job") << " jobs, "
+       << db.scalar("select count(*) from archive") << " archives" << endl;
+
+  for( int q=0; q<2; q++ ) {
+    double start = now();
+    for( long i=0; i<loops; i++ ) {
+      db.scalar(bench_sql[q]);
+    }
+    double spent = now()-start;
+    printf("%-16s %10.1f usec per query\n", bench_names[q],
+      spent*1e6/loops);
+    db.plan(bench_sql[q]);
+  }
+  return 0;
+}
+
+// main()
+// Program entry point
+int main(int argc, char* argv[]) {
+  if( argc < 3 ) {
+    cerr << "usage: " << argv[0] << " <capconf.xml> status" << endl
+	 << "       " << argv[0] << " <capconf.xml> up" << endl
+	 << "       " << argv[0] << " <capconf.xml> seed [jobs]" << endl
+	 << "       " << argv[0] << " <capconf.xml> bench [loops]" << endl;
+    return 1;
+  }
+
+  CAP_XML* xml=NULL;
+  SchemaDb* db=NULL;
+  int ret=1;
+  try {
+    xml = new CAP_XML(argv[1]);
+    db = openDb(*xml);
+
+    if( !strcmp(argv[2], "status") ) {
+      ret = status(*db);
+    }
+    else if( !strcmp(argv[2], "up") ) {
+      ret = up(*db);
+    }
+    else if( !strcmp(argv[2], "seed") ) {
+      ret = seed(*db, argc > 3 ? atol(argv[3]) : 1000000);
+    }
+    else if( !strcmp(argv[2], "bench") ) {
+      ret = bench(*db, argc > 3 ? atol(argv[3]) : 1000);
+    }
+    else {
+      cerr << "unknown command " << argv[2] << endl;
+    }
+  }
+  catch( CAP_XMLException err ) {
+    cerr << err.strmsg << endl;
+  }
+  catch( string& err ) {
+    cerr << err << endl;
+    ret = 1;
+  }
+
+  delete db;
+  delete xml;
+  return ret;
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/perl
+
+# File Name: cappipe.pl
+# Author: Grant Gipson
+# Date Last Edited: October 16, 2026
+# Description: Sends messages to the Master Program in binary frames
+#   (protocol version 2; see frame.h) for Senior CAP Project components
+#   written in Perl. Load with require.
+
+use strict;
+use warnings;
+use POSIX qw(PIPE_BUF);
+
+# frame header layout; every field is little-endian
+use constant FRAME_HEADER_SIZE => 20;
+use constant FRAME_VERSION => 2;
+use constant FRAME_FLAG_MORE => 0x0001; # body continues in next frame
+use constant FRAME_FLAG_CONT => 0x0002; # body continues last frame
+
+my $cap_seq = 0; # sequence number of last frame sent
+
+# writes message to an open pipe as frames of at most PIPE_BUF characters,
+# each with a single write, so nothing another process writes into the
+# pipe can land inside one; a body too long for one frame continues in
+# more. Master looks command up by name. Returns false on failure.
+sub cap_pipe_send {
+    (my $pipe, my $command, my $body) = @_;
+    utf8::encode($body) if utf8::is_utf8($body);
+
+    # first frame must hold command name and some of body
+    return 0 if PIPE_BUF-FRAME_HEADER_SIZE-length($command) <= 0;
+
+    my $sent = 0;
+    my $first = 1;
+    while( $first || $sent < length($body) ) {
+	my $name = $first ? $command : "";
+	my $take = length($body)-$sent;
+	my $room = PIPE_BUF-FRAME_HEADER_SIZE-length($name);
+	$take = $room if $take > $room;
+
+	my $flags = ($sent+$take < length($body) ? FRAME_FLAG_MORE : 0) |
+	    ($first ? 0 : FRAME_FLAG_CONT);
+	$cap_seq = ($cap_seq+1) & 0xffffffff;
+
+	# magic, version, type (named), flags, name length, body length,
+	# sequence number, sender
+	my $frame = pack("CCCCvvVVV", 0xCA, 0x50, FRAME_VERSION, 0, $flags,
+			 length($name), $take, $cap_seq, $$)
+	    . $name . substr($body, $sent, $take);
+	my $n = syswrite($pipe, $frame);
+	return 0 if !defined($n) || $n != length($frame);
+
+	$sent += $take;
+	$first = 0;
+    }
+    return 1;
+}
+
+1;
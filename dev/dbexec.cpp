@@ -0,0 +1,218 @@
+/*******************************************************************************
+  File Name: dbexec.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_DbExecutor class
+*******************************************************************************/
+#include "dbexec.h"
+#include <signal.h>
+using namespace std;
+
+/* CAP_DbExecutor::CAP_DbExecutor()
+   Constructor; threads are not started until start() */
+CAP_DbExecutor::CAP_DbExecutor(CAP_Log* _errlog, CAP_Store* _store)
+  : errlog(_errlog), store(_store), started(false), stopping(false), wakeD(-1)
+{
+  if( !errlog ) { throw CAP_Exception(CAPEXC_NOERRLOG); }
+  if( !store ) { throw CAP_Exception(CAPEXC_INVALPARAM); }
+  for( int i=0; i<DBLANE_MAX; i++ ) { busy[i]=false; }
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&ready, NULL);
+}
+
+/* CAP_DbExecutor::~CAP_DbExecutor()
+   Destructor; runs whatever is still queued, discards completions never
+   called */
+CAP_DbExecutor::~CAP_DbExecutor() {
+  stop();
+  while( !done.empty() ) {
+    delete done.front();
+    done.pop_front();
+  }
+  pthread_cond_destroy(&ready);
+  pthread_mutex_destroy(&lock);
+}
+
+/* CAP_DbExecutor::lane()
+   Lane an operation runs in */
+DbLane CAP_DbExecutor::lane(DbOpKind kind) {
+  switch( kind ) {
+  case DBOP_JOB_INSERT:
+  case DBOP_JOB_CLAIM:
+  case DBOP_JOB_RETIRE:
+  case DBOP_KEY_PRUNE:
+  case DBOP_JOB_RELEASE:
+    return DBLANE_JOB;
+  case DBOP_ARCHIVE_INSERT:
+  case DBOP_ARCHIVE_SELECT:
+  case DBOP_STATUS_FLUSH:
+    return DBLANE_ARCHIVE;
+  default:
+    return DBLANE_CONTENT;
+  }
+}
+
+/* CAP_DbExecutor::start()
+   Registers completion wakeup with event loop and starts *nthreads*
+   threads; more than one per lane, or than store can run at once, would 
+   only wait */
+void CAP_DbExecutor::start(CAP_EventLoop* events, int nthreads) {
+  wakeD = events->addWakeup(onDone, this);
+
+  if( nthreads > DBLANE_MAX ) { nthreads = DBLANE_MAX; }
+  if( nthreads > store->threads() ) { nthreads = store->threads(); }
+  if( nthreads < 1 ) { nthreads = 1; }
+
+  started = true;
+  for( int i=0; i<nthreads; i++ ) {
+    pthread_t thread;
+    int err = pthread_create(&thread, NULL, threadMain, this);
+    if( err ) {
+      errlog->writef("failed to start database thread: %d", LOG_FATAL, err);
+      if( threads.empty() ) { started = false; }
+      throw -1;
+    }
+    threads.push_back(thread);
+  }
+}
+
+/* CAP_DbExecutor::submit()
+   Queues operation; executor owns it from here on. Once stopped,
+   operation runs right away on caller's thread and completes on next
+   call to complete(). */
+void CAP_DbExecutor::submit(CAP_DbOp* op) {
+  pthread_mutex_lock(&lock);
+  if( started ) {
+    queue.push_back(op);
+    pthread_cond_broadcast(&ready);
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+  pthread_mutex_unlock(&lock);
+
+  run(*op);
+  done.push_back(op);
+}
+
+/* CAP_DbExecutor::complete()
+   Calls completion of every operation which has run. Rethrows first exit
+   status thrown by store. */
+void CAP_DbExecutor::complete() {
+  deque<CAP_DbOp*> batch;
+  pthread_mutex_lock(&lock);
+  batch.swap(done);
+  pthread_mutex_unlock(&lock);
+
+  while( !batch.empty() ) {
+    CAP_DbOp* op = batch.front();
+    batch.pop_front();
+
+    if( op->fatal ) {
+      int status = op->fatal;
+      delete op;
+      while( !batch.empty() ) { delete batch.front(); batch.pop_front(); }
+      throw status;
+    }
+
+    try {
+      if( op->done ) { (*op->done)(*op, op->ctx); }
+    }
+    catch( ... ) {
+      delete op;
+      while( !batch.empty() ) { delete batch.front(); batch.pop_front(); }
+      throw;
+    }
+    delete op;
+  }
+}
+
+/* CAP_DbExecutor::stop()
+   Lets threads run everything queued and waits for them to exit. 
+   Completions are left for complete(). */
+void CAP_DbExecutor::stop() {
+  pthread_mutex_lock(&lock);
+  if( !started ) {
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+  stopping = true;
+  pthread_cond_broadcast(&ready);
+  pthread_mutex_unlock(&lock);
+
+  for( unsigned i=0; i<threads.size(); i++ ) {
+    pthread_join(threads[i], NULL);
+  }
+  threads.clear();
+  started = false;
+}
+
+/* CAP_DbExecutor::next()
+   Takes first queued operation whose lane is free and marks lane busy; 
+   NULL if there is none. Caller holds lock. */
+CAP_DbOp* CAP_DbExecutor::next() {
+  for( deque<CAP_DbOp*>::iterator it=queue.begin(); it!=queue.end(); it++ ) {
+    DbLane l = lane((*it)->kind);
+    if( !busy[l] ) {
+      CAP_DbOp* op = *it;
+      queue.erase(it);
+      busy[l] = true;
+      return op;
+    }
+  }
+  return NULL;
+}
+
+/* CAP_DbExecutor::threadMain()
+   Database thread; runs operations until stopped and queue is empty */
+void* CAP_DbExecutor::threadMain(void* arg) {
+  CAP_DbExecutor* ex = (CAP_DbExecutor*)arg;
+
+  /* signals belong to event loop's signalfd */
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, NULL);
+  ex->store->threadInit();
+
+  pthread_mutex_lock(&ex->lock);
+  for(;;) {
+    CAP_DbOp* op;
+    while( !(op=ex->next()) && !(ex->stopping && ex->queue.empty()) ) {
+      pthread_cond_wait(&ex->ready, &ex->lock);
+    }
+    if( !op ) { break; }
+    pthread_mutex_unlock(&ex->lock);
+
+    ex->run(*op);
+
+    /* loop is raised only when done goes from empty; it takes the whole
+       queue each time it runs */
+    pthread_mutex_lock(&ex->lock);
+    ex->busy[lane(op->kind)] = false;
+    pthread_cond_broadcast(&ex->ready);
+    bool idle = ex->done.empty();
+    ex->done.push_back(op);
+    if( idle && ex->wakeD != -1 ) { CAP_EventLoop::wake(ex->wakeD); }
+  }
+  pthread_mutex_unlock(&ex->lock);
+
+  ex->store->threadEnd();
+  return NULL;
+}
+
+/* CAP_DbExecutor::onDone()
+   Wakeup handler; calls completions */
+void CAP_DbExecutor::onDone(int fd, unsigned events, void* ctx) {
+  ((CAP_DbExecutor*)ctx)->complete();
+}
+
+/* CAP_DbExecutor::run()
+   Runs one operation; failures are recorded in it for its completion */
+void CAP_DbExecutor::run(CAP_DbOp& op) {
+  try {
+    store->run(op);
+  }
+  catch( int err ) {
+    op.fatal = err ? err : -1;
+    op.ok = false;
+  }
+}
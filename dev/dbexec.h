@@ -0,0 +1,69 @@
+/*******************************************************************************
+  File Name: dbexec.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Runs store operations on threads of their own and hands
+    results back to the Master Program's event loop
+*******************************************************************************/
+#ifndef _DBEXEC_H_
+#define _DBEXEC_H_
+
+#include "master.h"
+#include "log.h"
+#include "event.h"
+#include "store.h"
+#include <pthread.h>
+#include <deque>
+#include <list>
+#include <vector>
+#include <string>
+using namespace std;
+
+/* operations in one lane run in the order submitted, one at a time; 
+   different lanes run side by side */
+enum DbLane {
+  DBLANE_JOB=0,     // job table
+  DBLANE_CONTENT=1, // downloaded content
+  DBLANE_ARCHIVE=2, // archives, and status changes so an archive marked 
+                    // finished is committed before the next select
+  DBLANE_MAX=3
+};
+
+/* Database threads, at most as many as store can run at once.
+   Operations in a lane run in the order submitted, so an operation may 
+   rely on everything submitted before it in its lane (a job finished 
+   before the next select); lanes run in parallel.
+   Completions run inside event loop through a wakeup; an exit status
+   thrown by store is rethrown there, where handlers throw theirs. */
+class CAP_DbExecutor {
+ protected:
+  CAP_Log* errlog;          /* log events are written to */
+  CAP_Store* store;         /* runs operations */
+  vector<pthread_t> threads;/* run operations */
+  bool started;             /* threads are running */
+  bool stopping;            /* threads should exit once queue is empty */
+  bool busy[DBLANE_MAX];    /* lane has an operation running */
+  pthread_mutex_t lock;     /* guards queues, busy and stopping */
+  pthread_cond_t ready;     /* broadcast when an operation may be runnable */
+  deque<CAP_DbOp*> queue;   /* submitted; not yet run */
+  deque<CAP_DbOp*> done;    /* run; completion not yet called */
+  int wakeD;                /* event loop wakeup raised when done fills */
+
+  static void* threadMain(void* arg);
+  static void onDone(int fd, unsigned events, void* ctx);
+  CAP_DbOp* next();
+  void run(CAP_DbOp& op);
+
+ public:
+  CAP_DbExecutor(CAP_Log* _errlog, CAP_Store* _store);
+  ~CAP_DbExecutor();
+
+  static DbLane lane(DbOpKind kind);
+  void start(CAP_EventLoop* events, int nthreads);
+  void submit(CAP_DbOp* op);
+  void complete();
+  void stop();
+  inline int getFd() const { return wakeD; }
+};
+
+#endif /* _DBEXEC_H_ */
@@ -0,0 +1,360 @@
+/*******************************************************************************
+  File Name: dbpool.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_DbConn and CAP_DbPool classes
+*******************************************************************************/
+#include "dbpool.h"
+using namespace std;
+
+/* client error codes meaning the server is no longer there */
+#define DB_SERVER_GONE 2006
+#define DB_SERVER_LOST 2013
+
+/* server error codes meaning another transaction held a lock; the 
+   statement may succeed if run again */
+#define DB_LOCK_WAIT 1205
+#define DB_DEADLOCK 1213
+
+#define DB_PACKET_DEFAULT 1048576 /* server's max_allowed_packet if it can't 
+                                     be read (MySQL 5 default) */
+#define DB_PACKET_SLACK 1024      /* kept free for protocol overhead */
+
+/* usec_now()
+   Monotonic clock in microseconds */
+static unsigned long usec_now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000UL + ts.tv_nsec/1000;
+}
+
+/* CAP_DbConn::CAP_DbConn()
+   Constructor; not connected until pool connects it */
+CAP_DbConn::CAP_DbConn(CAP_Log* _errlog)
+  : errlog(_errlog), conn(NULL), plain(NULL), broken(false), 
+    contended(false), lastUsed(0), maxPacket(0)
+{
+  for( int i=0; i<STMT_MAX; i++ ) { stmts[i]=NULL; }
+}
+
+/* CAP_DbConn::~CAP_DbConn()
+   Destructor */
+CAP_DbConn::~CAP_DbConn() {
+  discard();
+}
+
+/* CAP_DbConn::discard()
+   Closes connection along with its statements */
+void CAP_DbConn::discard() {
+  for( int i=0; i<STMT_MAX; i++ ) {
+    try { delete stmts[i]; }
+    catch( SQLException& err ) {}
+    stmts[i]=NULL;
+  }
+  try { delete plain; }
+  catch( SQLException& err ) {}
+  plain=NULL;
+  try { delete conn; }
+  catch( SQLException& err ) {}
+  conn=NULL;
+  maxPacket=0;
+}
+
+/* CAP_DbConn::stmt()
+   Returns statement *id*, preparing it if prepareAll() has not. Throws
+   CAP_Exception(CAPEXC_DBGONE) without a connection and -1 if statement
+   cannot be prepared. */
+PreparedStatement* CAP_DbConn::stmt(SqlStmt id) {
+  if( stmts[id] ) { return stmts[id]; }
+  if( !sql_defs[id].text ) { throw CAP_Exception(CAPEXC_INVALPARAM); }
+  if( !conn || broken ) { throw CAP_Exception(CAPEXC_DBGONE); }
+
+  try {
+    stmts[id] = conn->prepareStatement(sql_defs[id].text);
+  }
+  catch( SQLException& err ) {
+    if( lost(err) ) { throw CAP_Exception(CAPEXC_DBGONE); }
+    errlog->writef("failed to generate prepared SQL statement %s: what: %s, "
+      "code: %d, state: %s", LOG_FATAL, sql_defs[id].name, err.what(),
+      err.getErrorCode(), err.getSQLState().c_str());
+    throw -1;
+  }
+  return stmts[id];
+}
+
+/* CAP_DbConn::prepareAll()
+   Prepares every statement with text of its own, so a mistake in one is 
+   found on connecting rather than on first use. False if any failed. */
+bool CAP_DbConn::prepareAll() {
+  try {
+    for( int i=0; i<STMT_MAX; i++ ) {
+      if( sql_defs[i].text ) { stmt((SqlStmt)i); }
+    }
+    if( !plain ) { plain = conn->createStatement(); }
+  }
+  catch( CAP_Exception& err ) { return false; }
+  catch( SQLException& err ) {
+    lost(err);
+    errlog->writef("failed to create SQL statement: what: %s", LOG_FATAL,
+      err.what());
+    return false;
+  }
+  catch( int err ) { return false; }
+  return true;
+}
+
+/* CAP_DbConn::timed()
+   Counts one execution of statement *id* begun at *start*; one slower 
+   than CAP_DB_SLOW_MSEC is logged as it happens */
+void CAP_DbConn::timed(SqlStmt id, unsigned long start, bool failed) {
+  unsigned long spent = usec_now()-start;
+  CAP_SqlStat& stat = stats[id];
+  stat.calls++;
+  stat.usecs += spent;
+  if( failed ) { stat.errors++; }
+  if( spent > stat.maxUsecs ) { stat.maxUsecs = spent; }
+  if( spent > CAP_DB_SLOW_MSEC*1000UL ) {
+    errlog->writef("statement %s took %lu usec", LOG_WARNING, 
+      sql_defs[id].name, spent);
+  }
+}
+
+/* CAP_DbConn::query()
+   Runs prepared statement *id* with parameters already set; caller owns 
+   result set */
+ResultSet* CAP_DbConn::query(SqlStmt id) {
+  PreparedStatement* pstmt = stmt(id);
+  unsigned long start = usec_now();
+  ResultSet* res;
+  try { res = pstmt->executeQuery(); }
+  catch( SQLException& err ) {
+    timed(id, start, true);
+    throw;
+  }
+  timed(id, start, false);
+  return res;
+}
+
+/* CAP_DbConn::update()
+   Runs prepared statement *id* with parameters already set; returns rows 
+   changed */
+int CAP_DbConn::update(SqlStmt id) {
+  return update(id, stmt(id));
+}
+
+/* CAP_DbConn::update()
+   Runs *sql*, built by caller, counting it as statement *id* */
+int CAP_DbConn::update(SqlStmt id, const string& sql) {
+  if( !plain ) { throw CAP_Exception(CAPEXC_DBGONE); }
+  unsigned long start = usec_now();
+  int ret;
+  try { ret = plain->executeUpdate(sql); }
+  catch( SQLException& err ) {
+    timed(id, start, true);
+    throw;
+  }
+  timed(id, start, false);
+  return ret;
+}
+
+/* CAP_DbConn::update()
+   Runs *pstmt*, prepared by caller, counting it as statement *id* */
+int CAP_DbConn::update(SqlStmt id, PreparedStatement* pstmt) {
+  unsigned long start = usec_now();
+  int ret;
+  try { ret = pstmt->executeUpdate(); }
+  catch( SQLException& err ) {
+    timed(id, start, true);
+    throw;
+  }
+  timed(id, start, false);
+  return ret;
+}
+
+/* CAP_DbConn::lost()
+   Marks connection broken if *err* says server has gone away; pool
+   replaces it before it is used again. Notes a deadlock or lock wait 
+   timeout as well, as running again may then succeed. */
+bool CAP_DbConn::lost(const SQLException& err) {
+  if( err.getErrorCode() == DB_SERVER_GONE ||
+      err.getErrorCode() == DB_SERVER_LOST ) {
+    broken=true;
+  }
+  else if( err.getErrorCode() == DB_DEADLOCK ||
+           err.getErrorCode() == DB_LOCK_WAIT ) {
+    contended=true;
+  }
+  return broken;
+}
+
+/* CAP_DbConn::packetMax()
+   Longest statement which may be sent, less room for protocol overhead; 
+   asked of server once per connection */
+unsigned long CAP_DbConn::packetMax() {
+  if( maxPacket ) { return maxPacket; }
+  if( !conn || broken ) { throw CAP_Exception(CAPEXC_DBGONE); }
+
+  unsigned long packet = DB_PACKET_DEFAULT;
+  Statement* stmt=NULL;
+  ResultSet* res=NULL;
+  try {
+    stmt = conn->createStatement();
+    res = stmt->executeQuery("select @@max_allowed_packet");
+    if( res->next() ) { packet = res->getUInt64(1); }
+  }
+  catch( SQLException& err ) {
+    if( lost(err) ) { 
+      delete res;
+      delete stmt;
+      throw CAP_Exception(CAPEXC_DBGONE); 
+    }
+    errlog->writef("failed to read max_allowed_packet; assuming %lu: %s", 
+      LOG_WARNING, packet, err.what());
+  }
+  delete res;
+  delete stmt;
+
+  maxPacket = packet > 2*DB_PACKET_SLACK ? packet-DB_PACKET_SLACK : packet/2;
+  return maxPacket;
+}
+
+/* CAP_DbPool::CAP_DbPool()
+   Constructor; connections are not opened until open() */
+CAP_DbPool::CAP_DbPool(CAP_Log* _errlog, const string& _connect,
+  const string& _user, const string& _passwd)
+  : errlog(_errlog), driver(NULL), strConnect(_connect), strUser(_user),
+    strPasswd(_passwd)
+{
+  if( !errlog ) { throw CAP_Exception(CAPEXC_NOERRLOG); }
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&freed, NULL);
+}
+
+/* CAP_DbPool::~CAP_DbPool()
+   Destructor; closes every connection. Nothing may still hold one. */
+CAP_DbPool::~CAP_DbPool() {
+  for( unsigned i=0; i<conns.size(); i++ ) {
+    delete conns[i];
+  }
+  pthread_cond_destroy(&freed);
+  pthread_mutex_destroy(&lock);
+}
+
+/* CAP_DbPool::connect()
+   (Re)opens connection and prepares its statements; left disconnected on 
+   failure */
+void CAP_DbPool::connect(CAP_DbConn& c) {
+  c.discard();
+  c.broken=false;
+  try {
+    c.conn = driver->connect(strConnect.c_str(), strUser.c_str(),
+      strPasswd.c_str());
+  }
+  catch( SQLException& err ) {
+    errlog->writef("failed to connect to database: what: %s, code: %d, "
+      "state: %s", LOG_ERROR, err.what(), err.getErrorCode(),
+      err.getSQLState().c_str());
+    c.conn=NULL;
+  }
+  if( c.conn && !c.prepareAll() ) { c.discard(); }
+  c.lastUsed=time(NULL);
+}
+
+/* CAP_DbPool::open()
+   Opens *size* connections; throws -1 unless every one opens */
+void CAP_DbPool::open(int size) {
+  try {
+    driver = mysql::get_driver_instance();
+  }
+  catch( SQLException& err ) {
+    errlog->writef("failed to load database driver: what: %s", LOG_FATAL,
+      err.what());
+    throw -1;
+  }
+
+  for( int i=0; i<size; i++ ) {
+    CAP_DbConn* c = new CAP_DbConn(errlog);
+    conns.push_back(c);
+    connect(*c);
+    if( c->isBroken() ) {
+      errlog->writef("failed to open database connection %d of %d",
+        LOG_FATAL, i+1, size);
+      throw -1;
+    }
+    idle.push_back(c);
+  }
+  errlog->writef("opened %d connections to database", LOG_INFO, size);
+}
+
+/* CAP_DbPool::acquire()
+   Hands out a connection, waiting for one if all are in use. A connection
+   which is broken, or idle long enough to have been dropped by server and
+   no longer valid, is replaced first; if that fails it is handed out
+   disconnected and stmt() reports CAPEXC_DBGONE. */
+CAP_DbConn& CAP_DbPool::acquire() {
+  pthread_mutex_lock(&lock);
+  while( idle.empty() ) {
+    pthread_cond_wait(&freed, &lock);
+  }
+  CAP_DbConn* c = idle.back();
+  idle.pop_back();
+  pthread_mutex_unlock(&lock);
+
+  bool healthy = !c->isBroken();
+  if( healthy && time(NULL)-c->lastUsed > CAP_DB_PING_IDLE ) {
+    try { healthy = c->conn->isValid(); }
+    catch( SQLException& err ) { healthy = false; }
+  }
+  if( !healthy ) { reconnect(*c); }
+
+  c->lastUsed=time(NULL);
+  c->contended=false;
+  return *c;
+}
+
+/* CAP_DbPool::release()
+   Returns connection to pool */
+void CAP_DbPool::release(CAP_DbConn& c) {
+  pthread_mutex_lock(&lock);
+  idle.push_back(&c);
+  pthread_cond_signal(&freed);
+  pthread_mutex_unlock(&lock);
+}
+
+/* CAP_DbPool::reconnect()
+   Replaces a connection held by caller; its statements are prepared
+   again as soon as the new connection opens. Returns false if it could 
+   not connect. */
+bool CAP_DbPool::reconnect(CAP_DbConn& c) {
+  errlog->write("database connection lost; reconnecting", LOG_WARNING);
+  connect(c);
+  if( c.isBroken() ) { return false; }
+  errlog->write("reconnected to database", LOG_INFO);
+  return true;
+}
+
+/* CAP_DbPool::threadInit()
+   Must be called by any thread besides main one before it uses a
+   connection */
+void CAP_DbPool::threadInit() {
+  driver->threadInit();
+}
+
+/* CAP_DbPool::threadEnd()
+   Called by such a thread before it exits */
+void CAP_DbPool::threadEnd() {
+  driver->threadEnd();
+}
+
+/* CAP_DbPool::logStats()
+   Writes counters of every statement which has run, summed over 
+   connections, to log. Nothing may hold a connection. */
+void CAP_DbPool::logStats() const {
+  for( int i=0; i<STMT_MAX; i++ ) {
+    CAP_SqlStat total;
+    for( unsigned j=0; j<conns.size(); j++ ) {
+      total.add(conns[j]->stats[i]);
+    }
+    total.logStats(errlog, sql_defs[i].name);
+  }
+}
@@ -0,0 +1,152 @@
+/*******************************************************************************
+  File Name: dbpool.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Bounded pool of database connections, each with its own
+    prepared statements and statement counters
+*******************************************************************************/
+#ifndef _DBPOOL_H_
+#define _DBPOOL_H_
+
+#include "master.h"
+#include "log.h"
+#include "store.h"
+#include <mysql_driver.h>
+#include <mysql_connection.h>
+#include <cppconn/exception.h>
+#include <cppconn/prepared_statement.h>
+#include <pthread.h>
+#include <time.h>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace sql;
+
+/* every statement run against database; names and text are in 
+   sql_stmt.cpp */
+enum SqlStmt {
+  STMT_ARCHIVE_INSERT=0,
+  STMT_ARCHIVE_SELECT,
+  STMT_CONTENT_INSERT,
+  STMT_LAST_ID,
+  STMT_JOB_INSERT,
+  STMT_JOB_CLAIM,
+  STMT_JOB_RETIRE,
+  STMT_REQUEST_KEY,
+  STMT_KEY_PRUNE,
+  /* built per call; counted but not prepared */
+  STMT_ARCHIVE_ITEMS,
+  STMT_JOB_MARK,
+  STMT_STATUS_JOBS,
+  STMT_STATUS_ARCHIVES,
+  STMT_STATUS_DELETE,
+  STMT_STATUS_RENAME,
+  STMT_JOB_HISTORY,
+  STMT_JOB_PURGE,
+  STMT_JOB_RELEASE,
+  STMT_MAX
+};
+
+extern const CAP_SqlDef sql_defs[STMT_MAX];
+
+/* Owns a statement or result set and deletes it when it goes out of 
+   scope, whichever way that happens. Not copyable. */
+template <class T> class CAP_SqlPtr {
+ protected:
+  T* ptr;
+
+  CAP_SqlPtr(const CAP_SqlPtr&);
+  void operator=(const CAP_SqlPtr&);
+
+ public:
+  inline explicit CAP_SqlPtr(T* _ptr=NULL) : ptr(_ptr) {}
+  inline ~CAP_SqlPtr() { reset(); }
+
+  /* reset()
+     Deletes what is held and takes *_ptr* in its place */
+  inline void reset(T* _ptr=NULL) {
+    if( ptr == _ptr ) { return; }
+    try { delete ptr; }
+    catch( SQLException& err ) {}
+    ptr = _ptr;
+  }
+
+  inline T* operator->() const { return ptr; }
+  inline T* get() const { return ptr; }
+};
+
+typedef CAP_SqlPtr<ResultSet> CAP_Result;
+
+/* one pooled connection. Statements are prepared together as soon as 
+   it connects and belong to this connection alone; they are thrown away 
+   with it when it is replaced. Statements run through query() and 
+   update() are counted and timed; counters outlive reconnects. */
+class CAP_DbConn {
+ protected:
+  CAP_Log* errlog;                    /* log events are written to */
+  Connection* conn;                   /* NULL while disconnected */
+  PreparedStatement* stmts[STMT_MAX]; /* NULL until prepared */
+  Statement* plain;                   /* runs statements built per call */
+  CAP_SqlStat stats[STMT_MAX];        /* counters by statement */
+  bool broken;                        /* server went away during use */
+  bool contended;                     /* lost a lock to another transaction 
+                                         since handed out */
+  time_t lastUsed;                    /* when last handed out */
+  unsigned long maxPacket;            /* server's max_allowed_packet; zero 
+                                         until asked */
+
+  friend class CAP_DbPool;
+  void discard();
+  bool prepareAll();
+  void timed(SqlStmt id, unsigned long start, bool failed);
+
+ public:
+  CAP_DbConn(CAP_Log* _errlog);
+  ~CAP_DbConn();
+
+  PreparedStatement* stmt(SqlStmt id);
+  ResultSet* query(SqlStmt id);
+  int update(SqlStmt id);
+  int update(SqlStmt id, const string& sql);
+  int update(SqlStmt id, PreparedStatement* pstmt);
+  bool lost(const SQLException& err);
+  unsigned long packetMax();
+  inline Connection* get() { return conn; }
+  inline bool isBroken() const { return broken || !conn; }
+  inline bool isContended() const { return contended; }
+};
+
+/* Connections are opened by open() and handed to one caller at a time.
+   A connection idle longer than CAP_DB_PING_IDLE is checked before it is
+   handed out; one found dead, or marked broken by lost(), is replaced
+   and its statements prepared again. */
+class CAP_DbPool {
+ protected:
+  CAP_Log* errlog;               /* log events are written to */
+  mysql::MySQL_Driver* driver;   /* opens connections */
+  string strConnect;             /* connection string */
+  string strUser;                /* user name */
+  string strPasswd;              /* password */
+  vector<CAP_DbConn*> conns;     /* every connection */
+  vector<CAP_DbConn*> idle;      /* connections not handed out */
+  pthread_mutex_t lock;          /* guards idle */
+  pthread_cond_t freed;          /* signaled when a connection is released */
+
+  void connect(CAP_DbConn& c);
+
+ public:
+  CAP_DbPool(CAP_Log* _errlog, const string& _connect, const string& _user,
+    const string& _passwd);
+  ~CAP_DbPool();
+
+  void open(int size);
+  CAP_DbConn& acquire();
+  void release(CAP_DbConn& c);
+  bool reconnect(CAP_DbConn& c);
+  void threadInit();
+  void threadEnd();
+  void logStats() const;
+  inline int size() const { return conns.size(); }
+};
+
+#endif /* _DBPOOL_H_ */
@@ -0,0 +1,183 @@
+/*******************************************************************************
+  File Name: dispatch.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_Dispatcher and CAP_NameDispatcher
+    classes
+*******************************************************************************/
+#include "dispatch.h"
+#include <time.h>
+#include <stdint.h>
+using namespace std;
+
+#define DISPATCH_SLOTS 16 /* initial size of a name table */
+
+/* usec_now()
+   Returns monotonic time in microseconds */
+static unsigned long usec_now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000UL + ts.tv_nsec/1000;
+}
+
+/* name_hash()
+   FNV-1a hash of name */
+static uint32_t name_hash(const CAP_StrRef& name) {
+  uint32_t h = 2166136261U;
+  for( int i=0; i<name.len; i++ ) {
+    h = (h ^ (uint8_t)name.ptr[i]) * 16777619U;
+  }
+  return h;
+}
+
+/* CAP_Handler::call()
+   Runs handler and counts time spent in it, including runs which end by 
+   throwing */
+void CAP_Handler::call(CAP_PipeMessageRef& msg, void* ctx) {
+  unsigned long start = usec_now();
+  try {
+    (*proc)(msg, ctx);
+  }
+  catch( ... ) {
+    unsigned long spent = usec_now()-start;
+    calls++;
+    usecs += spent;
+    if( spent > maxUsecs ) { maxUsecs = spent; }
+    throw;
+  }
+
+  unsigned long spent = usec_now()-start;
+  calls++;
+  usecs += spent;
+  if( spent > maxUsecs ) { maxUsecs = spent; }
+}
+
+/* CAP_Handler::logStats()
+   Writes handler's counters to log */
+void CAP_Handler::logStats(CAP_Log* errlog) const {
+  if( !calls ) { return; }
+  errlog->writef("handler %s: %lu calls, %lu usec total, %lu usec average, "
+    "%lu usec longest", LOG_INFO, name.c_str(), calls, usecs, usecs/calls, 
+    maxUsecs);
+}
+
+/* CAP_Dispatcher::CAP_Dispatcher()
+   Class constructor */
+CAP_Dispatcher::CAP_Dispatcher(CAP_Log* _errlog) : errlog(_errlog) {
+  if( !errlog ) { throw CAP_Exception(CAPEXC_NOERRLOG); }
+
+  for( int type=MSGT_NAMED+1; type<MSGT_MAX; type++ ) {
+    table[type].name = cap_msgname(type);
+  }
+  fallback.name = "(unhandled)";
+}
+
+/* CAP_Dispatcher::add()
+   Registers handler for given message type */
+void CAP_Dispatcher::add(int type, PCAP_MsgProc proc) {
+  if( type <= MSGT_NAMED || type >= MSGT_MAX || !proc ) {
+    errlog->writef("invalid handler for message type %d", LOG_ERROR, type);
+    throw CAP_Exception(CAPEXC_INVALPARAM);
+  }
+  table[type].proc = proc;
+}
+
+/* CAP_Dispatcher::setDefault()
+   Registers handler for messages no other handler takes */
+void CAP_Dispatcher::setDefault(PCAP_MsgProc proc) {
+  fallback.proc = proc;
+}
+
+/* CAP_Dispatcher::dispatch()
+   Calls handler registered for message's type */
+void CAP_Dispatcher::dispatch(CAP_PipeMessageRef& msg, void* ctx) {
+  CAP_Handler* h = &fallback;
+  if( msg.type > MSGT_NAMED && msg.type < MSGT_MAX && 
+      table[msg.type].proc ) {
+    h = &table[msg.type];
+  }
+
+  if( !h->proc ) {
+    errlog->writef("no handler for message %.*s", LOG_WARNING, 
+      msg.command.len, msg.command.ptr);
+    return;
+  }
+  h->call(msg, ctx);
+}
+
+/* CAP_Dispatcher::logStats()
+   Writes every handler's counters to log */
+void CAP_Dispatcher::logStats() const {
+  for( int type=MSGT_NAMED+1; type<MSGT_MAX; type++ ) {
+    table[type].logStats(errlog);
+  }
+  fallback.logStats(errlog);
+}
+
+/* CAP_NameDispatcher::CAP_NameDispatcher()
+   Class constructor */
+CAP_NameDispatcher::CAP_NameDispatcher(CAP_Log* _errlog)
+  : slots(DISPATCH_SLOTS), used(0), errlog(_errlog)
+{
+  if( !errlog ) { throw CAP_Exception(CAPEXC_NOERRLOG); }
+}
+
+/* CAP_NameDispatcher::find()
+   Returns slot holding name, or the empty slot where it belongs */
+int CAP_NameDispatcher::find(const CAP_StrRef& name) const {
+  int mask = slots.size()-1;
+  int i = name_hash(name) & mask;
+  while( slots[i].proc && !name.equals(slots[i].name.c_str()) ) {
+    i = (i+1) & mask;
+  }
+  return i;
+}
+
+/* CAP_NameDispatcher::grow()
+   Doubles table and places every handler again */
+void CAP_NameDispatcher::grow() {
+  vector<CAP_Handler> old;
+  old.swap(slots);
+  slots.resize(old.size()*2);
+  for( unsigned i=0; i<old.size(); i++ ) {
+    if( old[i].proc ) {
+      slots[find(CAP_StrRef(old[i].name))] = old[i];
+    }
+  }
+}
+
+/* CAP_NameDispatcher::add()
+   Registers handler for given name */
+void CAP_NameDispatcher::add(const char* name, PCAP_MsgProc proc) {
+  if( !name || !proc ) {
+    errlog->write("invalid handler given to name dispatcher", LOG_ERROR);
+    throw CAP_Exception(CAPEXC_INVALPARAM);
+  }
+
+  /* keep table at most half full so probes stay short */
+  if( (used+1)*2 > (int)slots.size() ) { grow(); }
+
+  CAP_Handler& h = slots[find(CAP_StrRef(name))];
+  if( !h.proc ) { used++; }
+  h.name = name;
+  h.proc = proc;
+}
+
+/* CAP_NameDispatcher::dispatch()
+   Calls handler registered for name; returns false if there is none */
+bool CAP_NameDispatcher::dispatch(const CAP_StrRef& name, 
+  CAP_PipeMessageRef& msg, void* ctx)
+{
+  CAP_Handler& h = slots[find(name)];
+  if( !h.proc ) { return false; }
+  h.call(msg, ctx);
+  return true;
+}
+
+/* CAP_NameDispatcher::logStats()
+   Writes every handler's counters to log */
+void CAP_NameDispatcher::logStats() const {
+  for( unsigned i=0; i<slots.size(); i++ ) {
+    if( slots[i].proc ) { slots[i].logStats(errlog); }
+  }
+}
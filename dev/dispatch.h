@@ -0,0 +1,71 @@
+/*******************************************************************************
+  File Name: dispatch.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Tables which route messages to registered handlers and keep
+    counters for each of them
+*******************************************************************************/
+#ifndef _DISPATCH_H_
+#define _DISPATCH_H_
+
+#include "master.h"
+#include "log.h"
+#include "pipe.h"
+#include "strref.h"
+#include "frame.h"
+#include <vector>
+using namespace std;
+
+/* handler for one kind of message; *ctx* is passed through dispatch() */
+typedef void (*PCAP_MsgProc)(CAP_PipeMessageRef& msg, void* ctx);
+
+/* a registered handler and its counters */
+struct CAP_Handler {
+  string name;             /* what it handles; used when logging */
+  PCAP_MsgProc proc;       /* NULL if slot is unused */
+  unsigned long calls;     /* times handler has run */
+  unsigned long usecs;     /* total time spent in handler */
+  unsigned long maxUsecs;  /* longest single run */
+
+  inline CAP_Handler() : proc(NULL), calls(0), usecs(0), maxUsecs(0) {}
+  void call(CAP_PipeMessageRef& msg, void* ctx);
+  void logStats(CAP_Log* errlog) const;
+};
+
+/* routes by message type; text commands are typed by a perfect hash of 
+   their name when read, frames carry their type */
+class CAP_Dispatcher {
+ protected:
+  CAP_Handler table[MSGT_MAX]; /* indexed by CAP_MsgType */
+  CAP_Handler fallback;        /* messages with no handler */
+  CAP_Log* errlog;             /* log events are written to */
+
+ public:
+  CAP_Dispatcher(CAP_Log* _errlog);
+
+  void add(int type, PCAP_MsgProc proc);
+  void setDefault(PCAP_MsgProc proc);
+  void dispatch(CAP_PipeMessageRef& msg, void* ctx);
+  void logStats() const;
+};
+
+/* routes by a name chosen by caller (e.g. first line of a body); names are
+   kept in an open-addressed hash table */
+class CAP_NameDispatcher {
+ protected:
+  vector<CAP_Handler> slots; /* size is a power of two */
+  int used;                  /* slots holding a handler */
+  CAP_Log* errlog;           /* log events are written to */
+
+  int find(const CAP_StrRef& name) const;
+  void grow();
+
+ public:
+  CAP_NameDispatcher(CAP_Log* _errlog);
+
+  void add(const char* name, PCAP_MsgProc proc);
+  bool dispatch(const CAP_StrRef& name, CAP_PipeMessageRef& msg, void* ctx);
+  void logStats() const;
+};
+
+#endif /* _DISPATCH_H_ */
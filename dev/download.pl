@@ -10,6 +10,8 @@ use warnings;
 use XML::Simple;
 use Switch;
 use Fcntl;
+use FindBin;
+require "$FindBin::Bin/cappipe.pl"; # cap_pipe_send()
 
 # global variables
 my $xmlref;
@@ -214,17 +216,16 @@ while( $errcount_rd < $readerr_max ) {
 	    my $send_body;
 			if( !$wgetFAIL ) {
 				$send_command = "MSG_DOWNLOADED";
-				$send_body = "$html\n$title\n";
+				$send_body = "$html\n$title";
 			}
 			else { 
 				$send_command = "MSG_DOWNLOADFAIL";
 				$send_body = "";
 			}
-	    my $send_length = length($send_body);
-
-	    # send confirmation back to Master Program
+	    # send confirmation back to Master Program; frames keep it whole
+	    # however long title is, though others write the same pipe
 	    pipe_out_open();
-	    print $p_out "$send_command\n$send_length\n$send_body" or
+	    cap_pipe_send($p_out, $send_command, $send_body) or
 				err("failed to send message to Master Program: $!",'E');
 	    err("sent $send_command to master",'I');
 	    pipe_out_close();
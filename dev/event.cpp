@@ -0,0 +1,239 @@
+/*******************************************************************************
+  File Name: event.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_EventLoop class
+*******************************************************************************/
+#include "event.h"
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+using namespace std;
+
+#define EVENT_BATCH 16 /* max. number of events handled per epoll_wait() */
+
+/* CAP_EventLoop::CAP_EventLoop()
+   Class constructor */
+CAP_EventLoop::CAP_EventLoop(CAP_Log* _errlog)
+  : epollD(-1), errlog(_errlog), running(false)
+{
+  if( !errlog ) { throw CAP_EventException(EXCEVT_NOERRLOG); }
+
+  if( (epollD=epoll_create1(EPOLL_CLOEXEC)) == -1 ) {
+    errlog->writef("failed to create epoll descriptor: %d", LOG_ERROR, errno);
+    throw CAP_EventException(EXCEVT_CREATEFAIL);
+  }
+}
+
+/* CAP_EventLoop::~CAP_EventLoop()
+   Class destructor; closes every descriptor created by loop */
+CAP_EventLoop::~CAP_EventLoop() {
+  for( map<int, Watch>::iterator it=watches.begin(); it!=watches.end(); it++ ) {
+    if( it->second.kind != EVENT_FD ) { ::close(it->first); }
+  }
+  if( epollD != -1 ) { ::close(epollD); }
+}
+
+/* CAP_EventLoop::add()
+   Registers descriptor with epoll and records its handler */
+void CAP_EventLoop::add(int fd, EventKind kind, PCAP_EventProc proc,
+  void* ctx, unsigned events)
+{
+  if( fd < 0 || !proc ) {
+    errlog->writef("invalid descriptor %d or handler given to event loop",
+      LOG_ERROR, fd);
+    throw CAP_EventException(EXCEVT_ADDFAIL);
+  }
+
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  if( epoll_ctl(epollD, EPOLL_CTL_ADD, fd, &ev) == -1 ) {
+    errlog->writef("failed to add descriptor %d to event loop: %d",
+      LOG_ERROR, fd, errno);
+    throw CAP_EventException(EXCEVT_ADDFAIL);
+  }
+
+  Watch w;
+  w.fd = fd;
+  w.kind = kind;
+  w.proc = proc;
+  w.ctx = ctx;
+  watches[fd] = w;
+}
+
+/* CAP_EventLoop::addFd()
+   Watches caller's descriptor; caller remains owner of it */
+void CAP_EventLoop::addFd(int fd, PCAP_EventProc proc, void* ctx,
+  unsigned events)
+{
+  add(fd, EVENT_FD, proc, ctx, events);
+}
+
+/* CAP_EventLoop::addTimer()
+   Creates a timer firing every *msec* milliseconds; returns its descriptor.
+   With *msec* zero it is created disarmed, for use with armTimer(). */
+int CAP_EventLoop::addTimer(unsigned msec, PCAP_EventProc proc, void* ctx) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+  if( fd == -1 ) {
+    errlog->writef("failed to create timer: %d", LOG_ERROR, errno);
+    throw CAP_EventException(EXCEVT_ADDFAIL);
+  }
+
+  itimerspec spec;
+  spec.it_interval.tv_sec = msec / 1000;
+  spec.it_interval.tv_nsec = (msec % 1000) * 1000000L;
+  spec.it_value = spec.it_interval;
+  if( timerfd_settime(fd, 0, &spec, NULL) == -1 ) {
+    errlog->writef("failed to arm timer: %d", LOG_ERROR, errno);
+    ::close(fd);
+    throw CAP_EventException(EXCEVT_ADDFAIL);
+  }
+
+  try { add(fd, EVENT_TIMER, proc, ctx, EPOLLIN); }
+  catch( CAP_EventException& err ) { ::close(fd); throw; }
+  return fd;
+}
+
+/* CAP_EventLoop::armTimer()
+   Makes timer fire once, *msec* milliseconds from now, instead of 
+   repeating; zero disarms it */
+void CAP_EventLoop::armTimer(int fd, unsigned msec) {
+  itimerspec spec;
+  spec.it_interval.tv_sec = 0;
+  spec.it_interval.tv_nsec = 0;
+  spec.it_value.tv_sec = msec / 1000;
+  spec.it_value.tv_nsec = (msec % 1000) * 1000000L;
+  if( timerfd_settime(fd, 0, &spec, NULL) == -1 ) {
+    errlog->writef("failed to arm timer: %d", LOG_ERROR, errno);
+  }
+}
+
+/* CAP_EventLoop::addSignal()
+   Blocks given signal and delivers it through loop instead; returns
+   descriptor which was created for it */
+int CAP_EventLoop::addSignal(int signo, PCAP_EventProc proc, void* ctx) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, signo);
+
+  /* signal must be blocked or it will still be delivered normally */
+  if( sigprocmask(SIG_BLOCK, &mask, NULL) == -1 ) {
+    errlog->writef("failed to block signal %d: %d", LOG_ERROR, signo, errno);
+    throw CAP_EventException(EXCEVT_ADDFAIL);
+  }
+
+  int fd = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+  if( fd == -1 ) {
+    errlog->writef("failed to create descriptor for signal %d: %d",
+      LOG_ERROR, signo, errno);
+    throw CAP_EventException(EXCEVT_ADDFAIL);
+  }
+
+  try { add(fd, EVENT_SIGNAL, proc, ctx, EPOLLIN); }
+  catch( CAP_EventException& err ) { ::close(fd); throw; }
+  return fd;
+}
+
+/* CAP_EventLoop::addWakeup()
+   Creates a descriptor which anything may raise with wake(); handler runs 
+   once however many times it was raised since last run. Returns 
+   descriptor. */
+int CAP_EventLoop::addWakeup(PCAP_EventProc proc, void* ctx) {
+  int fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+  if( fd == -1 ) {
+    errlog->writef("failed to create wakeup: %d", LOG_ERROR, errno);
+    throw CAP_EventException(EXCEVT_ADDFAIL);
+  }
+
+  try { add(fd, EVENT_WAKEUP, proc, ctx, EPOLLIN); }
+  catch( CAP_EventException& err ) { ::close(fd); throw; }
+  return fd;
+}
+
+/* CAP_EventLoop::wake()
+   Raises wakeup created by addWakeup() */
+void CAP_EventLoop::wake(int fd) {
+  uint64_t one=1;
+  if( ::write(fd, &one, sizeof(one)) == -1 ) {
+    /* counter is full; handler is due to run anyway */
+  }
+}
+
+/* CAP_EventLoop::remove()
+   Stops watching descriptor; descriptors created by loop are closed */
+void CAP_EventLoop::remove(int fd) {
+  map<int, Watch>::iterator it = watches.find(fd);
+  if( it == watches.end() ) { return; }
+
+  if( epoll_ctl(epollD, EPOLL_CTL_DEL, fd, NULL) == -1 ) {
+    errlog->writef("failed to remove descriptor %d from event loop: %d",
+      LOG_WARNING, fd, errno);
+  }
+  if( it->second.kind != EVENT_FD ) { ::close(fd); }
+  watches.erase(it);
+}
+
+/* CAP_EventLoop::dispatch()
+   Drains loop-owned descriptors and calls handler */
+void CAP_EventLoop::dispatch(Watch& w, unsigned events) {
+  switch( w.kind ) {
+  case EVENT_WAKEUP:
+  case EVENT_TIMER: {
+    uint64_t expired=0;
+    if( ::read(w.fd, &expired, sizeof(expired)) != sizeof(expired) ) {
+      return; /* spurious wakeup */
+    }
+    break;
+  }
+  case EVENT_SIGNAL: {
+    signalfd_siginfo info;
+    if( ::read(w.fd, &info, sizeof(info)) != sizeof(info) ) {
+      return;
+    }
+    events = info.ssi_signo;
+    break;
+  }
+  default:
+    break;
+  }
+
+  (*w.proc)(w.fd, events, w.ctx);
+}
+
+/* CAP_EventLoop::runOnce()
+   Waits up to *timeout* milliseconds (-1 is forever) and handles every
+   descriptor which became ready */
+void CAP_EventLoop::runOnce(int timeout) {
+  epoll_event events[EVENT_BATCH];
+  int n = epoll_wait(epollD, events, EVENT_BATCH, timeout);
+  if( n == -1 ) {
+    if( errno == EINTR ) { return; }
+    errlog->writef("failed waiting on event loop: %d", LOG_ERROR, errno);
+    throw CAP_EventException(EXCEVT_WAITFAIL);
+  }
+
+  for( int i=0; i<n; i++ ) {
+    /* a handler may have removed this descriptor already */
+    map<int, Watch>::iterator it = watches.find(events[i].data.fd);
+    if( it == watches.end() ) { continue; }
+
+    Watch w = it->second; /* copy; handler may modify map */
+    dispatch(w, events[i].events);
+  }
+}
+
+/* CAP_EventLoop::run()
+   Handles events until stop() is called */
+void CAP_EventLoop::run() {
+  running = true;
+  while( running ) {
+    runOnce();
+  }
+}
@@ -0,0 +1,77 @@
+/*******************************************************************************
+  File Name: event.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: epoll-based event loop which watches the Master Program's pipe
+    descriptors, timers, signals and wakeups and calls registered handlers
+*******************************************************************************/
+#ifndef _EVENT_H_
+#define _EVENT_H_
+
+#include "master.h"
+#include "log.h"
+#include <sys/epoll.h>
+#include <map>
+using namespace std;
+
+/* CAP_EventLoop exception constants and exception class */
+#define EXCEVT_NOERRLOG       1
+#define EXCEVT_CREATEFAIL     2
+#define EXCEVT_ADDFAIL        3
+#define EXCEVT_WAITFAIL       4
+
+class CAP_EventException {
+ public:
+  inline CAP_EventException(const int nmsg) : msg(nmsg) {}
+  const int msg;
+};
+
+/* handler called when a watched descriptor is ready; *events* holds the
+   epoll events which occurred (for signals it is the signal number) */
+typedef void (*PCAP_EventProc)(int fd, unsigned events, void* ctx);
+
+/* kinds of descriptors owned by event loop */
+enum EventKind {
+  EVENT_FD=0,     // caller's descriptor (pipes)
+  EVENT_TIMER=1,  // timerfd created by loop
+  EVENT_SIGNAL=2, // signalfd created by loop
+  EVENT_WAKEUP=3  // eventfd created by loop
+};
+
+class CAP_EventLoop {
+ protected:
+  struct Watch {
+    int fd;              /* descriptor being watched */
+    EventKind kind;      /* what fd is */
+    PCAP_EventProc proc; /* handler */
+    void* ctx;           /* passed to handler */
+  };
+
+  int epollD;              /* epoll descriptor */
+  CAP_Log* errlog;         /* log events are written to */
+  bool running;            /* cleared by stop() */
+  map<int, Watch> watches; /* registered descriptors */
+
+  void add(int fd, EventKind kind, PCAP_EventProc proc, void* ctx,
+    unsigned events);
+  void dispatch(Watch& w, unsigned events);
+
+ public:
+  CAP_EventLoop(CAP_Log* _errlog);
+  ~CAP_EventLoop();
+
+  void addFd(int fd, PCAP_EventProc proc, void* ctx,
+    unsigned events=EPOLLIN);
+  int addTimer(unsigned msec, PCAP_EventProc proc, void* ctx);
+  void armTimer(int fd, unsigned msec);
+  int addSignal(int signo, PCAP_EventProc proc, void* ctx);
+  int addWakeup(PCAP_EventProc proc, void* ctx);
+  static void wake(int fd);
+  void remove(int fd);
+  void runOnce(int timeout=-1);
+  void run();
+  inline void stop() { running=false; }
+  inline bool isRunning() const { return running; }
+};
+
+#endif /* _EVENT_H_ */
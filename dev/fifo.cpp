@@ -0,0 +1,150 @@
+/*******************************************************************************
+  File Name: fifo.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_FifoTransport class
+*******************************************************************************/
+#include "pipe.h"
+#include "transport.h"
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+/* CAP_FifoTransport::CAP_FifoTransport()
+   Class constructor */
+CAP_FifoTransport::CAP_FifoTransport(const string& _name, CAP_Log* _errlog)
+  : CAP_Transport(_name, _errlog), fileD(0), holdD(0)
+{
+}
+
+/* CAP_FifoTransport::~CAP_FifoTransport()
+   Class destructor */
+CAP_FifoTransport::~CAP_FifoTransport() {
+  close();
+}
+
+/* CAP_FifoTransport::create()
+   Creates FIFO at given pathname--unless it already exists */
+void CAP_FifoTransport::create(const string& pathname, PipeMode _mode) {
+  CAP_Transport::create(pathname, _mode);
+
+  if( mkfifo(pathname.c_str(), CAP_FILE_MASK) == -1 && errno != EEXIST ) {
+    errlog->writef("%s pipe could not be created. errno: %d", 
+		   LOG_ERROR, strName.c_str(), errno);
+    throw CAP_PipeException(EXCPIPE_CREATEFAIL);
+  }
+}
+
+/* CAP_FifoTransport::open()
+   Opens FIFO; returns false if it is being written and nobody is reading */
+bool CAP_FifoTransport::open() {
+  if( fileD ) { 
+    /* already open */
+    throw CAP_PipeException(EXCPIPE_ISOPEN);
+  }
+
+  // open pipe for use; do not block when opening because 
+  // fifos will block by default until something is written
+  fileD = ::open(strPathname.c_str(), 
+		 mode==PIPE_RDONLY ? O_RDONLY : O_WRONLY|O_NONBLOCK);
+  if( fileD==-1 && errno==ENXIO ) {
+    errlog->writef("%s pipe cannot be written to because it is closed", 
+      LOG_WARNING, strName.c_str());
+    fileD=0;
+    return false;
+  }
+  else if( fileD==-1 ) {
+    errlog->writef("%s pipe could not be opened. errno: %d", 
+		   LOG_ERROR, strName.c_str(), errno);
+    fileD=0;
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+
+  errlog->writef("%s pipe opened", LOG_INFO, strName.c_str());
+  return true;
+}
+
+/* CAP_FifoTransport::close()
+   Closes FIFO's descriptors */
+void CAP_FifoTransport::close() {
+  /* release write end held by listen() */
+  if( holdD ) {
+    ::close(holdD);
+    holdD=0;
+  }
+
+  if( !fileD ) { return; } // already closed
+
+  // close file descriptor
+  if( ::close(fileD) == -1 ) {
+    errlog->writef("Pipe %s could not be closed errno: %d", LOG_ERROR, 
+		   strName.c_str(), errno);
+  }
+  else {
+    errlog->writef("pipe %s closed", LOG_INFO, strName.c_str());
+    fileD=0;
+  }
+}
+
+/* CAP_FifoTransport::listen()
+   Opens read end of FIFO and keeps it open so it may be watched by an 
+   event loop. A write end is held as well so FIFO never reports 
+   end-of-file between writers. */
+void CAP_FifoTransport::listen() {
+  if( fileD ) {
+    throw CAP_PipeException(EXCPIPE_ISOPEN);
+  }
+
+  /* open without blocking for a writer, then become our own writer */
+  if( (fileD=::open(strPathname.c_str(), O_RDONLY|O_NONBLOCK)) == -1 ) {
+    errlog->writef("%s pipe could not be opened. errno: %d", 
+		   LOG_ERROR, strName.c_str(), errno);
+    fileD=0;
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+  if( (holdD=::open(strPathname.c_str(), O_WRONLY)) == -1 ) {
+    errlog->writef("%s pipe could not be held open. errno: %d", 
+		   LOG_ERROR, strName.c_str(), errno);
+    holdD=0;
+    close();
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+
+  /* descriptor stays nonblocking; only what has arrived is read and a 
+     partial message waits in pipe's buffer for the rest */
+  errlog->writef("%s pipe listening", LOG_INFO, strName.c_str());
+}
+
+/* CAP_FifoTransport::available()
+   Returns number of characters waiting in FIFO */
+int CAP_FifoTransport::available() {
+  int avail=0;
+  if( ioctl(fileD, FIONREAD, &avail) == -1 ) {
+    return 0;
+  }
+  return avail;
+}
+
+/* CAP_FifoTransport::read()
+   Reads up to *len* characters from FIFO */
+int CAP_FifoTransport::read(char* buf, int len) {
+  int n = ::read(fileD, buf, len);
+  if( n == 0 && mode==PIPE_RDONLY && !holdD ) {
+    /* end-of-file means write end is no longer held; take it back 
+       so descriptor watched by event loop remains valid */
+    if( (holdD=::open(strPathname.c_str(), O_WRONLY|O_NONBLOCK)) == -1 ) {
+      holdD=0;
+    }
+  }
+  return n;
+}
+
+/* CAP_FifoTransport::write()
+   Writes up to *len* characters into FIFO */
+int CAP_FifoTransport::write(const char* buf, int len) {
+  return ::write(fileD, buf, len);
+}
@@ -0,0 +1,65 @@
+/*******************************************************************************
+  File Name: frame.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Message type names used by both protocol versions
+*******************************************************************************/
+#include "frame.h"
+
+/* command name of every message type; indexed by CAP_MsgType */
+static const char* msgnames[MSGT_MAX] = {
+  "",
+  "MSG_NULL",
+  "MSG_QUIT",
+  "MSG_HELLO",
+  "MSG_ARCHIVEREQ",
+  "MSG_ARCHIVED",
+  "MSG_ARCHIVE",
+  "MSG_CLIENTREQ",
+  "MSG_DOWNLOADED",
+  "MSG_DOWNLOADFAIL"
+};
+
+/* perfect hash of every command name above; slot holds its type, or
+   MSGT_NAMED if no name hashes there. Regenerate multipliers and table 
+   whenever a message type is added. */
+#define MSGHASH_SIZE 16
+#define MSGHASH(p, len) \
+  (((len)*2 + (uint8_t)(p)[4]*3 + (uint8_t)(p)[(len)-1]) & (MSGHASH_SIZE-1))
+
+static const uint8_t msghash[MSGHASH_SIZE] = {
+  MSGT_ARCHIVEREQ,   /*  0 */
+  MSGT_NAMED,        /*  1 */
+  MSGT_NAMED,        /*  2 */
+  MSGT_NAMED,        /*  3 */
+  MSGT_CLIENTREQ,    /*  4 */
+  MSGT_NAMED,        /*  5 */
+  MSGT_NULL,         /*  6 */
+  MSGT_QUIT,         /*  7 */
+  MSGT_DOWNLOADFAIL, /*  8 */
+  MSGT_HELLO,        /*  9 */
+  MSGT_NAMED,        /* 10 */
+  MSGT_NAMED,        /* 11 */
+  MSGT_DOWNLOADED,   /* 12 */
+  MSGT_NAMED,        /* 13 */
+  MSGT_ARCHIVE,      /* 14 */
+  MSGT_ARCHIVED      /* 15 */
+};
+
+/* cap_msgname()
+   Returns command name of given message type */
+const char* cap_msgname(int type) {
+  if( type <= MSGT_NAMED || type >= MSGT_MAX ) { return ""; }
+  return msgnames[type];
+}
+
+/* cap_msgtype()
+   Returns message type of given command name, or MSGT_NAMED if it has
+   none; one hash and one comparison */
+int cap_msgtype(const CAP_StrRef& name) {
+  if( name.len < 5 ) { return MSGT_NAMED; }
+
+  int type = msghash[MSGHASH(name.ptr, name.len)];
+  if( type != MSGT_NAMED && name.equals(msgnames[type]) ) { return type; }
+  return MSGT_NAMED;
+}
@@ -0,0 +1,105 @@
+/*******************************************************************************
+  File Name: frame.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Binary message framing (protocol version 2) and message type
+    identifiers shared by both protocol versions
+*******************************************************************************/
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+#include "strref.h"
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+/* protocol versions a pipe may speak */
+#define PIPE_PROTO_TEXT   1 /* command line, length line, body */
+#define PIPE_PROTO_FRAME  2 /* fixed binary header, body */
+
+/* frame header layout; every field is little-endian at a fixed offset.
+   First byte can never begin a text command, so both versions may share
+   a pipe. */
+#define FRAME_MAGIC0        0xCA
+#define FRAME_MAGIC1        0x50
+#define FRAME_HEADER_SIZE   20
+#define FRAME_OFF_MAGIC      0 /* 2 bytes */
+#define FRAME_OFF_VERSION    2 /* 1 byte  */
+#define FRAME_OFF_TYPE       3 /* 1 byte; CAP_MsgType */
+#define FRAME_OFF_FLAGS      4 /* 2 bytes */
+#define FRAME_OFF_NAMELEN    6 /* 2 bytes; command name for MSGT_NAMED */
+#define FRAME_OFF_LENGTH     8 /* 4 bytes; body length */
+#define FRAME_OFF_SEQ       12 /* 4 bytes; sender's sequence number */
+#define FRAME_OFF_SOURCE    16 /* 4 bytes; sender's process ID */
+
+/* frame flags */
+#define FRAME_FLAG_MORE     0x0001 /* body continues in sender's next frame */
+#define FRAME_FLAG_CONT     0x0002 /* body continues sender's last frame */
+
+/* message types; MSGT_NAMED carries its command name after the header */
+enum CAP_MsgType {
+  MSGT_NAMED=0,
+  MSGT_NULL,
+  MSGT_QUIT,
+  MSGT_HELLO,
+  MSGT_ARCHIVEREQ,
+  MSGT_ARCHIVED,
+  MSGT_ARCHIVE,
+  MSGT_CLIENTREQ,
+  MSGT_DOWNLOADED,
+  MSGT_DOWNLOADFAIL,
+  MSGT_MAX
+};
+
+struct CAP_FrameHeader {
+  uint8_t version;  /* PIPE_PROTO_FRAME */
+  uint8_t type;     /* CAP_MsgType */
+  uint16_t flags;   /* FRAME_FLAG_* */
+  uint16_t namelen; /* length of command name following header */
+  uint32_t length;  /* length of body following name */
+  uint32_t seq;     /* incremented by sender for every frame */
+  uint32_t source;  /* sender's process ID */
+};
+
+const char* cap_msgname(int type);
+int cap_msgtype(const CAP_StrRef& name);
+
+/* frame_encode()
+   Writes header into first FRAME_HEADER_SIZE bytes of *p* */
+inline void frame_encode(char* p, const CAP_FrameHeader& h) {
+  uint16_t u16;
+  uint32_t u32;
+
+  p[FRAME_OFF_MAGIC] = (char)FRAME_MAGIC0;
+  p[FRAME_OFF_MAGIC+1] = (char)FRAME_MAGIC1;
+  p[FRAME_OFF_VERSION] = h.version;
+  p[FRAME_OFF_TYPE] = h.type;
+  u16 = htole16(h.flags);   memcpy(p+FRAME_OFF_FLAGS, &u16, 2);
+  u16 = htole16(h.namelen); memcpy(p+FRAME_OFF_NAMELEN, &u16, 2);
+  u32 = htole32(h.length);  memcpy(p+FRAME_OFF_LENGTH, &u32, 4);
+  u32 = htole32(h.seq);     memcpy(p+FRAME_OFF_SEQ, &u32, 4);
+  u32 = htole32(h.source);  memcpy(p+FRAME_OFF_SOURCE, &u32, 4);
+}
+
+/* frame_decode()
+   Reads header from first FRAME_HEADER_SIZE bytes of *p*; returns false if
+   they do not hold a frame header */
+inline bool frame_decode(const char* p, CAP_FrameHeader& h) {
+  uint16_t u16;
+  uint32_t u32;
+
+  if( (uint8_t)p[FRAME_OFF_MAGIC] != FRAME_MAGIC0 ||
+      (uint8_t)p[FRAME_OFF_MAGIC+1] != FRAME_MAGIC1 ) {
+    return false;
+  }
+  h.version = p[FRAME_OFF_VERSION];
+  h.type = p[FRAME_OFF_TYPE];
+  memcpy(&u16, p+FRAME_OFF_FLAGS, 2);   h.flags = le16toh(u16);
+  memcpy(&u16, p+FRAME_OFF_NAMELEN, 2); h.namelen = le16toh(u16);
+  memcpy(&u32, p+FRAME_OFF_LENGTH, 4);  h.length = le32toh(u32);
+  memcpy(&u32, p+FRAME_OFF_SEQ, 4);     h.seq = le32toh(u32);
+  memcpy(&u32, p+FRAME_OFF_SOURCE, 4);  h.source = le32toh(u32);
+  return h.version == PIPE_PROTO_FRAME && h.type < MSGT_MAX;
+}
+
+#endif /* _FRAME_H_ */
@@ -0,0 +1,51 @@
+/*******************************************************************************
+  File Name: jobqueue.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Jobs the Master Program has claimed from the job table and
+    not yet handed to the downloader
+*******************************************************************************/
+#ifndef _JOBQUEUE_H_
+#define _JOBQUEUE_H_
+
+#include "store.h"
+#include <deque>
+using namespace std;
+
+/* Jobs in the order they were inserted. Filled a batch at a time by
+   DBOP_JOB_CLAIM, so picking the next job only goes to the database
+   once per batch; completions are still written through. */
+class CAP_JobQueue {
+ protected:
+  deque<JobRec> jobs; /* waiting; oldest first */
+
+ public:
+  /* push()
+     Queues job; its strings are taken, not copied */
+  inline void push(JobRec& job) {
+    jobs.push_back(JobRec());
+    JobRec& back = jobs.back();
+    back.id = job.id;
+    back.user_id = job.user_id;
+    back.type.swap(job.type);
+    back.url.swap(job.url);
+  }
+
+  /* pop()
+     Takes oldest job; false if there is none */
+  inline bool pop(JobRec& job) {
+    if( jobs.empty() ) { return false; }
+    JobRec& front = jobs.front();
+    job.id = front.id;
+    job.user_id = front.user_id;
+    job.type.swap(front.type);
+    job.url.swap(front.url);
+    jobs.pop_front();
+    return true;
+  }
+
+  inline bool empty() const { return jobs.empty(); }
+  inline unsigned size() const { return jobs.size(); }
+};
+
+#endif /* _JOBQUEUE_H_ */
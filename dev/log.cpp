@@ -1,7 +1,7 @@
 //-----------------------------------------------------------------------------
 // File: log.cpp
 // Author: Grant Gipson
-// Date Last Edited: April 13, 2011
+// Date Last Edited: October 16, 2026
 // Description: Log file object used for activity logging
 //-----------------------------------------------------------------------------
 #include "log.h"
@@ -12,6 +12,8 @@
 #include <errno.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
 
 // CAP_Log::open()
 // Opens the specified file for logging
@@ -64,13 +66,13 @@ void CAP_Log::write(const char* pszMsg, LogPriority lvl) {
   // format timestamp for log entry
   char timestamp[32];
   time_t rawTime;
-  tm* fTime = 0;
+  tm fTime; // own copy; database thread writes to log too
 
   if( (rawTime=time(NULL)) == -1 ) { // what just happened???
     errorHandle("unable retrieve time for log entry");
   }
-  fTime = localtime(&rawTime);
-  if( !strftime(timestamp, 32, "[%m/%d/%Y %H:%M:%S]", fTime) ) {
+  localtime_r(&rawTime, &fTime);
+  if( !strftime(timestamp, 32, "[%m/%d/%Y %H:%M:%S]", &fTime) ) {
     errorHandle("unable to format time for log entry");
   }
 
@@ -100,6 +102,7 @@ void CAP_Log::write(const char* pszMsg, LogPriority lvl) {
     sprintf(sz, "unable to write log entry, errno: %d", errno);
     errorHandle(sz);
   }
+  delete [] entry;
 }
 
 // CAP_Log::writef()
@@ -111,7 +114,7 @@ void CAP_Log::writef(const char* pszMsg, LogPriority lvl, ...) {
 
   // format log message and pass to write()
   char sz[256];
-  vsprintf(sz, pszMsg, args);
+  vsnprintf(sz, sizeof(sz), pszMsg, args);
   write(sz, lvl);
 
   // free list
@@ -1,7 +1,7 @@
 //-----------------------------------------------------------------------------
 // File Name: master.cpp
 // Author: Grant Gipson
-// Date Last Edited: May 14, 2011
+// Date Last Edited: October 16, 2026
 // Description: Entry point for Senior CAP Project Master Program
 //-----------------------------------------------------------------------------
 #include "master.h"
@@ -19,14 +19,25 @@
 #include "pipe.h"
 #include <time.h>
 #include <list>
-#include "sql.h"
+#include "store.h"
+#include "mysqlstore.h"
+#include "sqlitestore.h"
+#include "memstore.h"
+#include "event.h"
+#include "dispatch.h"
+#include "tokens.h"
+#include "dbexec.h"
+#include "jobqueue.h"
+#include "statusbatch.h"
+#include "spool.h"
+#include "stage.h"
 #include <signal.h>
+#include <string.h>
 using namespace std;
 
 // Global Variables
 CAP_Log* errlog = 0;       // global error log
 CAP_XML* xmlconfig = 0;    // global XML configuration file
-Connection* sqlconn=NULL;  /* connection to database */
 
 // logErrHandler()
 // Handles errors from log files
@@ -34,31 +45,651 @@ void logErrHandler(const char* pszmsg) {
   cerr << "log write failed: " << pszmsg << endl;
 }
 
-/* parseBody()
-   Parses message body into separate lines */
-void parseBody(string& str, list<string>& body) {
-  int start=0;
-  int end=0;
+/* CAP_Master
+   State shared by the event handlers of the message loop */
+struct CAP_Master {
+  CAP_EventLoop* events;     /* owns pipe, timer and signal descriptors */
+  CAP_Pipe* pipe_master;     /* receives messages */
+  CAP_Pipe* pipe_downloader; /* commands to downloader */
+  CAP_Pipe* pipe_archiver;   /* commands to archiver */
+  string download_dir;       /* location of downloads */
+  string content_dir;        /* location of content */
+  string archive_dir;        /* location archives are built */
+  int errCount_Rd;           /* number of errors which have occurred trying 
+                                to read from pipe */
+  unsigned download_job_id;  /* job ID being handled by downloader */
+  int download_user_id;      /* user ID of above job */
+  unsigned archive_job_id;   /* ID of archive being created */
+  int archive_user_id;       /* user ID of above archive */
+  int wakeD;                 /* raised when work may be waiting */
+  CAP_DbExecutor* db;        /* runs database operations */
+  CAP_StatusBatch* status;   /* status changes waiting to be written */
+  CAP_Spool* spool;          /* requests kept until database has them; NULL 
+                                if none configured */
+  CAP_Stager* stager;        /* copies content of archive being selected */
+  CAP_JobQueue jobs;         /* claimed jobs waiting for downloader */
+  bool jobs_claiming;        /* job claim submitted; not yet completed */
+  bool jobs_waiting;         /* database may hold unclaimed jobs */
+  bool archive_selecting;    /* archive select submitted; not yet completed */
+  int retireD;               /* timer moving finished jobs to history */
+  unsigned retire_msec;      /* interval of above; zero if never */
+  unsigned long jobs_retired;/* moved by current pass */
+  CAP_Dispatcher* dispatcher;     /* handlers by message type */
+  CAP_NameDispatcher* clientreq;  /* handlers by MSG_CLIENTREQ type */
+};
 
-  /* search for newlines */
-  while( (end=str.find('\n',start)) != string::npos ) {
-    body.push_back(str.substr(start,end-start));
-    start=end+1;
+/* wantWork()
+   Notes that a job or archive may be waiting or a component may have 
+   become free; dispatchWork() runs once the current batch of messages 
+   has been handled, however many times this was called */
+void wantWork(CAP_Master* m) {
+  CAP_EventLoop::wake(m->wakeD);
+}
+
+/* onJobsClaimed()
+   Completion of job claim; queues jobs claimed */
+void onJobsClaimed(CAP_DbOp& op, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  m->jobs_claiming=false;
+  if( !op.ok ) { return; }
+
+  /* a short batch means nothing else was waiting */
+  if( op.jobs.size() < CAP_JOB_CLAIM_MAX ) { m->jobs_waiting=false; }
+  for( list<JobRec>::iterator it=op.jobs.begin(); it!=op.jobs.end(); it++ ) {
+    m->jobs.push(*it);
   }
-  body.push_back(str.substr(start)); /* last string */
+  if( !op.jobs.empty() ) { wantWork(m); }
 }
 
-/* sig_pipe()
-   Handles SIGPIPE signals which indicate a broken pipe */
-void sig_pipe(int sig) {
-  /* make sure this is the expected signal */
-  if( sig==SIGPIPE ) {
-    errlog->write("received SIGPIPE signal", LOG_ERROR);
+/* claimJobs()
+   Claims next batch of jobs once the last has been handed out, if any 
+   may be waiting */
+void claimJobs(CAP_Master* m) {
+  if( m->jobs_claiming || !m->jobs_waiting || !m->jobs.empty() ) { return; }
+  m->jobs_claiming=true;
+  CAP_DbOp* op = new CAP_DbOp(DBOP_JOB_CLAIM, onJobsClaimed, m);
+  op->id = CAP_JOB_CLAIM_MAX;
+  m->db->submit(op);
+}
+
+/* jobsAdded()
+   Notes that jobs may have been added to database */
+void jobsAdded(CAP_Master* m) {
+  m->jobs_waiting=true;
+  wantWork(m);
+}
+
+/* onJobsRetired()
+   Completion of a move of finished jobs to history. A full batch means 
+   more are left; next batch goes as soon as loop comes round, so claims 
+   and inserts in job lane get their turn in between. */
+void onJobsRetired(CAP_DbOp& op, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+
+  if( op.ok ) { m->jobs_retired += op.id; }
+  if( op.ok && op.id == CAP_JOB_HISTORY_BATCH ) {
+    m->events->armTimer(m->retireD, 1);
+    return;
+  }
+
+  if( m->jobs_retired ) {
+    errlog->writef("moved %lu finished jobs to history", LOG_INFO, 
+      m->jobs_retired);
+    m->jobs_retired=0;
+  }
+  m->events->armTimer(m->retireD, m->retire_msec);
+}
+
+/* onRetire()
+   Timer handler; moves a batch of finished jobs out of job table so it 
+   holds little more than jobs still waiting or running. Timer is 
+   re-armed by completion, so one batch is out at a time. */
+void onRetire(int fd, unsigned events, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  CAP_DbOp* op = new CAP_DbOp(DBOP_JOB_RETIRE, onJobsRetired, m);
+  op->id = CAP_JOB_HISTORY_BATCH;
+  m->db->submit(op);
+}
+
+/* onJobsReleased()
+   Completion of a return of claimed jobs to waiting */
+void onJobsReleased(CAP_DbOp& op, void* ctx) {
+  if( op.ok && op.id ) {
+    errlog->writef("returned %u claimed jobs to waiting", LOG_INFO, op.id);
+  }
+}
+
+/* releaseJobs()
+   Returns jobs claimed but not finished, including the one downloader 
+   has, to waiting so the next run hands them out */
+void releaseJobs(CAP_Master* m) {
+  CAP_DbOp* op = new CAP_DbOp(DBOP_JOB_RELEASE, onJobsReleased, m);
+  JobRec job;
+  while( m->jobs.pop(job) ) {
+    op->jobs.push_back(job);
+  }
+  if( m->download_job_id ) {
+    job.id = m->download_job_id;
+    op->jobs.push_back(job);
+  }
+
+  /* an empty list would return every job in progress */
+  if( op->jobs.empty() ) {
+    delete op;
+    return;
+  }
+  m->db->submit(op);
+}
+
+/* onContentRow()
+   Row callback of archive select; hands content item to stager, which 
+   copies it while rows keep coming. Runs on a database thread, so it 
+   reads only stager, which is set before that thread starts. */
+void onContentRow(const CAP_DbOp& op, const ContentRec& rec, void* ctx) {
+  ((CAP_Master*)ctx)->stager->push(rec);
+}
+
+/* onArchiveStaged()
+   Stager has copied every content item of archive; sends it to archiver */
+void onArchiveStaged(unsigned archive_id, unsigned long failed, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  if( archive_id != m->archive_job_id ) {
+    errlog->writef("staged archive %u is not the one being created", 
+      LOG_WARNING, archive_id);
+    return;
+  }
+  if( failed ) {
+    errlog->writef("archive %u is missing %lu content items", LOG_WARNING, 
+      archive_id, failed);
+  }
+
+  char sz[32];
+  memset(sz, '\0', 32);
+  sprintf(sz, "%010d", m->archive_job_id);
+
+  /* send command to archiver */
+  CAP_PipeMessage msg_send;
+  msg_send.command="MSG_ARCHIVE";
+  msg_send.body.assign(sz);
+  m->pipe_archiver->sendMessage(msg_send);
+}
+
+/* onArchiveSelected()
+   Completion of archive select; content was queued for stager as it was 
+   read, and archive goes to archiver once stager has copied the last */
+void onArchiveSelected(CAP_DbOp& op, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  m->archive_selecting=false;
+  if( !op.ok ) { return; }
+
+  m->archive_job_id=op.id;
+  m->archive_user_id=op.user_id;
+  if( op.rows ) {
+    m->stager->finish(op.id);
+  }
+  else { /* how is this empty? */
+    m->status->archiveFinished(m->archive_job_id);
+    errlog->writef("found an empty archive %d and marked it complete", 
+      LOG_WARNING, m->archive_job_id);
+    m->archive_job_id=0;
+    m->archive_user_id=0;
+  }
+}
+
+/* dispatchWork()
+   Sends queued jobs and archives to any component which is not busy. 
+   Jobs come from the batch last claimed; archive selects run on database 
+   thread and their completions do the sending. */
+void dispatchWork(CAP_Master* m) {
+  /* if the downloader is not busy, then send it the next claimed job */
+  JobRec job;
+  if( !m->download_job_id && m->jobs.pop(job) ) {
+    m->download_job_id=job.id;
+    m->download_user_id=job.user_id;
+
+    CAP_PipeMessage msg_send;
+    msg_send.command.swap(job.type);
+    msg_send.body.swap(job.url);
+    m->pipe_downloader->sendMessage(msg_send);
+  }
+  claimJobs(m);
+
+  /* if the archiver is not busy, then check for the next one which needs 
+     created */
+  if( !m->archive_job_id && !m->archive_selecting ) {
+    m->archive_selecting=true;
+    m->status->flush(); /* select must see archives already finished */
+    CAP_DbOp* op = new CAP_DbOp(DBOP_ARCHIVE_SELECT, onArchiveSelected, m);
+    op->row = onContentRow;
+    m->db->submit(op);
+  }
+}
+
+/* onMsgQuit()
+   MSG_QUIT; stops Master Program */
+void onMsgQuit(CAP_PipeMessageRef& msg, void* ctx) {
+  ((CAP_Master*)ctx)->status->flush();
+  throw 0;
+}
+
+/* onMsgNull()
+   MSG_NULL; a kick from an operator; checks for work added to database 
+   directly */
+void onMsgNull(CAP_PipeMessageRef& msg, void* ctx) {
+  jobsAdded((CAP_Master*)ctx);
+}
+
+/* onMsgHello()
+   MSG_HELLO; component announcing its pipe and the protocol version it 
+   speaks. Answers on that pipe in the version both sides understand. */
+void onMsgHello(CAP_PipeMessageRef& msg, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  CAP_Tokens body;
+  cap_tokenize(msg.body, body);
+
+  CAP_Pipe* pipe=NULL;
+  if( body[0].equals(m->pipe_downloader->getName().c_str()) ) { 
+    pipe=m->pipe_downloader; 
+  }
+  else if( body[0].equals(m->pipe_archiver->getName().c_str()) ) { 
+    pipe=m->pipe_archiver; 
+  }
+  if( !pipe || body.size() < 2 ) {
+    errlog->writef("received MSG_HELLO for unknown pipe %.*s", LOG_WARNING, 
+      body[0].len, body[0].ptr);
+    return;
+  }
+
+  int version = cap_touint(body[1]);
+  if( version > PIPE_PROTO_FRAME ) { version=PIPE_PROTO_FRAME; }
+  if( version < PIPE_PROTO_TEXT ) { version=PIPE_PROTO_TEXT; }
+  pipe->setVersion(version);
+
+  CAP_PipeMessage reply;
+  char sz[16];
+  sprintf(sz, "%d", version);
+  reply.command="MSG_HELLO";
+  reply.body.assign(sz);
+  pipe->sendMessage(reply);
+  errlog->writef("pipe %s now speaks protocol version %d", LOG_INFO, 
+    pipe->getName().c_str(), version);
+}
+
+/* onDbQueued()
+   Completion of an insert which queued work */
+void onDbQueued(CAP_DbOp& op, void* ctx) {
+  wantWork((CAP_Master*)ctx);
+}
+
+/* onJobInserted()
+   Completion of a job insert */
+void onJobInserted(CAP_DbOp& op, void* ctx) {
+  if( op.ok ) { jobsAdded((CAP_Master*)ctx); }
+}
+
+/* onSpoolApplied()
+   Database has a spooled request; same as completion of its insert */
+void onSpoolApplied(CAP_DbOp& op, void* ctx) {
+  if( op.kind == DBOP_JOB_INSERT ) { onJobInserted(op, ctx); }
+  else { onDbQueued(op, ctx); }
+}
+
+/* submitBody()
+   Queues a database operation on a copy of message's body; spooled 
+   first if there is a spool, in which case spool's completion is used */
+void submitBody(CAP_Master* m, DbOpKind kind, CAP_PipeMessageRef& msg, 
+  PCAP_DbDoneProc done=NULL)
+{
+  if( m->spool ) {
+    m->spool->append(kind, 1, msg.body);
+    return;
+  }
+
+  CAP_DbOp* op = new CAP_DbOp(kind, done, m);
+  op->user_id = 1;
+  op->body.assign(msg.body.ptr, msg.body.len);
+  m->db->submit(op);
+}
+
+/* onMsgArchiveReq()
+   MSG_ARCHIVEREQ; request to create an archive */
+void onMsgArchiveReq(CAP_PipeMessageRef& msg, void* ctx) {
+  /* any number of content IDs */
+  submitBody((CAP_Master*)ctx, DBOP_ARCHIVE_INSERT, msg, onDbQueued);
+}
+
+/* onMsgArchived()
+   MSG_ARCHIVED; archiver has finished */
+void onMsgArchived(CAP_PipeMessageRef& msg, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  if( !m->archive_job_id ) {
+    errlog->write("received unexpected MSG_ARCHIVED", LOG_WARNING);
+    return;
+  }
+
+  /* move archive to content directory */
+  char sz[128];
+  memset(sz, '\0', 128);
+  sprintf(sz, "mv \"%s%010d.zip\" \"%s\"", m->archive_dir.c_str(), 
+    m->archive_job_id, m->content_dir.c_str());
+  system(sz);
+
+  /* clear archive directory */
+  memset(sz, '\0', 128);
+  sprintf(sz, "rm %s*", m->archive_dir.c_str());
+  system(sz);
+
+  /* update archive as completed; written before any select submitted 
+     later */
+  m->status->archiveFinished(m->archive_job_id);
+  errlog->writef("created archive %010d.zip", LOG_INFO, m->archive_job_id);
+  m->archive_job_id=0;
+  m->archive_user_id=0;
+  wantWork(m);
+}
+
+/* onClientDownload()
+   MSG_CLIENTREQ of type download */
+void onClientDownload(CAP_PipeMessageRef& msg, void* ctx) {
+  /* a request database would reject must not reach spool, where it would 
+     be retried for good */
+  CAP_Tokens body;
+  cap_tokenize(msg.body, body);
+  if( !CAP_Store::jobType(body, errlog) ) { return; }
+  submitBody((CAP_Master*)ctx, DBOP_JOB_INSERT, msg, onJobInserted);
+}
+
+/* onClientDelete()
+   MSG_CLIENTREQ of type delete */
+void onClientDelete(CAP_PipeMessageRef& msg, void* ctx) {
+  CAP_Tokens body;
+  cap_tokenize(msg.body, body);
+  if( body.size() < 2 ) {
+    errlog->writef("message body parsing error in content delete: %d lines "
+      "when 2 were expected", LOG_ERROR, body.size());
+    return;
+  }
+  ((CAP_Master*)ctx)->status->contentDeleted(cap_touint(body[1]));
+}
+
+/* onClientRename()
+   MSG_CLIENTREQ of type rename */
+void onClientRename(CAP_PipeMessageRef& msg, void* ctx) {
+  CAP_Tokens body;
+  cap_tokenize(msg.body, body);
+  if( body.size() != 3 || body.more ) {
+    errlog->writef("message body parsing error in content rename: %d lines "
+      "when 3 were expected", LOG_ERROR, body.size());
+    return;
+  }
+  ((CAP_Master*)ctx)->status->contentRenamed(cap_touint(body[1]), 
+    body[2].str());
+}
+
+/* onMsgClientReq()
+   MSG_CLIENTREQ; request from client extension, routed by its type on the 
+   first line of body */
+void onMsgClientReq(CAP_PipeMessageRef& msg, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  const char* nl = (const char*)memchr(msg.body.ptr, '\n', msg.body.len);
+  CAP_StrRef type(msg.body.ptr, nl ? nl-msg.body.ptr : msg.body.len);
+
+  if( !m->clientreq->dispatch(type, msg, ctx) ) {
+    errlog->writef("received unknown MSG_CLIENTREQ type: %.*s", 
+      LOG_WARNING, type.len, type.ptr);
+  }
+}
+
+/* onContentInserted()
+   Completion of downloaded content's insert; moves file into storage and 
+   marks job completed */
+void onContentInserted(CAP_DbOp& op, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  if( !op.ok ) { return; }
+  if( !m->download_job_id ) {
+    errlog->write("content inserted with no download job", LOG_WARNING);
+    return;
+  }
+
+  unsigned content_id=op.id;
+  CAP_Tokens body;
+  cap_tokenize(op.body,body);
+  const CAP_StrRef& filename = body[0];
+
+  /* prepare move commad */
+  char szSystemCmd[1024];
+  memset(szSystemCmd, '\0', 1024);
+
+  if( snprintf(szSystemCmd, 1024, "mv %s%.*s %s%010u.html", 
+               m->download_dir.c_str(), filename.len, filename.ptr, 
+               m->content_dir.c_str(), content_id) == -1 )
+  {
+    errlog->writef("unable to format file name for content %d", 
+      LOG_ERROR, content_id);
+    return;
+  }
+
+  /* move content into storage */
+  system(szSystemCmd);
+
+  /* clear download location */
+  memset(szSystemCmd, '\0', 1024);
+  if( sprintf(szSystemCmd, "rm %s*", m->download_dir.c_str()) == -1 ) {
+    errlog->writef("unable to format command to clear download dir.", 
+      LOG_ERROR);
   }
   else {
+    system(szSystemCmd);
+  }
+
+  /* mark job completed */
+  m->status->jobFinished(m->download_job_id);
+  m->download_job_id  =0;
+  m->download_user_id =0;
+  wantWork(m);
+}
+
+/* onMsgDownloaded()
+   MSG_DOWNLOADED; downloader has finished. Content is inserted on 
+   database thread; downloader stays busy until that completes. */
+void onMsgDownloaded(CAP_PipeMessageRef& msg, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  if( !m->download_job_id ) {
+    errlog->write("received unexpected MSG_DOWNLOADED", LOG_WARNING);
+    return;
+  }
+  CAP_DbOp* op = new CAP_DbOp(DBOP_CONTENT_INSERT, onContentInserted, m);
+  op->user_id = m->download_user_id;
+  op->body.assign(msg.body.ptr, msg.body.len);
+  m->db->submit(op);
+}
+
+/* onMsgDownloadFail()
+   MSG_DOWNLOADFAIL; downloader could not fetch job */
+void onMsgDownloadFail(CAP_PipeMessageRef& msg, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  if( !m->download_job_id ) {
+    errlog->write("received unexpected MSG_DOWNLOADFAIL", LOG_WARNING);
+    return;
+  }
+  errlog->writef("downloader indicated that job %u failed", LOG_WARNING, 
+    m->download_job_id);
+
+  /* mark job failed */
+  m->status->jobFailed(m->download_job_id);
+  m->download_job_id  =0;
+  m->download_user_id =0;
+  wantWork(m);
+}
+
+/* onMsgUnknown()
+   Any message without a handler of its own */
+void onMsgUnknown(CAP_PipeMessageRef& msg, void* ctx) {
+  errlog->writef("received unknown message %.*s", LOG_WARNING, 
+    msg.command.len, msg.command.ptr);
+}
+
+/* pipeTransport()
+   Reads transport configured for a pipe ("fifo", "seqpacket" or 
+   "shmring"); FIFO unless configured otherwise */
+PipeTransport pipeTransport(const char* key) {
+  string strTransport;
+  if( !xmlconfig->getValue(key, strTransport) || strTransport == "fifo" ) {
+    return PIPE_FIFO;
+  }
+  else if( strTransport == "seqpacket" ) {
+    return PIPE_SEQPACKET;
+  }
+  else if( strTransport == "shmring" ) {
+    return PIPE_SHMRING;
+  }
+
+  errlog->writef("unknown transport %s for %s; using fifo", LOG_WARNING, 
+    strTransport.c_str(), key);
+  return PIPE_FIFO;
+}
+
+/* makeStore()
+   Creates store configured under database ("mysql", "sqlite" or 
+   "memory"); MySQL unless configured otherwise. Throws -1 if what it 
+   needs is missing. */
+CAP_Store* makeStore() {
+  string strBackend;
+  StoreBackend backend = STORE_MYSQL;
+  if( xmlconfig->getValue("database.backend", strBackend) && 
+      strBackend != "mysql" ) {
+    if( strBackend == "sqlite" ) {
+      backend = STORE_SQLITE;
+    }
+    else if( strBackend == "memory" ) {
+      backend = STORE_MEMORY;
+    }
+    else {
+      errlog->writef("unknown database backend %s", LOG_FATAL, 
+        strBackend.c_str());
+      throw -1;
+    }
+  }
+
+  if( backend == STORE_MEMORY ) {
+    return new CAP_MemStore(errlog);
+  }
+  if( backend == STORE_SQLITE ) {
+    string strFile;
+    if( !xmlconfig->getValue("database.sqlite_file", strFile) ) {
+      errlog->write("failed to read SQLite database file from XML", 
+        LOG_FATAL);
+      throw -1;
+    }
+    return new CAP_SqliteStore(errlog, strFile);
+  }
+
+  /* get information needed to connect to database */
+  string strDBconnect="";
+  string strDBuser="";
+  string strDBpasswd="";
+  if( !xmlconfig->getValue("database.connect", strDBconnect) ) {
+    errlog->write("failed to read database connection string from XML", 
+      LOG_FATAL);
+    throw -1;
+  }
+  if( !xmlconfig->getValue("database.master_user", strDBuser) ) {
+    errlog->write("failed to read database username from XML", LOG_FATAL);
+    throw -1;
+  }
+  if( !xmlconfig->getValue("database.master_password", strDBpasswd) ) {
+    errlog->write("failed to read database password from XML", LOG_FATAL);
+    throw -1;
+  }
+  return new CAP_MysqlStore(errlog, strDBconnect, strDBuser, strDBpasswd);
+}
+
+/* readFailed()
+   Counts a failed read from master pipe; terminates once too many have 
+   happened in a row */
+void readFailed(CAP_Master* m) {
+  errlog->writef("message from pipe %s was lost", LOG_WARNING, 
+                 m->pipe_master->getName().c_str());
+
+  /* if number of read errors has reached a concerning level, then 
+     something has gone wrong, so terminate */
+  if( ++m->errCount_Rd == PIPE_READ_ERROR_MAX ) {
+    errlog->writef("The maximum number of allowed errors (%d) reading "
+                   "from pipe %s has been reached. Master Program will "
+                   "now terminate.", LOG_FATAL, PIPE_READ_ERROR_MAX, 
+                   m->pipe_master->getName().c_str());
+    throw -1;
+  }
+}
+
+/* onMasterPipe()
+   Event handler for master pipe; reads everything which has arrived and 
+   handles every whole message in it. A partial message waits in pipe's 
+   buffer until the rest arrives. */
+void onMasterPipe(int fd, unsigned events, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  CAP_PipeMessageRef msg; /* refers to pipe's buffer; no copies */
+
+  try {
+    m->pipe_master->receive();
+  }
+  catch( CAP_PipeException& err ) {
+    readFailed(m);
+    return;
+  }
+
+  while( m->pipe_master->hasMessage() ) {
+    if( !m->pipe_master->getMessage(msg) ) {
+      readFailed(m);
+      break;
+    }
+
+    m->errCount_Rd=0; /* a successful read disregards any errors */
+    m->dispatcher->dispatch(msg, m);
+    msg.release(); /* handler is done with buffer space */
+
+    /* next message! */
+  }
+
+  /* requests spooled by the batch reach disk with one fsync */
+  if( m->spool ) { m->spool->sync(); }
+
+  /* handlers which queued work or freed a component raised wakeup; 
+     database is checked once for the whole batch */
+}
+
+/* onWakeup()
+   Wakeup handler; sends queued work to any component which is free */
+void onWakeup(int fd, unsigned events, void* ctx) {
+  dispatchWork((CAP_Master*)ctx);
+}
+
+/* onRescan()
+   Timer handler; picks up work queued without a message to master. Its 
+   interval is the longest such work waits. Messages waiting for a 
+   component to open its pipe are retried by the pipe itself. */
+void onRescan(int fd, unsigned events, void* ctx) {
+  CAP_Master* m = (CAP_Master*)ctx;
+  m->jobs_waiting=true;
+  dispatchWork(m);
+}
+
+/* onSignal()
+   Handles signals delivered through event loop */
+void onSignal(int fd, unsigned sig, void* ctx) {
+  switch( sig ) {
+  case SIGPIPE:
+    /* broken pipe; write which caused it will report failure */
+    errlog->write("received SIGPIPE signal", LOG_ERROR);
+    break;
+  case SIGTERM:
+  case SIGINT:
+    errlog->writef("received signal %d; terminating", LOG_INFO, sig);
+    throw 0;
+  default:
     /* what is this garbage??? */
-    errlog->writef("received signal %d when SIGPIPE was expected", 
-      LOG_WARNING, sig);
+    errlog->writef("received unexpected signal %d", LOG_WARNING, sig);
+    break;
   }
 }
 
@@ -71,7 +702,32 @@ int main(int argc, char* argv[]) {
   CAP_Pipe* pipe_downloader=NULL; /* commands to downloader */
   CAP_Pipe* pipe_archiver=NULL;   /* commands to archiver */
   int nFdRuntime=0;               /* file descriptor of PID file */
-  mysql::MySQL_Driver* sqldriver=NULL;
+  CAP_Store* store=NULL;          /* jobs, content and archives */
+  int nDbThreads=CAP_DB_POOL_SIZE;/* database connections and threads */
+  CAP_EventLoop* events=NULL;     /* message loop */
+  CAP_Master master;              /* state shared by event handlers */
+  master.events=NULL;
+  master.pipe_master=NULL;
+  master.pipe_downloader=NULL;
+  master.pipe_archiver=NULL;
+  master.errCount_Rd=0;
+  master.download_job_id=0;
+  master.download_user_id=0;
+  master.archive_job_id=0;
+  master.archive_user_id=0;
+  master.wakeD=-1;
+  master.db=NULL;
+  master.status=NULL;
+  master.spool=NULL;
+  master.stager=NULL;
+  master.jobs_claiming=false;
+  master.jobs_waiting=true;
+  master.archive_selecting=false;
+  master.retireD=-1;
+  master.retire_msec=CAP_JOB_HISTORY_MSEC;
+  master.jobs_retired=0;
+  master.dispatcher=NULL;
+  master.clientreq=NULL;
 
   /* exit status is thrown upon an abort or normal terminaton */
   try {
@@ -196,12 +852,6 @@ int main(int argc, char* argv[]) {
   //    Additional Setup
   //---------------------------------------------------------------------------
 
-  /* designate handler for any SIGPIPE signals */
-  if( signal(SIGPIPE, sig_pipe) == SIG_ERR ) {
-    errlog->write("failed to designate handler for SIGPIPE signals", 
-      LOG_WARNING);
-  }
-
   /* get locations for downloading, content and archiving */
   string strDownload_Dir="";
   string strContent_Dir="";
@@ -249,47 +899,33 @@ int main(int argc, char* argv[]) {
   strPipe_Archiver = strPipe_Dir + strPipe_Archiver;
   try {
     pipe_master = new CAP_Pipe("master", errlog);
-    pipe_master->create(strPipe_Master, PIPE_RDONLY);
+    pipe_master->create(strPipe_Master, PIPE_RDONLY, 
+      pipeTransport("pipes.pipes_master_transport"));
     pipe_downloader = new CAP_Pipe("downloader", errlog);
-    pipe_downloader->create(strPipe_Downloader, PIPE_WRONLY);
+    pipe_downloader->create(strPipe_Downloader, PIPE_WRONLY, 
+      pipeTransport("pipes.pipes_downloader_transport"));
     pipe_archiver = new CAP_Pipe("archiver", errlog);
-    pipe_archiver->create(strPipe_Archiver, PIPE_WRONLY);
+    pipe_archiver->create(strPipe_Archiver, PIPE_WRONLY, 
+      pipeTransport("pipes.pipes_archiver_transport"));
+
+    /* keep descriptors open for life of program */
+    pipe_downloader->connect();
+    pipe_archiver->connect();
   }
   catch( CAP_PipeException err) {
     throw -1;
   }
 
-  /* get information needed to connect to database */
-  string strDBconnect="";
-  string strDBuser="";
-  string strDBpasswd="";
-  if( !xmlconfig->getValue("database.connect", strDBconnect) ) {
-    errlog->write("failed to read database connection string from XML", 
-      LOG_FATAL);
-    throw -1;
-  }
-  if( !xmlconfig->getValue("database.master_user", strDBuser) ) {
-    errlog->write("failed to read database username from XML", LOG_FATAL);
-    throw -1;
-  }
-  if( !xmlconfig->getValue("database.master_password", strDBpasswd) ) {
-    errlog->write("failed to read database password from XML", LOG_FATAL);
-    throw -1;
+  /* one connection for each database thread */
+  string strPoolSize;
+  if( xmlconfig->getValue("database.pool_size", strPoolSize) && 
+      atoi(strPoolSize.c_str()) > 0 ) {
+    nDbThreads = atoi(strPoolSize.c_str());
   }
 
   /* connect to database */
-  try {
-    sqldriver = mysql::get_driver_instance();
-    sqlconn = sqldriver->connect(strDBconnect.c_str(),strDBuser.c_str(),
-      strDBpasswd.c_str());
-    errlog->write("opened connection to database");
-  }
-  catch( SQLException& err ) {
-    errlog->writef("failed to connect to database: what: %s, code: %d, "
-                   "state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
-	           err.getSQLState().c_str());
-    throw -1;
-  }
+  store = makeStore();
+  store->open(nDbThreads);
 
   /* give other components some time to start before we start */
   sleep(CAP_STARTUP_DELAY);
@@ -298,204 +934,118 @@ int main(int argc, char* argv[]) {
   //    Message Loop
   //---------------------------------------------------------------------------
 
-  errlog->write("master program started; entering message loop");
+  /* register pipes, timers and signals with event loop */
+  master.pipe_master = pipe_master;
+  master.pipe_downloader = pipe_downloader;
+  master.pipe_archiver = pipe_archiver;
+  master.download_dir = strDownload_Dir;
+  master.content_dir = strContent_Dir;
+  master.archive_dir = strArchive_Dir;
+  try {
+    /* register a handler for every message */
+    master.dispatcher = new CAP_Dispatcher(errlog);
+    master.dispatcher->add(MSGT_QUIT, onMsgQuit);
+    master.dispatcher->add(MSGT_NULL, onMsgNull);
+    master.dispatcher->add(MSGT_HELLO, onMsgHello);
+    master.dispatcher->add(MSGT_ARCHIVEREQ, onMsgArchiveReq);
+    master.dispatcher->add(MSGT_ARCHIVED, onMsgArchived);
+    master.dispatcher->add(MSGT_CLIENTREQ, onMsgClientReq);
+    master.dispatcher->add(MSGT_DOWNLOADED, onMsgDownloaded);
+    master.dispatcher->add(MSGT_DOWNLOADFAIL, onMsgDownloadFail);
+    master.dispatcher->setDefault(onMsgUnknown);
+    master.clientreq = new CAP_NameDispatcher(errlog);
+    master.clientreq->add("download", onClientDownload);
+    master.clientreq->add("delete", onClientDelete);
+    master.clientreq->add("rename", onClientRename);
+  }
+  catch( CAP_Exception& err ) {
+    errlog->writef("failed to register message handlers: %d", LOG_FATAL, 
+      err.msg);
+    throw -1;
+  }
 
-  // enter message loop; reading pipes until told to terminate
-  CAP_PipeMessage msg;
-  int errCount_Rd=0; /* number of errors which have occurred trying 
-			to read from pipe */
-  unsigned download_job_id=0; /* job ID being handled by downloader */
-  int download_user_id=0; /* user ID of above job */
-  unsigned archive_job_id=0; /* ID of archive being created */
-  int archive_user_id=0; /* user ID of above archive */
-
-	while( true ) {
-    /* if the downloader is not busy, then check for available jobs and 
-       send one to be processed */
-    if( !download_job_id ) {
-      CAP_PipeMessage msg_send;
-      if( dosql_job_select(download_job_id, download_user_id, 
-			   msg_send.command, msg_send.body) )
-      {
-        /* there is a job so send it to downloader */
-				pipe_downloader->sendMessage(msg_send);
-      }
+  try {
+    events = new CAP_EventLoop(errlog);
+    master.events = events;
+
+    /* buffer may grow to hold large requests */
+    string strBufferMax;
+    if( xmlconfig->getValue("pipes.pipe_buffer_max", strBufferMax) ) {
+      pipe_master->setBufferLimit(atoi(strBufferMax.c_str()));
     }
+    pipe_master->listen();
+    events->addFd(pipe_master->getFd(), onMasterPipe, &master);
+
+    /* a message a component could not take yet goes as soon as it can */
+    pipe_downloader->watch(events);
+    pipe_archiver->watch(events);
+    master.wakeD = events->addWakeup(onWakeup, &master);
+
+    /* content is copied for archiving on a thread of its own, as archive 
+       select reads it */
+    master.stager = new CAP_Stager(errlog, strContent_Dir, strArchive_Dir);
+    master.stager->start(events, onArchiveStaged, &master);
 
-    /* if the archiver is not busy, then check for the next one which needs 
-       created and send it off */
-    if( !archive_job_id ) {
-      CAP_PipeMessage msg_send;
-      list<ContentRec> content;
-
-      if( dosql_archive_select(archive_job_id, archive_user_id, content) ) {
-	if( content.size() ) {
-	  /* copy content items into directory for archiving */
-	  for( list<ContentRec>::iterator it=content.begin();
-	       it!=content.end();
-	       it++ )
-	  {
-	    char sz[512];
-	    memset(sz, '\0', 512);
-	    sprintf(sz, "cp \"%s%010d.html\" \"%s%d-%s.html\"", 
-		    strContent_Dir.c_str(), (*it).id, strArchive_Dir.c_str(), 
-		    (*it).id, (*it).title.c_str());
-	    system(sz);
-	  }
-	
-	  char sz[32];
-	  memset(sz, '\0', 32);
-	  sprintf(sz, "%010d", archive_job_id);
-
-	  /* send command to archiver */
-	  msg_send.command="MSG_ARCHIVE";
-	  msg_send.body.assign(sz);
-	  pipe_archiver->sendMessage(msg_send);
-	}
-	else { /* how is this empty? */
-	  dosql_archive_finish(archive_job_id);
-	  errlog->writef("found an empty archive %d and marked it complete", 
-            LOG_WARNING, archive_job_id);
-	  archive_job_id=0;
-	  archive_user_id=0;
-	}
-      }
+    /* database runs on a thread of its own from here on */
+    master.db = new CAP_DbExecutor(errlog, store);
+    master.db->start(events, nDbThreads);
+
+    /* jobs a run which crashed left in progress; only one master runs, so 
+       nobody is working on them. Job lane runs this before first claim. */
+    master.db->submit(new CAP_DbOp(DBOP_JOB_RELEASE, onJobsReleased, 
+      &master));
+    master.status = new CAP_StatusBatch(errlog, master.db);
+    master.status->start(events);
+
+    /* client and archive requests are spooled if a file is configured; 
+       anything left from last run is replayed now */
+    string strSpool;
+    if( xmlconfig->getValue("database.spool_file", strSpool) ) {
+      master.spool = new CAP_Spool(errlog, master.db, strSpool, 
+        onSpoolApplied, &master);
+      master.spool->open();
+      master.spool->start(events);
     }
 
-    /* wait for a message */
-    if( !pipe_master->getMessage(msg) ) {
-      errlog->writef("message from pipe %s was lost", LOG_WARNING, 
-                     pipe_master->getName().c_str());
-
-      /* if number of read errors has reached a concerning level, then 
-         something has gone wrong, so terminate */
-      if( ++errCount_Rd == PIPE_READ_ERROR_MAX ) {
-        errlog->writef("The maximum number of allowed errors (%d) reading "
-	               "from pipe %s has been reached. Master Program will "
-	               "now terminate.", LOG_FATAL, PIPE_READ_ERROR_MAX, 
-	               pipe_master->getName().c_str());
-	throw -1;
-      }
+    /* work added to database without a message waits at most this long */
+    string strRescan;
+    unsigned rescan = CAP_RESCAN_INTERVAL;
+    if( xmlconfig->getValue("rescan_interval", strRescan) && 
+        atoi(strRescan.c_str()) > 0 ) {
+      rescan = atoi(strRescan.c_str());
     }
-		else {
-      errCount_Rd=0; /* a successful read disregards any errors */
-
-      if( msg.command == "MSG_QUIT" ) {
-	/* stop Master Program */
-	throw 0;
-      }
-      else if( msg.command == "MSG_NULL" ) {
-	/* do nothing */
-      }
-      else if( msg.command == "MSG_ARCHIVEREQ" ) {
-	/* request to create an archive */
-	list<string> body;
-	parseBody(msg.body,body);
-	dosql_archive_insert(1,body);
-      }
-      else if( msg.command == "MSG_ARCHIVED" ) {
-	if( !archive_job_id ) {
-	  errlog->write("received unexpected MSG_ARCHIVED", LOG_WARNING);
-	  continue;
-	}
-
-	/* move archive to content directory */
-	char sz[128];
-	memset(sz, '\0', 128);
-	sprintf(sz, "mv \"%s%010d.zip\" \"%s\"", strArchive_Dir.c_str(), 
-	  archive_job_id, strContent_Dir.c_str());
-	system(sz);
-
-	/* clear archive directory */
-	memset(sz, '\0', 128);
-	sprintf(sz, "rm %s*", strArchive_Dir.c_str());
-	system(sz);
-
-	/* update archive as completed */
-	dosql_archive_finish(archive_job_id);
-	errlog->writef("created archive %010d.zip", LOG_INFO, archive_job_id);
-	archive_job_id=0;
-	archive_user_id=0;
-      }
-			else if( msg.command == "MSG_CLIENTREQ" ) {
-				/* request from client extension */
-				list<string> body;
-				parseBody(msg.body,body);
-				list<string>::iterator type=body.begin();
-
-				/* determine client request type */
-				if( *type == "download" ) {
-			        dosql_job_insert(1,body);
-				}
-				else if( *type == "delete" ) {
-					dosql_content_delete(body);
-				}
-				else if( *type == "rename" ) {
-					dosql_content_rename(body);
-				}
-				else {
-					errlog->writef("received unknown MSG_CLIENTREQ type: %s", 
-						LOG_WARNING, (*type).c_str());
-				}
-			}
-      		else if( msg.command == "MSG_DOWNLOADED" ) {
-		        /* downloader has finished */
-				list<string> body;
-				parseBody(msg.body,body);
-
-				/* insert content into database */
-				string strFilename="";
-				unsigned content_id=0;
-				if( !dosql_content_insert(body, download_user_id, strFilename, content_id) ) {
-					continue;
-				}
-
-				/* prepare move commad */
-				char szSystemCmd[1024];
-				memset(szSystemCmd, '\0', 1024);
-
-				int fret=0;
-				if( sprintf(szSystemCmd, "mv %s%s %s%010u.html", 
-					strDownload_Dir.c_str(), strFilename.c_str(), 
-					strContent_Dir.c_str(), content_id) == -1 )
-				{
-					errlog->writef("unable to format file name for content %d", LOG_ERROR, content_id);
-					continue;
-				}
-
-				/* move content into storage */
-				system(szSystemCmd);
-
-				/* clear download location */
-				memset(szSystemCmd, '\0', 1024);
-				if( sprintf(szSystemCmd, "rm %s*", strDownload_Dir.c_str()) == -1 ) {
-					errlog->writef("unable to format command to clear download dir.", LOG_ERROR);
-				}
-				else {
-					system(szSystemCmd);
-				}
-
-				/* mark job completed */
-				dosql_job_finish(download_job_id);
-				download_job_id  =0;
-				download_user_id =0;
-			}
-			else if( msg.command == "MSG_DOWNLOADFAIL" ) {
-				errlog->writef("downloader indicated that job %u failed", LOG_WARNING, download_job_id);
-
-				/* mark job failed */
-				dosql_job_failed(download_job_id);
-				download_job_id  =0;
-				download_user_id =0;
-			}
-			else {
-				/* unknown message */
-				errlog->writef("received unknown message %s", LOG_WARNING, msg.command.c_str());
-			}
-		}
-
-		/* next message! */
-	}
+    events->addTimer(rescan, onRescan, &master);
+
+    /* finished jobs leave job table this often; zero keeps them there */
+    string strHistory;
+    if( xmlconfig->getValue("database.history_interval", strHistory) ) {
+      master.retire_msec = atoi(strHistory.c_str()) > 0 ? 
+        atoi(strHistory.c_str()) : 0;
+    }
+    if( master.retire_msec ) {
+      master.retireD = events->addTimer(0, onRetire, &master);
+      events->armTimer(master.retireD, master.retire_msec);
+    }
+    events->addSignal(SIGPIPE, onSignal, &master);
+    events->addSignal(SIGTERM, onSignal, &master);
+    events->addSignal(SIGINT, onSignal, &master);
+  }
+  catch( CAP_EventException& err ) {
+    errlog->writef("failed to set up event loop: %d", LOG_FATAL, err.msg);
+    throw -1;
+  }
+  catch( CAP_PipeException& err ) {
+    errlog->writef("failed to open pipe %s for event loop: %d", LOG_FATAL, 
+      pipe_master->getName().c_str(), err.msg);
+    throw -1;
+  }
+
+  errlog->write("master program started; entering message loop");
+
+  /* send off anything already waiting and handle events until a handler 
+     throws an exit status */
+  wantWork(&master);
+  events->run();
 
   //---------------------------------------------------------------------------
   //    Cleanup
@@ -506,10 +1056,42 @@ int main(int argc, char* argv[]) {
     ret=err;
   }
 
-  // close pipes
+  /* how long each handler took */
+  if( master.dispatcher ) { master.dispatcher->logStats(); }
+  if( master.clientreq ) { master.clientreq->logStats(); }
+  delete master.dispatcher;
+  delete master.clientreq;
+
+  /* let database thread finish what was queued; completions may queue a 
+     little more, which runs right away */
+  if( master.spool ) {
+    try { master.spool->stop(); }
+    catch( int err ) { ret=err; }
+    master.spool->logStats();
+  }
+  if( master.status ) {
+    master.status->flush();
+    master.status->logStats();
+  }
+  if( master.db ) {
+    releaseJobs(&master);
+    master.db->stop();
+    try { master.db->complete(); }
+    catch( int err ) {}
+    delete master.spool;
+    delete master.status;
+    delete master.db;
+  }
+
+  /* stager outlives database threads, as a select may be waiting on it for 
+     room; an archive it had not finished is selected again next run */
+  delete master.stager;
+
+  // close pipes; they stop being watched before event loop goes
   delete pipe_master;
   delete pipe_downloader;
   delete pipe_archiver;
+  delete events;
 
   // close file descriptors and streams
   if( close(nFdRuntime) == -1 ) {
@@ -517,14 +1099,10 @@ int main(int argc, char* argv[]) {
 		   "file. errno: %d", LOG_ERROR, errno);
   }
 
-  try { 
-    delete sqlconn;
-    errlog->write("closed connection to database");
-  }
-  catch( sql::SQLException& err ) {
-    errlog->writef("failed to close database: what: %s, code: %d, "
-                   "state: %s", LOG_WARNING, err.what(), err.getErrorCode(), 
-	           err.getSQLState().c_str());	  
+  if( store ) {
+    store->logStats();
+    delete store;
+    errlog->write("closed connections to database");
   }
 
   errlog->write("terminating Master Program");
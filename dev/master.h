@@ -1,7 +1,7 @@
 //-----------------------------------------------------------------------------
 // File Name: master.h
 // Author: Grant Gipson
-// Date Last Edited: April 16, 2011
+// Date Last Edited: October 16, 2026
 // Description: Various constants, data structures, etc... For Master Program
 //-----------------------------------------------------------------------------
 #ifndef _MASTER_H_
@@ -10,13 +10,57 @@
 #define CAP_FILE_MASK 0666 // file mask for newly-created files
 #define CAP_STARTUP_DELAY 2 /* time to wait before interactions with other 
 			       components begins */
-#define PIPE_BUFFER_SIZE 1000 // size of pipes' read buffers
+#define PIPE_BUFFER_SIZE 1000 // initial size of pipes' read buffers
+#define PIPE_BUFFER_MAX 1048576 /* size pipes' read buffers may grow to 
+				   unless configured otherwise */
+#define PIPE_READ_MAX 65536 /* most room made for a single read from pipe */
+#define PIPE_INLINE_MAX 16384 /* largest datagram sent on a socket; the rest 
+				 of a message follows in a memory file */
+#define PIPE_RING_SIZE 2097152 /* characters in a shared memory ring; must 
+				  be a power of two */
+#define PIPE_BACKLOG 16 /* connections waiting to be accepted on a socket */
 #define PIPE_LINE_MAX 64 /* maximum length for a line not in message body */
 #define PIPE_READ_ERROR_MAX 20 /* max. number of read errors from pipe */
+#define PIPE_RETRY_MSEC 20 /* msec. before a message waiting for a reader to 
+			      open its pipe is tried again; doubles with 
+			      each try */
+#define PIPE_RETRY_MAX_MSEC 1000 /* longest wait between such tries */
+#define CAP_RESCAN_INTERVAL 5000 /* msec. between checks for queued work 
+				    which arrived without a message, unless 
+				    configured otherwise */
+#define CAP_DB_POOL_SIZE 3 /* database connections, and threads using them, 
+			      unless configured otherwise */
+#define CAP_JOB_CLAIM_MAX 8 /* jobs claimed from database at once */
+#define CAP_STAGE_QUEUE_MAX 64 /* content items read by archive select but 
+				not yet copied; select waits for room */
+#define CAP_STATUS_BATCH_MAX 64 /* status changes written in one transaction */
+#define CAP_STATUS_BATCH_MSEC 5 /* longest a status change waits for others 
+				   to join its transaction */
+#define CAP_JOB_HISTORY_MSEC 60000 /* msec. between moves of finished jobs 
+				      to job_history, unless configured 
+				      otherwise */
+#define CAP_JOB_HISTORY_BATCH 500 /* finished jobs moved in one transaction */
+#define CAP_SPOOL_SYNC_MAX 64 /* requests spooled before one fsync, if a 
+				 batch of messages holds more */
+#define CAP_SPOOL_INFLIGHT 64 /* spooled requests handed to database at once */
+#define CAP_SPOOL_RETRY_MSEC 1000 /* msec. before a spooled request database 
+				     failed is tried again; doubles with 
+				     each try */
+#define CAP_SPOOL_RETRY_MAX_MSEC 60000 /* longest wait between tries */
+#define CAP_SPOOL_RETRY_MAX 64 /* tries of a spooled request before it is 
+				  dropped; about an hour of database being 
+				  away */
+#define CAP_SPOOL_TRUNCATE 1048576 /* bytes a drained spool may reach before 
+				      it is emptied */
+#define CAP_DB_PING_IDLE 60 /* sec. a connection may sit idle before it is 
+			       checked before use */
+#define CAP_DB_SLOW_MSEC 250 /* statement taking longer is logged as it 
+				happens */
 
 /* general exception class and common exception codes */
 #define CAPEXC_NOERRLOG      1
 #define CAPEXC_INVALPARAM    2
+#define CAPEXC_DBGONE        3 /* lost connection to database */
 
 class CAP_Exception {
  public:
@@ -0,0 +1,277 @@
+/*******************************************************************************
+  File Name: memstore.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_MemStore class
+*******************************************************************************/
+#include "memstore.h"
+using namespace std;
+
+/* CAP_MemStore::CAP_MemStore()
+   Constructor; store starts empty */
+CAP_MemStore::CAP_MemStore(CAP_Log* _errlog)
+  : CAP_Store(_errlog), nextJob(1), nextContent(1)
+{
+  for( int i=0; i<=DBOP_JOB_RETIRE; i++ ) { ops[i]=0; }
+}
+
+/* CAP_MemStore::~CAP_MemStore()
+   Destructor; everything is lost */
+CAP_MemStore::~CAP_MemStore() {
+  for( JobMap::iterator it=jobs.begin(); it!=jobs.end(); it++ ) {
+    delete it->second;
+  }
+  for( ArchiveMap::iterator it=archives.begin(); it!=archives.end(); it++ ) {
+    delete it->second;
+  }
+}
+
+/* CAP_MemStore::open()
+   Nothing to open; *size* is ignored */
+void CAP_MemStore::open(int size) {
+  errlog->write("using in-memory store; nothing will be kept", LOG_WARNING);
+}
+
+/* CAP_MemStore::run()
+   Runs one operation; failures are recorded in it */
+void CAP_MemStore::run(CAP_DbOp& op) {
+  CAP_Tokens toks;
+
+  if( op.kind >= 0 && op.kind <= DBOP_JOB_RETIRE ) { ops[op.kind]++; }
+  switch( op.kind ) {
+  case DBOP_JOB_INSERT:
+    if( !requestKey(op.key) ) { op.ok = true; break; }
+    cap_tokenize(op.body, toks);
+    op.ok = jobInsert(op.user_id, toks);
+    if( !op.ok ) { keys.erase(op.key); }
+    break;
+  case DBOP_JOB_CLAIM:
+    op.ok = jobClaim(op.id, op.jobs);
+    break;
+  case DBOP_CONTENT_INSERT:
+    cap_tokenize(op.body, toks);
+    op.ok = contentInsert(toks, op.user_id, op.id);
+    break;
+  case DBOP_ARCHIVE_INSERT:
+    if( !requestKey(op.key) ) { op.ok = true; break; }
+    op.ok = archiveInsert(op.user_id, op.body);
+    if( !op.ok ) { keys.erase(op.key); }
+    break;
+  case DBOP_ARCHIVE_SELECT:
+    op.ok = archiveSelect(op);
+    break;
+  case DBOP_STATUS_FLUSH:
+    op.ok = statusFlush(op.status);
+    break;
+  case DBOP_JOB_RETIRE:
+    /* finished jobs are dropped as they finish; there is no history */
+    op.id = 0;
+    op.ok = true;
+    break;
+  case DBOP_KEY_PRUNE:
+    for( KeySet::iterator it=keys.begin(); it!=keys.end(); ) {
+      if( *it < op.key ) { keys.erase(it++); }
+      else { it++; }
+    }
+    op.ok = true;
+    break;
+  case DBOP_JOB_RELEASE:
+    op.id = jobRelease(op.jobs);
+    op.ok = true;
+    break;
+  default:
+    errlog->writef("unknown database operation %d", LOG_ERROR,
+      (int)op.kind);
+    op.ok = false;
+    break;
+  }
+}
+
+/* CAP_MemStore::requestKey()
+   Records request key *key*; false if it was already there, meaning the
+   request went in before. A zero key is never recorded. */
+bool CAP_MemStore::requestKey(unsigned long long key) {
+  if( !key || keys.insert(key).second ) { return true; }
+  errlog->writef("request %llu was already applied; skipped", LOG_INFO, key);
+  return false;
+}
+
+/* CAP_MemStore::jobInsert()
+   Queues a new job */
+bool CAP_MemStore::jobInsert(int user_id, const CAP_Tokens& body) {
+  const char* type = jobType(body, errlog);
+  if( !type ) { return false; }
+
+  CAP_MemJob* job = new CAP_MemJob;
+  job->rec.id = nextJob++;
+  job->rec.user_id = user_id;
+  job->rec.type.assign(type);
+  job->rec.url.assign(body[2].ptr, body[2].len);
+  job->queued = true;
+  jobs[job->rec.id] = job;
+  waiting.push(job);
+  return true;
+}
+
+/* CAP_MemStore::jobClaim()
+   Hands out up to *max* waiting jobs, oldest first; they stay until
+   finished or failed */
+bool CAP_MemStore::jobClaim(unsigned max, list<JobRec>& claimed) {
+  for( unsigned i=0; i<max && !waiting.empty(); i++ ) {
+    CAP_MemJob* job = waiting.pop();
+    job->queued = false;
+    claimed.push_back(job->rec);
+  }
+  return true;
+}
+
+/* CAP_MemStore::jobRelease()
+   Queues claimed jobs in *released* again, or every claimed job if it is
+   empty; they go behind jobs already waiting. Returns how many went. */
+unsigned CAP_MemStore::jobRelease(const list<JobRec>& released) {
+  unsigned moved=0;
+  if( released.empty() ) {
+    for( JobMap::iterator it=jobs.begin(); it!=jobs.end(); it++ ) {
+      if( it->second->queued ) { continue; }
+      it->second->queued = true;
+      waiting.push(it->second);
+      moved++;
+    }
+    return moved;
+  }
+
+  for( list<JobRec>::const_iterator it=released.begin(); 
+       it!=released.end(); it++ ) {
+    JobMap::iterator job = jobs.find((*it).id);
+    if( job == jobs.end() || job->second->queued ) { continue; }
+    job->second->queued = true;
+    waiting.push(job->second);
+    moved++;
+  }
+  return moved;
+}
+
+/* CAP_MemStore::jobDone()
+   Drops a finished or failed job; one finished without being claimed is
+   unlinked from waiting queue first, which means a walk of that queue */
+void CAP_MemStore::jobDone(unsigned job_id) {
+  JobMap::iterator it = jobs.find(job_id);
+  if( it == jobs.end() ) {
+    errlog->writef("no job %u to update", LOG_WARNING, job_id);
+    return;
+  }
+  if( it->second->queued ) { waiting.remove(it->second); }
+  delete it->second;
+  jobs.erase(it);
+}
+
+/* CAP_MemStore::contentInsert()
+   Adds a content item; first line of body is file name (used by caller),
+   second is title */
+bool CAP_MemStore::contentInsert(const CAP_Tokens& body, int user_id,
+  unsigned& content_id)
+{
+  if( body.size() < 2 ) {
+    errlog->writef("message body parsing error: %d lines when 2 were "
+      "expected", LOG_ERROR, body.size());
+    return false;
+  }
+
+  content_id = nextContent++;
+  CAP_MemContent& item = content[content_id];
+  item.user_id = user_id;
+  item.status = 'A';
+  item.title.assign(body[1].ptr, body[1].len);
+  return true;
+}
+
+/* CAP_MemStore::archiveInsert()
+   Adds an archive; first line of body is its title, any number of
+   content IDs follow */
+bool CAP_MemStore::archiveInsert(int user_id, const CAP_StrRef& body) {
+  CAP_LineIter it(body);
+  CAP_StrRef line;
+  it.next(line);
+
+  /* an archive is content whose file name and title are both its title */
+  CAP_Tokens newbody;
+  newbody.tok[0] = line;
+  newbody.tok[1] = line;
+  newbody.count = 2;
+
+  unsigned archive_id;
+  if( !contentInsert(newbody, user_id, archive_id) ) { return false; }
+
+  CAP_MemArchive* archive = new CAP_MemArchive;
+  archive->id = archive_id;
+  archive->user_id = user_id;
+  while( it.next(line) ) {
+    archive->items.push_back(cap_touint(line));
+  }
+  archives[archive_id] = archive;
+  pending.push(archive);
+  return true;
+}
+
+/* CAP_MemStore::archiveSelect()
+   Oldest archive which has yet to be created; its content goes to op's
+   row callback, leaving out items which do not exist */
+bool CAP_MemStore::archiveSelect(CAP_DbOp& op) {
+  CAP_MemArchive* archive = pending.front();
+  if( !archive ) { return false; }
+
+  op.id = archive->id;
+  op.user_id = archive->user_id;
+  ContentRec rec;
+  for( unsigned i=0; i<archive->items.size(); i++ ) {
+    ContentMap::const_iterator it = content.find(archive->items[i]);
+    if( it == content.end() ) { continue; }
+    rec.id = it->first;
+    rec.title = it->second.title;
+    op.emit(rec);
+  }
+  return true;
+}
+
+/* CAP_MemStore::statusFlush()
+   Applies every status change in *set* */
+bool CAP_MemStore::statusFlush(const CAP_StatusSet& set) {
+  for( unsigned i=0; i<set.jobsFinished.size(); i++ ) {
+    jobDone(set.jobsFinished[i]);
+  }
+  for( unsigned i=0; i<set.jobsFailed.size(); i++ ) {
+    jobDone(set.jobsFailed[i]);
+  }
+
+  for( unsigned i=0; i<set.archivesFinished.size(); i++ ) {
+    ArchiveMap::iterator it = archives.find(set.archivesFinished[i]);
+    if( it == archives.end() ) { continue; }
+    pending.remove(it->second);
+    delete it->second;
+    archives.erase(it);
+  }
+
+  for( unsigned i=0; i<set.contentDeleted.size(); i++ ) {
+    ContentMap::iterator it = content.find(set.contentDeleted[i]);
+    if( it != content.end() ) { it->second.status = 'D'; }
+  }
+  for( list<ContentRec>::const_iterator it=set.contentRenamed.begin();
+       it!=set.contentRenamed.end(); it++ ) {
+    ContentMap::iterator item = content.find((*it).id);
+    if( item != content.end() ) { item->second.title = (*it).title; }
+  }
+  return true;
+}
+
+/* CAP_MemStore::logStats()
+   Writes operation counts and what the store holds to log */
+void CAP_MemStore::logStats() const {
+  errlog->writef("in-memory store: %lu job inserts, %lu claims, %lu content "
+    "inserts, %lu archive inserts, %lu archive selects, %lu status flushes",
+    LOG_INFO, ops[DBOP_JOB_INSERT], ops[DBOP_JOB_CLAIM],
+    ops[DBOP_CONTENT_INSERT], ops[DBOP_ARCHIVE_INSERT],
+    ops[DBOP_ARCHIVE_SELECT], ops[DBOP_STATUS_FLUSH]);
+  errlog->writef("in-memory store holds %u unfinished jobs, %u content "
+    "items, %u archives waiting", LOG_INFO, (unsigned)jobs.size(),
+    (unsigned)content.size(), (unsigned)archives.size());
+}
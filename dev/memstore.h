@@ -0,0 +1,127 @@
+/*******************************************************************************
+  File Name: memstore.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Store kept only in memory, for measuring the Master Program
+    without a database behind it
+*******************************************************************************/
+#ifndef _MEMSTORE_H_
+#define _MEMSTORE_H_
+
+#include "store.h"
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
+#include <vector>
+#include <string>
+using namespace std;
+
+/* Singly linked FIFO threaded through its elements' *next* member; 
+   pushing and popping never allocate. Does not own its elements. */
+template <class T> class CAP_IntrusiveQueue {
+ protected:
+  T* head; /* popped next; NULL if empty */
+  T* tail; /* pushed last */
+
+ public:
+  inline CAP_IntrusiveQueue() : head(NULL), tail(NULL) {}
+
+  inline bool empty() const { return head == NULL; }
+  inline T* front() const { return head; }
+
+  inline void push(T* item) {
+    item->next = NULL;
+    if( tail ) { tail->next = item; }
+    else { head = item; }
+    tail = item;
+  }
+
+  inline T* pop() {
+    T* item = head;
+    if( item ) {
+      head = item->next;
+      if( !head ) { tail = NULL; }
+      item->next = NULL;
+    }
+    return item;
+  }
+
+  /* remove()
+     Unlinks *item* wherever it is; false if it is not queued */
+  inline bool remove(T* item) {
+    T* prev = NULL;
+    for( T* it=head; it; prev=it, it=it->next ) {
+      if( it != item ) { continue; }
+      if( prev ) { prev->next = it->next; }
+      else { head = it->next; }
+      if( tail == it ) { tail = prev; }
+      it->next = NULL;
+      return true;
+    }
+    return false;
+  }
+};
+
+/* job not yet finished */
+struct CAP_MemJob {
+  JobRec rec;        /* as handed out by a claim */
+  bool queued;       /* in waiting queue; cleared once claimed */
+  CAP_MemJob* next;  /* next waiting job */
+};
+
+/* content item */
+struct CAP_MemContent {
+  int user_id;
+  char status;       /* 'A' active, 'D' deleted */
+  string title;
+};
+
+/* archive not yet created */
+struct CAP_MemArchive {
+  unsigned id;
+  int user_id;
+  vector<unsigned> items;  /* content IDs */
+  CAP_MemArchive* next;    /* next archive waiting */
+};
+
+/* Jobs, content and archives in hash maps by ID, with waiting jobs and 
+   archives in intrusive queues; no I/O at all. Finished jobs and archives 
+   are dropped, so only content grows. Nothing survives a restart. 
+   Operations run one at a time; nothing here would gain from more. */
+class CAP_MemStore : public CAP_Store {
+ protected:
+  typedef tr1::unordered_map<unsigned, CAP_MemJob*> JobMap;
+  typedef tr1::unordered_map<unsigned, CAP_MemContent> ContentMap;
+  typedef tr1::unordered_map<unsigned, CAP_MemArchive*> ArchiveMap;
+  typedef tr1::unordered_set<unsigned long long> KeySet;
+
+  JobMap jobs;                                /* unfinished, by ID */
+  CAP_IntrusiveQueue<CAP_MemJob> waiting;     /* not yet claimed */
+  ContentMap content;                         /* every item, by ID */
+  ArchiveMap archives;                        /* not yet created, by ID */
+  CAP_IntrusiveQueue<CAP_MemArchive> pending; /* oldest first */
+  unsigned nextJob;                           /* ID of next job */
+  unsigned nextContent;                       /* ID of next content item */
+  KeySet keys;                                /* request keys recorded */
+  unsigned long ops[DBOP_JOB_RETIRE+1];       /* operations run, by kind */
+
+  bool requestKey(unsigned long long key);
+  bool jobInsert(int user_id, const CAP_Tokens& body);
+  bool jobClaim(unsigned max, list<JobRec>& claimed);
+  unsigned jobRelease(const list<JobRec>& released);
+  bool contentInsert(const CAP_Tokens& body, int user_id, unsigned& id);
+  bool archiveInsert(int user_id, const CAP_StrRef& body);
+  bool archiveSelect(CAP_DbOp& op);
+  bool statusFlush(const CAP_StatusSet& set);
+  void jobDone(unsigned job_id);
+
+ public:
+  CAP_MemStore(CAP_Log* _errlog);
+  ~CAP_MemStore();
+
+  void open(int size);
+  inline int threads() const { return 1; }
+  void run(CAP_DbOp& op);
+  void logStats() const;
+};
+
+#endif /* _MEMSTORE_H_ */
@@ -0,0 +1,134 @@
+/*******************************************************************************
+  File Name: mysqlstore.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_MysqlStore class
+*******************************************************************************/
+#include "mysqlstore.h"
+using namespace std;
+
+/* CAP_MysqlStore::CAP_MysqlStore()
+   Constructor; not connected until open() */
+CAP_MysqlStore::CAP_MysqlStore(CAP_Log* _errlog, const string& _connect,
+  const string& _user, const string& _passwd)
+  : CAP_Store(_errlog), pool(_errlog, _connect, _user, _passwd)
+{
+}
+
+/* CAP_MysqlStore::open()
+   Opens *size* connections; throws -1 unless every one opens */
+void CAP_MysqlStore::open(int size) {
+  pool.open(size);
+}
+
+/* CAP_MysqlStore::threadInit()
+   Readies calling database thread for the driver */
+void CAP_MysqlStore::threadInit() {
+  pool.threadInit();
+}
+
+/* CAP_MysqlStore::threadEnd()
+   Called by a database thread before it exits */
+void CAP_MysqlStore::threadEnd() {
+  pool.threadEnd();
+}
+
+/* CAP_MysqlStore::logStats()
+   Writes counters of every statement which has run to log */
+void CAP_MysqlStore::logStats() const {
+  pool.logStats();
+}
+
+/* CAP_MysqlStore::run()
+   Runs one operation on a pooled connection; runs it again on a new 
+   connection if the old one was lost and running twice is harmless. A 
+   failure from a lost connection or a lock is marked transient. */
+void CAP_MysqlStore::run(CAP_DbOp& op) {
+  CAP_DbConn& db = pool.acquire();
+  run(op, db);
+
+  if( db.isBroken() ) {
+    bool retry = op.key || (op.kind != DBOP_JOB_INSERT && 
+      op.kind != DBOP_CONTENT_INSERT && op.kind != DBOP_ARCHIVE_INSERT);
+    if( retry && !op.fatal && pool.reconnect(db) ) {
+      op.ok = false;
+      op.rows = 0;
+      op.jobs.clear();
+      run(op, db);
+    }
+    if( db.isBroken() ) {
+      errlog->writef("database operation %d lost with its connection", 
+        LOG_ERROR, (int)op.kind);
+      op.ok = false;
+    }
+  }
+  if( !op.ok ) { op.transient = db.isBroken() || db.isContended(); }
+  pool.release(db);
+
+  if( op.fatal ) { throw op.fatal; }
+}
+
+/* CAP_MysqlStore::run()
+   Runs one operation on *db*; failures are recorded in it */
+void CAP_MysqlStore::run(CAP_DbOp& op, CAP_DbConn& db) {
+  CAP_Tokens toks;
+
+  try {
+    switch( op.kind ) {
+    case DBOP_JOB_INSERT:
+      cap_tokenize(op.body, toks);
+      op.ok = dosql_job_insert(db, op.user_id, toks, op.key);
+      break;
+    case DBOP_JOB_CLAIM:
+      op.ok = dosql_job_claim(db, op.id, op.jobs);
+      break;
+    case DBOP_CONTENT_INSERT:
+      cap_tokenize(op.body, toks);
+      op.ok = dosql_content_insert(db, toks, op.user_id, op.id);
+      break;
+    case DBOP_ARCHIVE_INSERT:
+      op.ok = dosql_archive_insert(db, op.user_id, op.body, op.key);
+      break;
+    case DBOP_ARCHIVE_SELECT:
+      op.ok = dosql_archive_select(db, op);
+      break;
+    case DBOP_STATUS_FLUSH:
+      op.ok = dosql_status_flush(db, op.status);
+      break;
+    case DBOP_JOB_RETIRE:
+      /* id stays the limit until a run succeeds, in case it is retried */
+      {
+        unsigned moved=0;
+        op.ok = dosql_job_retire(db, op.id, moved);
+        if( op.ok ) { op.id = moved; }
+      }
+      break;
+    case DBOP_KEY_PRUNE:
+      op.ok = dosql_key_prune(db, op.key);
+      break;
+    case DBOP_JOB_RELEASE:
+      {
+        unsigned moved=0;
+        op.ok = dosql_job_release(db, op.jobs, moved);
+        if( op.ok ) { op.id = moved; }
+      }
+      break;
+    default:
+      errlog->writef("unknown database operation %d", LOG_ERROR,
+        (int)op.kind);
+      break;
+    }
+  }
+  catch( CAP_Exception& err ) {
+    /* a lost connection is reported by caller once retry is settled */
+    if( err.msg != CAPEXC_DBGONE ) {
+      errlog->writef("database operation %d rejected: %d", LOG_ERROR,
+        (int)op.kind, err.msg);
+    }
+    op.ok = false;
+  }
+  catch( int err ) {
+    op.fatal = err ? err : -1;
+    op.ok = false;
+  }
+}
@@ -0,0 +1,40 @@
+/*******************************************************************************
+  File Name: mysqlstore.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Store kept in a MySQL server, reached through a pool of
+    connections
+*******************************************************************************/
+#ifndef _MYSQLSTORE_H_
+#define _MYSQLSTORE_H_
+
+#include "store.h"
+#include "dbpool.h"
+#include "sql.h"
+#include <string>
+using namespace std;
+
+/* runs every operation through a dosql_* function on a pooled connection. 
+   An operation which only reads or updates is run again once if its 
+   connection was lost part way; inserts are not, as they may have gone 
+   through, unless they carry a request key. Rows a lost select already 
+   handed out are handed out again. */
+class CAP_MysqlStore : public CAP_Store {
+ protected:
+  CAP_DbPool pool; /* connections operations run on */
+
+  void run(CAP_DbOp& op, CAP_DbConn& db);
+
+ public:
+  CAP_MysqlStore(CAP_Log* _errlog, const string& _connect, 
+    const string& _user, const string& _passwd);
+
+  void open(int size);
+  inline int threads() const { return pool.size(); }
+  void threadInit();
+  void threadEnd();
+  void run(CAP_DbOp& op);
+  void logStats() const;
+};
+
+#endif /* _MYSQLSTORE_H_ */
@@ -1,30 +1,35 @@
 //-----------------------------------------------------------------------------
 // File Name: pipe.cpp
 // Author: Grant Gipson
-// Date Last Edited: April 16, 2011
+// Date Last Edited: October 16, 2026
 // Description: Implementation of CAP_Pipe class
 //-----------------------------------------------------------------------------
 #include "pipe.h"
 #include <errno.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
+#include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <iostream>
 using namespace std;
 
 // CAP_Pipe::CAP_Pipe()
 // Class constructor
 CAP_Pipe::CAP_Pipe(string strNewName, CAP_Log* plog, int n_waitRead) 
-  : strName(strNewName), fileD(0), strPathname(""), mode(PIPE_RDONLY)
+  : strName(strNewName), transport(NULL), data(NULL), mode(PIPE_RDONLY),
+    persist(false), outOff(0), want(0), skip(0), version(PIPE_PROTO_TEXT), seqOut(0),
+    wholeReady(false), events(NULL), watchD(-1), retryD(-1), retrying(false),
+    retryMsec(PIPE_RETRY_MSEC)
 {
   if( !plog ) {
     throw CAP_PipeException(EXCPIPE_NOERRLOG);
   }
   errlog = plog;
 
+  /* FIFO until create() is told otherwise */
+  transport = CAP_Transport::make(PIPE_FIFO, strName, errlog);
+
   /* allocate data buffer (pass up exceptions) */
   data=new CAP_PipeBuffer(PIPE_BUFFER_SIZE, errlog, strName);
 }
@@ -33,195 +38,580 @@ CAP_Pipe::CAP_Pipe(string strNewName, CAP_Log* plog, int n_waitRead)
 // Class destructor
 CAP_Pipe::~CAP_Pipe() {
   close();
+  if( retryD != -1 ) { events->remove(retryD); }
+  if( transport ) { delete transport; }
   if( data ) { delete data; }
 }
 
 // CAP_Pipe::open()
 // Opens pipe's file descriptor assuming it has been created already
 void CAP_Pipe::open(void) {
-  if( fileD ) { 
-    /* already open */
+  if( !transport->open() ) {
+    throw CAP_PipeException(EXCPIPE_ISCLOSED);
+  }
+}
+
+// CAP_Pipe::create()
+// Creates FIFO or socket at given pathname; caller may specify pipe as 
+// being either one of two modes
+void CAP_Pipe::create(string& pathname, PipeMode _mode, PipeTransport kind) {
+  if( transport->isOpen() ) {
+    errlog->writef("pipe %s is already open", LOG_WARNING, strName.c_str());
     throw CAP_PipeException(EXCPIPE_ISOPEN);
   }
 
-  // open pipe for use; do not block when opening because 
-  // fifos will block by default until something is written
-  fileD = ::open(strPathname.c_str(), 
-		 mode==PIPE_RDONLY ? O_RDONLY : O_WRONLY|O_NONBLOCK);
-  if( fileD==-1 && errno==ENXIO ) {
-    errlog->writef("%s pipe cannot be written to because it is closed", 
-      LOG_WARNING, strName.c_str());
-    fileD=0;
-    throw CAP_PipeException(EXCPIPE_ISCLOSED);
+  /* swap in transport of requested kind */
+  delete transport;
+  transport = CAP_Transport::make(kind, strName, errlog);
+  transport->create(pathname, _mode);
+  mode = _mode;
+}
+
+// CAP_Pipe::close()
+// Closes pipe's file descriptor
+void CAP_Pipe::close() {
+  /* event loop must stop watching descriptor before it is reused */
+  if( watchD != -1 ) {
+    events->remove(watchD);
+    watchD=-1;
   }
-  else if( fileD==-1 ) {
-    errlog->writef("%s pipe could not be opened. errno: %d", 
-		   LOG_ERROR, strName.c_str(), errno);
-    fileD=0;
-    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  transport->close();
+}
+
+/* CAP_Pipe::listen()
+   Opens read end of pipe and keeps it open so it may be watched by an event 
+   loop */
+void CAP_Pipe::listen() {
+  if( mode!=PIPE_RDONLY ) {
+    throw CAP_PipeException(EXCPIPE_WRONGMODE);
   }
-  else {
-    errlog->writef("%s pipe opened", LOG_INFO, strName.c_str());
+
+  /* transport stays nonblocking; receive() takes only what has arrived 
+     and a partial message waits in buffer for the rest */
+  transport->listen();
+  persist=true;
+}
+
+/* CAP_Pipe::connect()
+   Switches write end of pipe to a long-lived descriptor. If nobody is 
+   reading yet, pipe is opened by the first write or flush() which finds 
+   a reader. */
+void CAP_Pipe::connect() {
+  if( mode!=PIPE_WRONLY ) {
+    throw CAP_PipeException(EXCPIPE_WRONGMODE);
+  }
+
+  persist=true;
+  if( !transport->isOpen() ) {
+    transport->open();
   }
 }
 
-// CAP_Pipe::create()
-// Creates FIFO at given pathname; caller may specify pipe as being 
-// either one of two modes
-void CAP_Pipe::create(string& pathname, PipeMode _mode) {
-  // check current file descriptor
-  if( fileD ) {
-    errlog->writef("pipe %s is already open", LOG_WARNING, strName.c_str());
-    throw CAP_PipeException(EXCPIPE_ISOPEN);
+/* CAP_Pipe::watch()
+   Has event loop finish writing outbox of a connected pipe rather than 
+   leave it for the next write or flush(); see waitWritable() */
+void CAP_Pipe::watch(CAP_EventLoop* _events) {
+  if( mode!=PIPE_WRONLY ) {
+    throw CAP_PipeException(EXCPIPE_WRONGMODE);
   }
 
-  // check parameters
-  if( pathname == "" ) {
-    errlog->writef("no pathname specified when opening pipe %s", LOG_ERROR, 
-		   strName.c_str());
-    throw CAP_PipeException(EXCPIPE_CREATEFAIL);
+  events=_events;
+  retryD=events->addTimer(0, onWritable, this);
+  waitWritable();
+}
+
+/* CAP_Pipe::waitWritable()
+   Once flush() has left messages in outbox, has event loop call it again: 
+   as soon as descriptor has room, or after PIPE_RETRY_MSEC if transport 
+   cannot tell. While nobody is reading the wait doubles each time, up to 
+   PIPE_RETRY_MAX_MSEC. Nothing is watched once outbox is empty. */
+void CAP_Pipe::waitWritable() {
+  if( !events ) { return; }
+  bool open = transport->isOpen();
+  bool poll = !outbox.empty() && open && transport->pollsWritable();
+
+  if( poll && watchD == -1 ) {
+    watchD = getFd();
+    events->addFd(watchD, onWritable, this, EPOLLOUT);
   }
-  if( !(_mode==PIPE_RDONLY || _mode==PIPE_WRONLY) ) {
-    errlog->writef("invalid mode specified when opening pipe %s", LOG_ERROR, 
-		   strName.c_str());
-    throw CAP_PipeException(EXCPIPE_CREATEFAIL);
+  else if( !poll && watchD != -1 ) {
+    events->remove(watchD);
+    watchD = -1;
   }
 
-  // create fifo--unless it already exists
-  fileD = mkfifo(pathname.c_str(), CAP_FILE_MASK);
-  if( fileD == -1 && errno == EEXIST) {
-    /* we're good! */
+  if( outbox.empty() || poll ) {
+    if( retrying ) {
+      events->armTimer(retryD, 0);
+      retrying = false;
+    }
+    retryMsec = PIPE_RETRY_MSEC;
+    return;
   }
-  else if( fileD == -1 ) {
-    errlog->writef("%s pipe could not be created. errno: %d", 
-		   LOG_ERROR, strName.c_str(), errno);
-    throw CAP_PipeException(EXCPIPE_CREATEFAIL);
+
+  if( open ) { retryMsec = PIPE_RETRY_MSEC; }
+  if( !retrying ) {
+    events->armTimer(retryD, retryMsec);
+    retrying = true;
+    if( !open ) {
+      retryMsec = retryMsec*2 < PIPE_RETRY_MAX_MSEC ? retryMsec*2 : 
+        PIPE_RETRY_MAX_MSEC;
+    }
   }
+}
 
-  fileD = 0; /* restore value */
-  strPathname = pathname;
-  mode = _mode;
+/* CAP_Pipe::onWritable()
+   Descriptor or retry timer handler; writes what it can of outbox */
+void CAP_Pipe::onWritable(int fd, unsigned events, void* ctx) {
+  CAP_Pipe* p = (CAP_Pipe*)ctx;
+  if( fd == p->retryD ) { p->retrying = false; }
+
+  try {
+    p->flush();
+  }
+  catch( CAP_PipeException& err ) {
+    /* already logged; outbox was dropped */
+  }
 }
 
-// CAP_Pipe::close()
-// Closes pipe's file descriptor
-void CAP_Pipe::close() {
-  if( !fileD ) { return; } // already closed
+/* CAP_Pipe::flush()
+   Writes messages left in outbox by earlier writes. Each is written on its 
+   own so a socket receives it as one datagram. Returns true once outbox is 
+   empty; if watched, event loop tries again later until it is. */
+bool CAP_Pipe::flush() {
+  /* one retry after reader closed its end (EPIPE) */
+  int attempt=0;
+  while( !outbox.empty() && attempt<2 ) {
+    if( !transport->isOpen() && !transport->open() ) {
+      break; /* no reader */
+    }
+
+    const string& front = outbox.front();
+    int n = transport->write(front.data()+outOff, front.length()-outOff);
+    if( n >= 0 ) {
+      /* FIFO may have taken only part of it */
+      outOff += n;
+      if( outOff >= (int)front.length() ) {
+	outbox.pop_front();
+	outOff = 0;
+      }
+      continue;
+    }
+    else if( errno == EAGAIN ) {
+      break; /* pipe is full; try again later */
+    }
+    else if( errno == EPIPE ) {
+      /* reader went away; reopen in case it has come back. Whatever part 
+	 of a message reached old reader is lost with it. */
+      close();
+      outOff = 0;
+      attempt++;
+      continue;
+    }
+
+    errlog->writef("pipe %s could not write message: %d", LOG_ERROR, 
+      strName.c_str(), errno);
+    outbox.clear();
+    outOff = 0;
+    waitWritable();
+    throw CAP_PipeException(EXCPIPE_WRITEFAIL);
+  }
 
-  // close file descriptor
-  if( ::close(fileD) == -1 ) {
-    errlog->writef("Pipe %s could not be closed errno: %d", LOG_ERROR, 
-		   strName.c_str(), errno);
+  waitWritable();
+  return outbox.empty();
+}
+
+/* CAP_Pipe::fill()
+   Reads more data from pipe into buffer */
+void CAP_Pipe::fill() {
+  if( persist ) {
+    /* listening; pipe stays open */
+    if( !receive() ) {
+      /* nothing has arrived yet */
+      throw CAP_PipeException(EXCPIPE_READFAIL);
+    }
   }
   else {
-    errlog->writef("pipe %s closed", LOG_INFO, strName.c_str());
-    fileD=0;
+    open();
+    data->read(transport, want);
+    close();
   }
 }
 
+/* CAP_Pipe::receive()
+   Reads whatever has arrived on a listening pipe without waiting; returns 
+   number of characters read */
+int CAP_Pipe::receive() {
+  int n = data->read(transport, want);
+  if( n == 0 ) {
+    /* transport has taken back write end so descriptor watched by event 
+       loop remains valid */
+    errlog->writef("pipe %s reached end-of-file", LOG_WARNING, 
+      strName.c_str());
+    throw CAP_PipeException(EXCPIPE_READFAIL);
+  }
+  if( n < 0 ) { return 0; }
+
+  /* rest of a large socket message was passed along with it and will not 
+     wake event loop again */
+  int total = n;
+  while( transport->pending() && (n=data->read(transport, want)) > 0 ) {
+    total += n;
+  }
+  return total;
+}
+
+/* CAP_Pipe::setBufferLimit()
+   Sets the size pipe's data buffer may grow to */
+void CAP_Pipe::setBufferLimit(int limit) {
+  data->setLimit(limit);
+}
+
 /* CAP_Pipe::read()
    Reads in *length chracters from buffer. If *use_delim is true, then 
-   function will stop once *delim is reached or *length has been read. */
+   function will stop once *delim is reached or *length has been read; 
+   delimiter is consumed but not stored. Otherwise exactly *length 
+   characters are read and a single trailing newline is dropped. */
 void CAP_Pipe::read(string& dest, int length, bool use_delim, char delim) {
-  char ch='\0'; /* character read from buffer */
-  int numread=0; /* number of characters read */
-  bool failed=false; /* throw exception after cleanup */
+  dest.clear();
 
   /* not sure why you would want to do this... */
-  if( length <= 0 ) { dest=""; return; }
-
-  /* allocate buffer for read operation */
-  char* dest_tmp=NULL;
-  if( !(dest_tmp=(char*)malloc(length+1)) ) { /* one extra for null-t. */
-      errlog->writef("Pipe %s failed allocate buffer for read", 
-		     LOG_ERROR, strName.c_str());
-      throw CAP_PipeException(EXCPIPE_READFAIL);
-  }
-  memset(dest_tmp, 0, length+1); /* initialize to zero */
-  char* dest_pos = dest_tmp; /* position for copying */
+  if( length <= 0 ) { return; }
 
   try {
-
-  /* read characters from buffer until length or delim are reached */
-  do {
-    /* if this is not first loop, then store last character read */
-    if( numread > 0 ) {
-      *dest_pos = ch;
-      dest_pos++; /* advance to next space in buffer */
-    }
-
-    /* read next character from buffer */
-    try { ch = data->next(); numread++; }
-    catch( CAP_PipeException err ) {
-      /* read data into buffer and try again (pass exceptions up) */
-      if( err.msg == EXCPIPE_BUFFEREMPTY ) {
-	open();
-	data->read(fileD);
-	close();
+    /* take whole runs out of buffer; refill only when it runs dry */
+    while( true ) {
+      if( use_delim ) {
+        if( data->getLine(dest, length, delim) ) { break; }
       }
-      else { throw err; }
+      else {
+        data->get(dest, length-dest.length());
+        if( (int)dest.length() >= length ) { break; }
+      }
+      fill();
     }
-  } while(numread < length &&
-	  ch != (use_delim ? delim : !ch));
-
-  /* any errors while reading into data buffer */
-  } catch( CAP_PipeException err ) {
-	  failed=true;
   }
-
-  /* copy into destination string and free allocated buffer */
-  if( !failed ) {
-    dest.assign(dest_tmp);
+  catch( CAP_PipeException& err ) {
+    throw CAP_PipeException(EXCPIPE_READFAIL);
   }
-  free(dest_tmp);
 
-  /* throw exception if an error occurred */
-  if( failed ) { throw CAP_PipeException(EXCPIPE_READFAIL); }
+  /* senders terminate bodies with a newline which is counted in length */
+  if( !use_delim && dest[dest.length()-1] == '\n' ) {
+    dest.erase(dest.length()-1);
+  }
 }
 
 /* CAP_Pipe::write()
    Writes given string into pipe */
 void CAP_Pipe::write(string& src) {
+  if( persist ) {
+    /* queue behind anything not yet written and send what we can */
+    outbox.push_back(src);
+    flush();
+    return;
+  }
+
   open();
-  if( ::write(fileD, src.c_str(), src.length()) == -1 ) {
+  if( transport->write(src.data(), src.length()) == -1 ) {
     errlog->writef("pipe %s could not write message: %d", LOG_ERROR, 
       strName.c_str(), errno);
     throw CAP_PipeException(EXCPIPE_WRITEFAIL);
   }
-  errlog->writef("wrote %d characters to pipe %s", LOG_INFO,
-    src.length(), strName.c_str());
   close();
 }
 
 /* CAP_Pipe::getMessage()
    Reads in a message header and body */
 bool CAP_Pipe::getMessage(CAP_PipeMessage& msg) {
-  string strCommand=""; /* first line */
-  string strLength="";  /* second line */
-  string strBody="";
+  CAP_PipeMessageRef ref;
+  if( !getMessage(ref) ) {
+    return false;
+  }
+
+  /* copy out of buffer; space is released along with ref */
+  msg.command = ref.command.str();
+  msg.body = ref.body.str();
+  return true;
+}
+
+/* CAP_Pipe::scanMessage()
+   Checks whether a whole message sits in buffer without consuming it. 
+   Returns 1 and message's layout if so, 0 if more must be read, or -1 if 
+   buffer does not start at a message boundary. */
+int CAP_Pipe::scanMessage(CAP_PipeLayout& lay) {
+  want = 0;
+
+  /* rest of a message too large for buffer is dropped as it arrives */
+  if( skip ) {
+    unsigned long n = (unsigned long)data->pending();
+    if( n > skip ) { n = skip; }
+    data->consume(n);
+    skip -= n;
+    if( skip ) { return 0; }
+  }
+
+  /* text senders may follow a body with a newline not counted in its 
+     length; it is not part of the next message */
+  while( data->pending() && *data->at(0) == '\n' ) {
+    data->consume(1);
+  }
+
+  /* binary frame; every field sits at a fixed offset */
+  if( data->pending() && (uint8_t)*data->at(0) == FRAME_MAGIC0 ) {
+    if( data->pending() < FRAME_HEADER_SIZE ) {
+      want = FRAME_HEADER_SIZE;
+      return 0;
+    }
+
+    CAP_FrameHeader h;
+    if( !frame_decode(data->at(0), h) ) {
+      errlog->writef("pipe %s received invalid frame header", LOG_ERROR, 
+        strName.c_str());
+      data->consume(1);
+      return -1;
+    }
+
+    lay.framed = true;
+    lay.type = h.type;
+    lay.flags = h.flags;
+    lay.cmdoff = FRAME_HEADER_SIZE;
+    lay.cmdlen = h.namelen;
+    lay.start = FRAME_HEADER_SIZE+h.namelen;
+    lay.length = h.length;
+    lay.seq = h.seq;
+    lay.source = h.source;
+    if( tooLarge(lay) ) { return -1; }
+    want = lay.start+lay.length; /* buffer makes room for all of it */
+    return data->pending() >= (long)want ? 1 : 0;
+  }
+
+  /* text; command line then length line */
+  int lenlen=0; /* length of second line */
+  bool cmdfound = data->findLine(0, PIPE_LINE_MAX, '\n', lay.cmdlen);
+  bool lenfound = cmdfound && 
+    data->findLine(lay.cmdlen+1, PIPE_LINE_MAX, '\n', lenlen);
+
+  if( lenfound ) {
+    /* convert length to an integer; counting stops once it no longer 
+       fits in one */
+    const char* digits = data->at(lay.cmdlen+1);
+    lay.length = 0;
+    for( int i=0; i<lenlen && digits[i]>='0' && digits[i]<='9' &&
+	   lay.length <= INT_MAX; i++ ) {
+      lay.length = lay.length*10 + (digits[i]-'0');
+    }
+
+    lay.framed = false;
+    lay.flags = 0;
+    lay.cmdoff = 0;
+    lay.start = lay.cmdlen+1+lenlen+1;
+    if( lay.length > INT_MAX ) {
+      /* not a length any sender writes, so what follows cannot be skipped 
+	 by it; drop only the header and look for next message there */
+      errlog->writef("pipe %s received invalid message length %.*s", 
+	LOG_ERROR, strName.c_str(), lenlen, digits);
+      data->consume(lay.start);
+      return -1;
+    }
+    if( tooLarge(lay) ) { return -1; }
+    want = lay.start+lay.length; /* buffer makes room for all of it */
+    return data->pending() >= (long)want ? 1 : 0;
+  }
+  else if( (!cmdfound && data->pending() >= PIPE_LINE_MAX) || 
+           (cmdfound && data->pending()-(lay.cmdlen+1) >= PIPE_LINE_MAX) ) {
+    /* a header line this long means we are not at a message boundary; 
+       drop it rather than wait forever */
+    errlog->writef("pipe %s received header line longer than %d "
+      "characters", LOG_ERROR, strName.c_str(), PIPE_LINE_MAX);
+    data->consume(cmdfound ? lay.cmdlen+1 : PIPE_LINE_MAX);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* CAP_Pipe::tooLarge()
+   Checks whether message at front of buffer could never fit in it; such a 
+   message is dropped, along with the rest of it still to arrive, so 
+   reading resumes at the next one */
+bool CAP_Pipe::tooLarge(const CAP_PipeLayout& lay) {
+  unsigned long total = lay.start+lay.length;
+  if( total <= (unsigned long)data->getLimit() ) {
+    return false;
+  }
+
+  errlog->writef("pipe %s dropped message of %lu characters; buffer limit "
+    "is %d", LOG_ERROR, strName.c_str(), total, data->getLimit());
+  unsigned long n = (unsigned long)data->pending();
+  if( n > total ) { n = total; }
+  data->consume(n);
+  skip = total-n;
+  return true;
+}
+
+/* CAP_Pipe::checkSeq()
+   Notes any frames lost by sender */
+void CAP_Pipe::checkSeq(const CAP_PipeLayout& lay) {
+  map<uint32_t, uint32_t>::iterator it = seqIn.find(lay.source);
+  if( it != seqIn.end() && lay.seq != it->second+1 ) {
+    errlog->writef("pipe %s expected frame %u from %u but received %u", 
+      LOG_WARNING, strName.c_str(), it->second+1, lay.source, lay.seq);
+  }
+  seqIn[lay.source] = lay.seq;
+}
+
+/* CAP_Pipe::isPiece()
+   Checks whether frame is part of a message sent in several frames */
+bool CAP_Pipe::isPiece(const CAP_PipeLayout& lay) const {
+  return lay.framed && (lay.flags & (FRAME_FLAG_MORE|FRAME_FLAG_CONT));
+}
+
+/* CAP_Pipe::absorb()
+   Moves a piece of a split message out of buffer and onto the rest sent 
+   by the same sender. Returns true once last piece has arrived, leaving 
+   message in whole. */
+bool CAP_Pipe::absorb(const CAP_PipeLayout& lay) {
+  checkSeq(lay);
+
+  map<uint32_t, CAP_PipePartial>::iterator it = partials.find(lay.source);
+  if( !(lay.flags & FRAME_FLAG_CONT) ) {
+    /* first piece carries command name; anything gathered before it was 
+       left by a sender which stopped part way */
+    if( it != partials.end() ) {
+      errlog->writef("pipe %s dropped unfinished message from %u", 
+        LOG_WARNING, strName.c_str(), lay.source);
+      partials.erase(it);
+    }
+    it = partials.insert(make_pair(lay.source, CAP_PipePartial())).first;
+    it->second.type = lay.type;
+    it->second.cmdlen = lay.cmdlen;
+  }
+  else if( it == partials.end() ) {
+    /* first pieces went to a reader before us */
+    errlog->writef("pipe %s dropped piece of a message from %u whose start "
+      "was not received", LOG_WARNING, strName.c_str(), lay.source);
+    data->consume(lay.start+lay.length);
+    want = 0;
+    return false;
+  }
+  CAP_PipePartial& part = it->second;
+  part.data.append(data->at(lay.cmdoff), lay.start-lay.cmdoff+lay.length);
+  data->consume(lay.start+lay.length);
+  want = 0;
+
+  /* a sender which died part way through must not hold memory forever */
+  if( (int)part.data.length() > data->getLimit() ) {
+    errlog->writef("pipe %s dropped split message from %u longer than %d "
+      "characters", LOG_ERROR, strName.c_str(), lay.source, 
+      data->getLimit());
+    partials.erase(it);
+    return false;
+  }
+
+  if( lay.flags & FRAME_FLAG_MORE ) {
+    return false;
+  }
+  whole.type = part.type;
+  whole.cmdlen = part.cmdlen;
+  whole.data.swap(part.data);
+  partials.erase(it);
+  wholeReady = true;
+  return true;
+}
+
+/* CAP_Pipe::hasMessage()
+   Checks whether a whole message may be taken from buffer without reading 
+   from pipe. Pieces of split messages are gathered along the way. */
+bool CAP_Pipe::hasMessage() {
+  CAP_PipeLayout lay;
+  int ret;
+
+  while( !wholeReady ) {
+    /* skip over anything which cannot be parsed */
+    if( (ret=scanMessage(lay)) == -1 ) { continue; }
+    if( ret == 0 ) { return false; }
+    if( !isPiece(lay) ) { return true; }
+    absorb(lay);
+  }
+  return true;
+}
+
+/* CAP_Pipe::getMessage()
+   Reads in a message header and body without copying them; message refers 
+   to pipe's data buffer until it is released or reused. A message which 
+   was split over several frames refers to pipe's copy of it instead, which 
+   is kept until the next split message is complete. */
+bool CAP_Pipe::getMessage(CAP_PipeMessageRef& msg) {
+  CAP_PipeLayout lay; /* where message sits in buffer */
 
   /* make sure pipe was created in correct mode */
   if( mode!=PIPE_RDONLY ) {
     throw CAP_PipeException(EXCPIPE_WRONGMODE);
   }
 
+  /* previous message's space may now be reused */
+  msg.release();
+
   try {
-    read(strCommand, PIPE_LINE_MAX, true);
-    read(strLength, PIPE_LINE_MAX, true);
+    /* wait until whole message sits in buffer, gathering split ones */
+    while( !wholeReady ) {
+      int ret;
+      while( (ret=scanMessage(lay)) != 1 ) {
+	if( ret == -1 ) { return false; }
+	fill();
+      }
+      if( !isPiece(lay) ) { break; }
+      absorb(lay);
+    }
+  }
+  catch( CAP_PipeException& err ) {
+    return false;
+  }
+
+  if( wholeReady ) {
+    CAP_StrRef command(whole.data.data(), whole.cmdlen);
+    CAP_StrRef body(whole.data.data()+whole.cmdlen, 
+      whole.data.length()-whole.cmdlen);
+    int type = whole.type;
+    if( type != MSGT_NAMED ) {
+      command = CAP_StrRef(cap_msgname(type));
+    }
+    else {
+      type = cap_msgtype(command);
+    }
+    wholeReady = false;
+    msg.attach(NULL, type, command, body);
 
-    /* convert length to an integer and read body */
-    unsigned long length = atol(strLength.c_str());
-    read(strBody, length);
+    errlog->writef("received message %.*s in pieces", LOG_INFO, 
+      command.len, command.ptr);
+    return true;
+  }
 
-    /* copy into message structure */
-    msg.command = strCommand;
-    msg.body = strBody;
+  CAP_StrRef command(data->at(lay.cmdoff), lay.cmdlen);
+  CAP_StrRef body(data->at(lay.start), lay.length);
+  if( lay.framed ) {
+    /* typed frames carry no name; named ones are looked up like text */
+    if( lay.type != MSGT_NAMED ) {
+      command = CAP_StrRef(cap_msgname(lay.type));
+    }
+    else {
+      lay.type = cap_msgtype(command);
+    }
+    checkSeq(lay);
   }
-  catch( CAP_PipeException err ) {
-    return false;
+  else {
+    /* senders terminate bodies with a newline which is counted in length */
+    if( body.len && body.ptr[body.len-1] == '\n' ) {
+      body.len--;
+    }
+    lay.type = cap_msgtype(command);
   }
 
-  errlog->writef("received message %s", LOG_INFO, msg.command.c_str());
+  data->consume(lay.start+lay.length);
+  msg.attach(data, lay.type, command, body);
+  want = 0;
+
+  errlog->writef("received message %.*s", LOG_INFO, command.len, 
+    command.ptr);
   return true;
 }
 
@@ -233,19 +623,45 @@ bool CAP_Pipe::sendMessage(CAP_PipeMessage& msg) {
     throw CAP_PipeException(EXCPIPE_WRONGMODE);
   }
 
-  /* convert body length to a string */
-  char* psz = new char[32];
-  memset(psz, '\0', 32);
-  sprintf(psz, "%d", msg.body.length());
+  /* combine header and body into a message */
+  string message;
+  if( version >= PIPE_PROTO_FRAME ) {
+    CAP_FrameHeader h;
+    h.version = PIPE_PROTO_FRAME;
+    h.type = cap_msgtype(msg.command);
+    h.flags = 0;
+    h.namelen = h.type==MSGT_NAMED ? msg.command.length() : 0;
+    h.length = msg.body.length();
+    h.source = getpid();
+
+    /* a frame too large to be written atomically could be interleaved 
+       with other writers' data; send it in pieces which each are */
+    int atomic = transport->atomicMax();
+    if( atomic && FRAME_HEADER_SIZE+h.namelen+h.length > (unsigned)atomic ) {
+      return sendPieces(msg, h, atomic);
+    }
 
-  /* combine strings into a message */
-  string message(msg.command);
-  message += "\n";
-  message += psz;
-  message += "\n";
-  message += msg.body;
-  message += "\n";
-  delete psz; /* free buffer */
+    h.seq = ++seqOut;
+    char hdr[FRAME_HEADER_SIZE];
+    frame_encode(hdr, h);
+    message.reserve(FRAME_HEADER_SIZE+h.namelen+h.length);
+    message.append(hdr, FRAME_HEADER_SIZE);
+    message.append(msg.command, 0, h.namelen);
+    message += msg.body;
+  }
+  else {
+    /* convert body length to a string */
+    char sz[32];
+    int szlen = snprintf(sz, 32, "%lu", (unsigned long)msg.body.length());
+
+    message.reserve(msg.command.length()+szlen+msg.body.length()+3);
+    message += msg.command;
+    message += '\n';
+    message.append(sz, szlen);
+    message += '\n';
+    message += msg.body;
+    message += '\n';
+  }
 
   /* write message to pipe */
   try { 
@@ -257,6 +673,69 @@ bool CAP_Pipe::sendMessage(CAP_PipeMessage& msg) {
     return false;
   }
 
-  errlog->writef("sent message %s", LOG_INFO, msg.command.c_str());
+  if( hasOutbox() ) {
+    errlog->writef("message %s queued until pipe %s can take it", LOG_INFO, 
+      msg.command.c_str(), strName.c_str());
+  }
+  else {
+    errlog->writef("sent message %s", LOG_INFO, msg.command.c_str());
+  }
+  return true;
+}
+
+/* CAP_Pipe::sendPieces()
+   Writes a framed message as several frames of at most *atomic* 
+   characters; every frame but the last is flagged FRAME_FLAG_MORE and 
+   every frame but the first FRAME_FLAG_CONT. Only the first carries the 
+   command name. */
+bool CAP_Pipe::sendPieces(CAP_PipeMessage& msg, CAP_FrameHeader h, 
+  int atomic)
+{
+  string piece;
+  unsigned long sent=0;
+  bool first=true;
+
+  /* first piece must fit its header and command name with room to spare
+     or the body never moves forward; later pieces have more room */
+  if( atomic-FRAME_HEADER_SIZE-(int)h.namelen <= 0 ) {
+    errlog->writef("message %s is too large to send to pipe %s; its "
+      "command name leaves no room in %d characters", LOG_ERROR,
+      msg.command.c_str(), strName.c_str(), atomic);
+    return false;
+  }
+  piece.reserve(atomic);
+
+  try {
+    while( first || sent < msg.body.length() ) {
+      int room = atomic-FRAME_HEADER_SIZE-(first ? (int)h.namelen : 0);
+      unsigned long left = msg.body.length()-sent;
+      unsigned long take = left < (unsigned long)room ? left : room;
+
+      CAP_FrameHeader ph = h;
+      ph.namelen = first ? h.namelen : 0;
+      ph.length = take;
+      ph.flags = (sent+take < msg.body.length() ? FRAME_FLAG_MORE : 0) | 
+	(first ? 0 : FRAME_FLAG_CONT);
+      ph.seq = ++seqOut;
+
+      char hdr[FRAME_HEADER_SIZE];
+      frame_encode(hdr, ph);
+      piece.assign(hdr, FRAME_HEADER_SIZE);
+      piece.append(msg.command, 0, ph.namelen);
+      piece.append(msg.body, sent, take);
+      write(piece);
+
+      sent += take;
+      first = false;
+    }
+  }
+  catch( CAP_PipeException err ) {
+    errlog->writef("message sent to pipe %s has been lost", 
+      LOG_WARNING, strName.c_str());
+    return false;
+  }
+
+  errlog->writef("sent message %s in pieces", LOG_INFO, 
+    msg.command.c_str());
   return true;
 }
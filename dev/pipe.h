@@ -1,23 +1,24 @@
 //-----------------------------------------------------------------------------
 // File Name: pipe.h
 // Author: Grant Gipson
-// Date Last Edited: April 16, 2011
-// Description: Pipe class for handling FIFOs in Senior CAP Project
+// Date Last Edited: October 16, 2026
+// Description: Pipe class for handling FIFOs and sockets in Senior CAP 
+//   Project
 //-----------------------------------------------------------------------------
 #ifndef _PIPE_H_
 #define _PIPE_H_
 
 #include "master.h"
 #include "log.h"
+#include "strref.h"
+#include "frame.h"
+#include "transport.h"
+#include "event.h"
 #include <string>
+#include <map>
+#include <deque>
 using namespace std;
 
-// modes in which a pipe may be open--mutually exclusive
-enum PipeMode {
-  PIPE_WRONLY=0,
-  PIPE_RDONLY=1
-};
-
 /* CAP_Pipe exception constants and exception class */
 #define EXCPIPE_NOERRLOG       1
 #define EXCPIPE_ISOPEN         2
@@ -48,39 +49,137 @@ class CAP_PipeBuffer {
   char* curr;      /* read position in data buffer */
   int size;        /* size of data buffer */
   int used;        /* amount of buffer used */
+  int limit;       /* size buffer may grow to */
+  int refs;        /* messages still referring to buffer space */
   CAP_Log* errlog; /* log events are written to */
   string pipename; /* name of pipe passed to errlog */
 
+  void makeRoom(int want);
+
  public:
 	CAP_PipeBuffer(int _size, CAP_Log* _errlog, string _pipename);
 	~CAP_PipeBuffer();
 
-	char next();
-	void read(int fileD);
+	bool getLine(string& dest, int max, char delim='\n');
+	int get(string& dest, int length);
+	int read(CAP_Transport* transport, int need=0);
+	void setLimit(int _limit);
+	inline int getLimit() const { return limit; }
+	bool findLine(int offset, int max, char delim, int& len) const;
+	inline int pending() const { return used-(curr-data); }
+	inline const char* at(int offset) const { return curr+offset; }
+	inline void consume(int n) { curr+=n; }
+	inline void hold() { refs++; }
+	inline void release() { refs--; }
+};
+
+/* message whose command and body refer directly to space in a pipe's data 
+   buffer; space cannot be reused until every copy has been released */
+class CAP_PipeMessageRef {
+ protected:
+  CAP_PipeBuffer* owner; /* buffer holding characters */
+
+ public:
+  int type;              /* CAP_MsgType */
+  CAP_StrRef command;
+  CAP_StrRef body;
+
+  inline CAP_PipeMessageRef() : owner(NULL), type(MSGT_NAMED) {}
+  CAP_PipeMessageRef(const CAP_PipeMessageRef& ref);
+  inline ~CAP_PipeMessageRef() { release(); }
+  CAP_PipeMessageRef& operator=(const CAP_PipeMessageRef& ref);
+
+  void attach(CAP_PipeBuffer* buf, int _type, CAP_StrRef _command, 
+    CAP_StrRef _body);
+  void release();
+};
+
+/* where the parts of a whole message sit in a pipe's buffer */
+struct CAP_PipeLayout {
+  bool framed;          /* binary frame rather than text */
+  int type;             /* CAP_MsgType */
+  int flags;            /* frame's FRAME_FLAG_* */
+  int cmdoff;           /* offset of command name */
+  int cmdlen;           /* length of command name */
+  int start;            /* offset of body */
+  unsigned long length; /* length of body */
+  uint32_t seq;         /* frame's sequence number */
+  uint32_t source;      /* frame's sender */
+};
+
+/* message sent in several frames, gathered as they arrive */
+struct CAP_PipePartial {
+  int type;             /* CAP_MsgType */
+  int cmdlen;           /* length of command name at front of data */
+  string data;          /* command name then body */
 };
 
 class CAP_Pipe {
  protected:
   CAP_Log* errlog;      // log events are written to
-  int fileD;            // pipe file descriptor
   const string strName; // name of pipe (set by caller)
-  string strPathname;   // path name of FIFO
+  CAP_Transport* transport; /* FIFO or socket carrying pipe's data */
   CAP_PipeBuffer* data; /* data buffer */
   PipeMode mode;        /* mode in which pipe is to be opened */
+  bool persist;         /* descriptor stays open between reads/writes */
+  deque<string> outbox; /* messages written while pipe had no reader */
+  int outOff;           /* characters of first message already written */
+  int want;             /* size of incomplete message at front of buffer */
+  unsigned long skip;   /* characters of a dropped message yet to arrive */
+  int version;          /* protocol used when sending (PIPE_PROTO_*) */
+  uint32_t seqOut;      /* sequence number of last frame sent */
+  map<uint32_t, uint32_t> seqIn; /* last frame received from each sender */
+  map<uint32_t, CAP_PipePartial> partials; /* split messages, by sender */
+  CAP_PipePartial whole; /* last split message gathered */
+  bool wholeReady;      /* whole is waiting to be taken by getMessage() */
+  CAP_EventLoop* events; /* finishes outbox; NULL unless watch() */
+  int watchD;           /* descriptor watched for room; -1 if none */
+  int retryD;           /* timer retrying outbox; -1 unless watch() */
+  bool retrying;        /* above is armed */
+  unsigned retryMsec;   /* wait before next retry of a closed pipe */
+
+  void fill();
+  int scanMessage(CAP_PipeLayout& lay);
+  bool tooLarge(const CAP_PipeLayout& lay);
+  void checkSeq(const CAP_PipeLayout& lay);
+  bool isPiece(const CAP_PipeLayout& lay) const;
+  bool absorb(const CAP_PipeLayout& lay);
+  bool sendPieces(CAP_PipeMessage& msg, CAP_FrameHeader h, int atomic);
+  void waitWritable();
+  static void onWritable(int fd, unsigned events, void* ctx);
 
  public:
   CAP_Pipe(string strNewName, CAP_Log* plog, int n_waitRead=0);
   ~CAP_Pipe();
 
-  void create(string& pathname, PipeMode _mode);
+  void create(string& pathname, PipeMode _mode, 
+    PipeTransport kind=PIPE_FIFO);
   void open();
   void close();
+  void listen();
+  void connect();
+  void watch(CAP_EventLoop* _events);
+  bool flush();
+  int receive();
+  bool hasMessage();
+  void setBufferLimit(int limit);
   void read(string& dest, int length, bool use_delim=false, char delim='\n');
   void write(string& src);
   bool getMessage(CAP_PipeMessage& msg);
+  bool getMessage(CAP_PipeMessageRef& msg);
   bool sendMessage(CAP_PipeMessage& msg);
   inline const string& getName() const
     { return strName; }
+  inline int getFd() const
+    { return transport->getFd(); }
+  inline bool hasData() const
+    { return data->pending() > 0; }
+  inline bool hasOutbox() const
+    { return !outbox.empty(); }
+  inline int getVersion() const
+    { return version; }
+  inline void setVersion(int _version)
+    { version=_version; }
 };
 
 #endif /* PIPE_H_ */
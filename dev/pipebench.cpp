@@ -0,0 +1,543 @@
+/*******************************************************************************
+  File Name: pipebench.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Measures how many messages per second each pipe transport
+    carries from a writer process to a reader running an event loop,
+    checks that messages from many writers sharing one FIFO arrive intact,
+    whether written by this program or by Perl through cappipe.pl, and how
+    long a message waits for a reader which opens its FIFO only
+    while reading a message, as the Perl components do.
+    Usage: pipebench <fifo|seqpacket|shmring|all> <directory> [count] [size]
+           pipebench fanin <directory> [writers] [count] [size] [cappipe.pl]
+           pipebench reopen <directory> [count] [size]
+*******************************************************************************/
+#include "pipe.h"
+#include "event.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+/* reader's state passed to event handler */
+struct Bench {
+  CAP_Pipe* pipe;  /* pipe being read */
+  long count;      /* messages received */
+  long bytes;      /* body characters received */
+  bool done;       /* MSG_QUIT received */
+};
+
+/* now()
+   Returns monotonic time in seconds */
+static double now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/* onBenchPipe()
+   Takes every whole message which has arrived */
+static void onBenchPipe(int fd, unsigned events, void* ctx) {
+  Bench* b = (Bench*)ctx;
+  CAP_PipeMessageRef msg;
+
+  try { b->pipe->receive(); }
+  catch( CAP_PipeException& err ) { return; }
+
+  while( b->pipe->hasMessage() ) {
+    if( !b->pipe->getMessage(msg) ) { break; }
+    if( msg.type == MSGT_QUIT ) { b->done = true; }
+    else { b->count++; b->bytes += msg.body.len; }
+    msg.release();
+  }
+}
+
+/* writeAll()
+   Writer process; sends *count* messages then MSG_QUIT */
+static void writeAll(CAP_Log* errlog, string& path, PipeTransport kind,
+  long count, int size)
+{
+  CAP_Pipe pipe("bench", errlog);
+  pipe.create(path, PIPE_WRONLY, kind);
+  pipe.setVersion(PIPE_PROTO_FRAME);
+  pipe.connect();
+
+  CAP_PipeMessage msg;
+  msg.command = "MSG_NULL";
+  msg.body = string(size, 'x');
+  for( long i=0; i<=count; i++ ) {
+    if( i == count ) {
+      msg.command = "MSG_QUIT";
+      msg.body = "";
+    }
+    pipe.sendMessage(msg);
+
+    /* reader has fallen behind; wait for room */
+    while( !pipe.flush() ) { sched_yield(); }
+  }
+}
+
+/* runBench()
+   Times one transport; returns messages per second */
+static double runBench(CAP_Log* errlog, const char* dir, const char* name,
+  PipeTransport kind, long count, int size)
+{
+  string path = string(dir) + "/pipebench." + name;
+  Bench b;
+  b.count = 0;
+  b.bytes = 0;
+  b.done = false;
+  b.pipe = new CAP_Pipe("bench", errlog);
+  b.pipe->create(path, PIPE_RDONLY, kind);
+  b.pipe->listen();
+
+  CAP_EventLoop events(errlog);
+  events.addFd(b.pipe->getFd(), onBenchPipe, &b);
+
+  double start = now();
+  pid_t pid = fork();
+  if( pid == 0 ) {
+    try { writeAll(errlog, path, kind, count, size); }
+    catch( CAP_PipeException& err ) { _exit(1); }
+    _exit(0);
+  }
+  while( !b.done ) {
+    events.runOnce(1000);
+  }
+  double secs = now()-start;
+  waitpid(pid, NULL, 0);
+
+  if( b.count != count || b.bytes != count*size ) {
+    printf("%-10s lost messages: received %ld of %ld\n", name, b.count,
+      count);
+  }
+  delete b.pipe;
+  unlink(path.c_str());
+
+  double rate = count/secs;
+  printf("%-10s %9ld msgs %7d bytes %8.3f s %12.0f msgs/s %9.1f MB/s\n",
+    name, count, size, secs, rate, b.bytes/secs/1e6);
+  return rate;
+}
+
+/* fan-in reader's state */
+struct FanIn {
+  CAP_Pipe* pipe;     /* pipe being read */
+  vector<long> next;  /* index of next message expected from each writer */
+  long count;         /* messages received intact */
+  long bad;           /* messages received damaged or out of order */
+  int quits;          /* writers which have finished */
+};
+
+/* fanInBody()
+   Fills body of writer *w*'s message *i*; writer and index lead so reader 
+   can check the rest */
+static void fanInBody(string& body, int w, long i, int size) {
+  char head[20];
+  snprintf(head, sizeof(head), "%08x%08lx", w, i);
+  int len = size*(1+i%3); /* some larger than PIPE_BUF */
+  body.assign(len, ' ');
+  memcpy(&body[0], head, 16);
+  for( int k=16; k<len; k++ ) {
+    body[k] = '0' + (w*31+i*7+k)%64;
+  }
+}
+
+/* Perl writer; same bodies as fanInBody(), each sent as Perl components 
+   send theirs, opening FIFO for one message at a time. Arguments are 
+   library, FIFO, writer, count and size. */
+static const char* fanInPerl =
+  "my ($lib, $path, $w, $count, $size) = @ARGV;\n"
+  "require $lib;\n"
+  "for my $i (0..$count) {\n"
+  "  my ($cmd, $body) = ('MSG_QUIT', '');\n"
+  "  if( $i < $count ) {\n"
+  "    $cmd = 'MSG_ARCHIVEREQ';\n"
+  "    $body = sprintf('%08x%08x', $w, $i) . join('', map { "
+  "chr(48+($w*31+$i*7+$_)%64) } 16..$size*(1+$i%3)-1);\n"
+  "  }\n"
+  "  open(my $p, '>>', $path) or exit 1;\n"
+  "  cap_pipe_send($p, $cmd, $body) or exit 1;\n"
+  "  close($p);\n"
+  "}\n";
+
+/* onFanInPipe()
+   Checks every whole message which has arrived */
+static void onFanInPipe(int fd, unsigned events, void* ctx) {
+  FanIn* f = (FanIn*)ctx;
+  CAP_PipeMessageRef msg;
+  string expect;
+
+  try { f->pipe->receive(); }
+  catch( CAP_PipeException& err ) { return; }
+
+  while( f->pipe->hasMessage() ) {
+    if( !f->pipe->getMessage(msg) ) { f->bad++; break; }
+    if( msg.type == MSGT_QUIT ) {
+      f->quits++;
+      continue;
+    }
+
+    unsigned w=0;
+    long i=0;
+    if( msg.body.len < 16 || 
+        sscanf(string(msg.body.ptr, 16).c_str(), "%8x%8lx", &w, &i) != 2 ||
+        w >= f->next.size() || i != f->next[w] ) {
+      f->bad++;
+      continue;
+    }
+    fanInBody(expect, w, i, msg.body.len/(1+i%3));
+    if( expect.length() != (unsigned)msg.body.len || 
+        memcmp(expect.data(), msg.body.ptr, msg.body.len) ) {
+      f->bad++;
+    }
+    else {
+      f->count++;
+    }
+    f->next[w]++;
+  }
+}
+
+/* runFanIn()
+   Starts *writers* processes which all write *count* messages into one 
+   FIFO at once; they run Perl with library *perl* if it is given. Returns 
+   number of messages lost or damaged. */
+static long runFanIn(CAP_Log* errlog, const char* dir, int writers, 
+  long count, int size, const char* perl)
+{
+  string path = string(dir) + "/pipebench.fanin";
+  FanIn f;
+  f.pipe = new CAP_Pipe("fanin", errlog);
+  f.pipe->create(path, PIPE_RDONLY, PIPE_FIFO);
+  f.pipe->listen();
+  f.next.assign(writers, 0);
+  f.count = 0;
+  f.bad = 0;
+  f.quits = 0;
+
+  CAP_EventLoop events(errlog);
+  events.addFd(f.pipe->getFd(), onFanInPipe, &f);
+
+  double start = now();
+  vector<pid_t> pids;
+  for( int w=0; w<writers; w++ ) {
+    pid_t pid = fork();
+    if( pid == 0 && perl ) {
+      char w_[16], count_[32], size_[16];
+      snprintf(w_, sizeof(w_), "%d", w);
+      snprintf(count_, sizeof(count_), "%ld", count);
+      snprintf(size_, sizeof(size_), "%d", size);
+      execlp("perl", "perl", "-e", fanInPerl, perl, path.c_str(), w_, 
+        count_, size_, (char*)NULL);
+      _exit(1);
+    }
+    else if( pid == 0 ) {
+      try {
+	CAP_Pipe pipe("fanin", errlog);
+	pipe.create(path, PIPE_WRONLY, PIPE_FIFO);
+	pipe.setVersion(PIPE_PROTO_FRAME);
+	pipe.connect();
+
+	CAP_PipeMessage msg;
+	msg.command = "MSG_ARCHIVEREQ";
+	for( long i=0; i<=count; i++ ) {
+	  if( i == count ) {
+	    msg.command = "MSG_QUIT";
+	    msg.body = "";
+	  }
+	  else {
+	    fanInBody(msg.body, w, i, size);
+	  }
+	  pipe.sendMessage(msg);
+	  while( !pipe.flush() ) { sched_yield(); }
+	}
+      }
+      catch( CAP_PipeException& err ) { _exit(1); }
+      _exit(0);
+    }
+    else if( pid > 0 ) {
+      pids.push_back(pid);
+    }
+  }
+  /* a MSG_QUIT lost to damage is never counted; once every writer has 
+     exited, take what is left and stop */
+  int running = pids.size();
+  while( f.quits < (int)pids.size() ) {
+    events.runOnce(1000);
+    while( running && waitpid(-1, NULL, WNOHANG) > 0 ) { running--; }
+    if( !running ) {
+      long seen;
+      do {
+	seen = f.count+f.bad;
+	events.runOnce(100);
+      } while( f.count+f.bad != seen );
+      break;
+    }
+  }
+  double secs = now()-start;
+  for( unsigned p=0; p<pids.size(); p++ ) {
+    waitpid(pids[p], NULL, 0);
+  }
+  delete f.pipe;
+  unlink(path.c_str());
+
+  long expected = (long)pids.size()*count;
+  long lost = expected-f.count;
+  printf("fanin%-5s  %5d writers %9ld msgs %8.3f s %12.0f msgs/s "
+    "%ld damaged %ld lost\n", perl ? "/perl" : "", (int)pids.size(), 
+    f.count, secs, f.count/secs, f.bad, lost);
+  return lost;
+}
+
+/* reopening reader's state, kept by writer */
+struct Reopen {
+  CAP_Pipe* out;      /* messages to reader */
+  CAP_Pipe* in;       /* reader's replies */
+  long count;         /* messages to send */
+  long sent;          /* messages sent */
+  long replies;       /* replies matching what was sent */
+  long bad;           /* replies which did not */
+  int size;           /* body characters */
+  double start;       /* when last message was sent */
+  double worst;       /* longest a message took to be answered */
+  bool done;          /* MSG_QUIT sent */
+};
+
+/* reopenBody()
+   Fills body of message *i* */
+static void reopenBody(string& body, long i, int size) {
+  body.assign(size, ' ');
+  for( int k=0; k<size; k++ ) { body[k] = 'a' + (i+k)%26; }
+}
+
+/* reopenSend()
+   Sends next message, or MSG_QUIT once all have been answered */
+static void reopenSend(Reopen* r) {
+  CAP_PipeMessage msg;
+  if( r->sent == r->count ) {
+    msg.command = "MSG_QUIT";
+    r->done = true;
+  }
+  else {
+    msg.command = "MSG_NULL";
+    reopenBody(msg.body, r->sent, r->size);
+  }
+  r->start = now();
+  r->sent++;
+  r->out->sendMessage(msg);
+}
+
+/* onReopenReply()
+   Checks reader's reply to last message and sends the next */
+static void onReopenReply(int fd, unsigned events, void* ctx) {
+  Reopen* r = (Reopen*)ctx;
+  CAP_PipeMessageRef msg;
+  string expect;
+
+  try { r->in->receive(); }
+  catch( CAP_PipeException& err ) { return; }
+
+  while( r->in->hasMessage() ) {
+    if( !r->in->getMessage(msg) ) { r->bad++; break; }
+    reopenBody(expect, r->sent-1, r->size);
+    if( expect.length() == (unsigned)msg.body.len &&
+        !memcmp(expect.data(), msg.body.ptr, msg.body.len) ) {
+      r->replies++;
+    }
+    else {
+      r->bad++;
+    }
+    if( now()-r->start > r->worst ) { r->worst = now()-r->start; }
+    msg.release();
+    reopenSend(r);
+  }
+}
+
+/* readLine()
+   Reads one line a character at a time, as no more than one message may 
+   be taken from FIFO; false at end-of-file */
+static bool readLine(int fd, string& line) {
+  char c;
+  line.clear();
+  while( ::read(fd, &c, 1) == 1 ) {
+    if( c == '\n' ) { return true; }
+    line += c;
+  }
+  return false;
+}
+
+/* reopenReader()
+   Reader process; for each message opens FIFO, reads it, closes FIFO and 
+   only then opens reply FIFO and echoes body back, as download.pl does */
+static void reopenReader(const string& path, const string& reply) {
+  string command, length, body;
+  while( true ) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if( fd == -1 ) { _exit(1); }
+    if( !readLine(fd, command) || !readLine(fd, length) ) { _exit(1); }
+    /* body is followed by a newline not counted in its length; Perl's 
+       buffered read takes that too */
+    body.resize(atol(length.c_str())+1);
+    for( size_t got=0; got<body.length(); ) {
+      ssize_t n = ::read(fd, &body[got], body.length()-got);
+      if( n <= 0 ) { _exit(1); }
+      got += n;
+    }
+    body.erase(body.length()-1);
+    ::close(fd);
+    if( command == "MSG_QUIT" ) { _exit(0); }
+
+    char head[32];
+    int headlen = snprintf(head, sizeof(head), "MSG_NULL\n%lu\n", 
+      (unsigned long)body.length());
+    string out = string(head, headlen) + body;
+    fd = ::open(reply.c_str(), O_WRONLY);
+    if( fd == -1 || ::write(fd, out.data(), out.length()) != 
+        (ssize_t)out.length() ) {
+      _exit(1);
+    }
+    ::close(fd);
+  }
+}
+
+/* runReopen()
+   Sends *count* messages one at a time to a reader which opens its FIFO 
+   only while reading one; returns number lost or damaged */
+static long runReopen(CAP_Log* errlog, const char* dir, long count, 
+  int size)
+{
+  string path = string(dir) + "/pipebench.reopen";
+  string reply = path + ".reply";
+  Reopen r;
+  r.count = count;
+  r.sent = 0;
+  r.replies = 0;
+  r.bad = 0;
+  r.size = size;
+  r.worst = 0;
+  r.done = false;
+
+  /* writes find reader gone; that must be EPIPE rather than death */
+  signal(SIGPIPE, SIG_IGN);
+
+  CAP_EventLoop events(errlog);
+  r.in = new CAP_Pipe("reply", errlog);
+  r.in->create(reply, PIPE_RDONLY, PIPE_FIFO);
+  r.in->listen();
+  events.addFd(r.in->getFd(), onReopenReply, &r);
+  r.out = new CAP_Pipe("reopen", errlog);
+  r.out->create(path, PIPE_WRONLY, PIPE_FIFO);
+  r.out->connect();
+  r.out->watch(&events);
+
+  pid_t pid = fork();
+  if( pid == 0 ) {
+    reopenReader(path, reply);
+  }
+
+  double start = now();
+  reopenSend(&r);
+  while( !r.done || r.out->hasOutbox() ) {
+    events.runOnce(1000);
+  }
+  double secs = now()-start;
+  int status=0;
+  waitpid(pid, &status, 0);
+  delete r.out;
+  delete r.in;
+  unlink(path.c_str());
+  unlink(reply.c_str());
+
+  long lost = count-r.replies;
+  printf("reopen     %9ld msgs %7d bytes %8.3f s %8.1f ms/msg %8.1f ms "
+    "worst %ld damaged %ld lost\n", r.replies, size, secs, 
+    secs*1000/(count ? count : 1), r.worst*1000, r.bad, lost);
+  return lost || !WIFEXITED(status) || WEXITSTATUS(status) ? 
+    (lost ? lost : 1) : 0;
+}
+
+// main()
+// Program entry point
+int main(int argc, char* argv[]) {
+  if( argc < 3 ) {
+    cerr << "usage: " << argv[0] << " <fifo|seqpacket|shmring|all> "
+	 << "<directory> [count] [size]" << endl
+	 << "       " << argv[0] << " fanin <directory> [writers] [count] "
+	 << "[size] [cappipe.pl]" << endl
+	 << "       " << argv[0] << " reopen <directory> [count] [size]" 
+	 << endl;
+    return 1;
+  }
+
+  CAP_Log* errlog = new CAP_Log();
+  errlog->open(string(argv[2]) + "/pipebench.log");
+  errlog->setLeastLogPriority(LOG_ERROR);
+
+  if( !strcmp(argv[1], "fanin") ) {
+    int writers = argc > 3 ? atoi(argv[3]) : 1000;
+    long count = argc > 4 ? atol(argv[4]) : 20;
+    int size = argc > 5 ? atoi(argv[5]) : 3000;
+    long lost=0;
+    const char* perl = argc > 6 ? argv[6] : NULL;
+    try { lost = runFanIn(errlog, argv[2], writers, count, size, perl); }
+    catch( CAP_PipeException& err ) {
+      cerr << "pipe failed: " << err.msg << endl;
+      return 1;
+    }
+    catch( CAP_EventException& err ) {
+      cerr << "event loop failed: " << err.msg << endl;
+      return 1;
+    }
+    delete errlog;
+    return lost ? 1 : 0;
+  }
+
+  if( !strcmp(argv[1], "reopen") ) {
+    long count = argc > 3 ? atol(argv[3]) : 200;
+    int size = argc > 4 ? atoi(argv[4]) : 100000;
+    long lost=0;
+    try { lost = runReopen(errlog, argv[2], count, size); }
+    catch( CAP_PipeException& err ) {
+      cerr << "pipe failed: " << err.msg << endl;
+      return 1;
+    }
+    catch( CAP_EventException& err ) {
+      cerr << "event loop failed: " << err.msg << endl;
+      return 1;
+    }
+    delete errlog;
+    return lost ? 1 : 0;
+  }
+
+  long count = argc > 3 ? atol(argv[3]) : 200000;
+  int size = argc > 4 ? atoi(argv[4]) : 64;
+
+  const char* names[] = { "fifo", "seqpacket", "shmring" };
+  PipeTransport kinds[] = { PIPE_FIFO, PIPE_SEQPACKET, PIPE_SHMRING };
+  try {
+    for( int i=0; i<3; i++ ) {
+      if( !strcmp(argv[1], "all") || !strcmp(argv[1], names[i]) ) {
+	runBench(errlog, argv[2], names[i], kinds[i], count, size);
+      }
+    }
+  }
+  catch( CAP_PipeException& err ) {
+    cerr << "pipe failed: " << err.msg << endl;
+    return 1;
+  }
+  catch( CAP_EventException& err ) {
+    cerr << "event loop failed: " << err.msg << endl;
+    return 1;
+  }
+
+  delete errlog;
+  return 0;
+}
@@ -0,0 +1,364 @@
+/*******************************************************************************
+  File Name: seqpacket.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_SeqPacketTransport class
+*******************************************************************************/
+#include "pipe.h"
+#include "transport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+using namespace std;
+
+#define SEQPACKET_EVENTS 16 /* max. number of connections checked at once */
+
+/* CAP_SeqPacketTransport::CAP_SeqPacketTransport()
+   Class constructor */
+CAP_SeqPacketTransport::CAP_SeqPacketTransport(const string& _name, 
+  CAP_Log* _errlog)
+  : CAP_Transport(_name, _errlog), sockD(-1), pollD(-1), currD(-1), 
+    contD(-1), contLeft(0)
+{
+}
+
+/* CAP_SeqPacketTransport::~CAP_SeqPacketTransport()
+   Class destructor */
+CAP_SeqPacketTransport::~CAP_SeqPacketTransport() {
+  close();
+}
+
+/* fill_address()
+   Fills in socket address for given pathname; returns false if it is too 
+   long */
+static bool fill_address(const string& pathname, sockaddr_un& addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if( pathname.length() >= sizeof(addr.sun_path) ) { return false; }
+  memcpy(addr.sun_path, pathname.c_str(), pathname.length());
+  return true;
+}
+
+/* CAP_SeqPacketTransport::open()
+   Connects to reader's socket; returns false if nobody is listening */
+bool CAP_SeqPacketTransport::open() {
+  if( sockD != -1 ) {
+    throw CAP_PipeException(EXCPIPE_ISOPEN);
+  }
+
+  sockaddr_un addr;
+  if( !fill_address(strPathname, addr) ) {
+    errlog->writef("%s pipe pathname is too long for a socket", LOG_ERROR, 
+		   strName.c_str());
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+
+  sockD = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+  if( sockD == -1 ) {
+    errlog->writef("%s pipe could not create socket. errno: %d", LOG_ERROR,
+		   strName.c_str(), errno);
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+
+  if( ::connect(sockD, (sockaddr*)&addr, sizeof(addr)) == -1 ) {
+    int err = errno;
+    ::close(sockD);
+    sockD = -1;
+
+    /* no socket yet, nobody accepting, or backlog full */
+    if( err==ENOENT || err==ECONNREFUSED || err==EAGAIN ) {
+      errlog->writef("%s pipe cannot be written to because it is closed", 
+        LOG_WARNING, strName.c_str());
+      return false;
+    }
+    errlog->writef("%s pipe could not be opened. errno: %d", 
+		   LOG_ERROR, strName.c_str(), err);
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+
+  errlog->writef("%s pipe opened", LOG_INFO, strName.c_str());
+  return true;
+}
+
+/* CAP_SeqPacketTransport::close()
+   Closes socket and every connection accepted on it */
+void CAP_SeqPacketTransport::close() {
+  while( !conns.empty() ) {
+    drop(conns.front());
+  }
+  if( contD != -1 ) {
+    ::close(contD);
+    contD = -1;
+    contLeft = 0;
+  }
+  if( pollD != -1 ) {
+    ::close(pollD);
+    pollD = -1;
+  }
+  if( sockD != -1 ) {
+    ::close(sockD);
+    sockD = -1;
+    errlog->writef("pipe %s closed", LOG_INFO, strName.c_str());
+  }
+}
+
+/* CAP_SeqPacketTransport::listen()
+   Binds reader's socket and watches it for connections. Anything left at 
+   pathname by an earlier run is removed first. */
+void CAP_SeqPacketTransport::listen() {
+  if( sockD != -1 ) {
+    throw CAP_PipeException(EXCPIPE_ISOPEN);
+  }
+
+  sockaddr_un addr;
+  if( !fill_address(strPathname, addr) ) {
+    errlog->writef("%s pipe pathname is too long for a socket", LOG_ERROR, 
+		   strName.c_str());
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+
+  /* stale socket, or FIFO from when channel was configured as one */
+  struct stat st;
+  if( lstat(strPathname.c_str(), &st) == 0 && 
+      (S_ISSOCK(st.st_mode) || S_ISFIFO(st.st_mode)) ) {
+    unlink(strPathname.c_str());
+  }
+
+  sockD = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+  if( sockD == -1 || 
+      bind(sockD, (sockaddr*)&addr, sizeof(addr)) == -1 ||
+      ::listen(sockD, PIPE_BACKLOG) == -1 ||
+      (pollD=epoll_create1(EPOLL_CLOEXEC)) == -1 ) {
+    errlog->writef("%s pipe could not listen on socket. errno: %d", 
+		   LOG_ERROR, strName.c_str(), errno);
+    close();
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+  chmod(strPathname.c_str(), CAP_FILE_MASK);
+
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = sockD;
+  if( epoll_ctl(pollD, EPOLL_CTL_ADD, sockD, &ev) == -1 ) {
+    errlog->writef("%s pipe could not watch socket. errno: %d", 
+		   LOG_ERROR, strName.c_str(), errno);
+    close();
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+
+  errlog->writef("%s pipe listening", LOG_INFO, strName.c_str());
+}
+
+/* CAP_SeqPacketTransport::getFd()
+   Returns descriptor to be watched for data; reader's connections all 
+   report through its epoll descriptor */
+int CAP_SeqPacketTransport::getFd() const {
+  return mode==PIPE_RDONLY ? pollD : sockD;
+}
+
+/* CAP_SeqPacketTransport::accept()
+   Accepts every connection waiting on listening socket */
+void CAP_SeqPacketTransport::accept() {
+  int fd;
+  while( (fd=accept4(sockD, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC)) != -1 ) {
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if( epoll_ctl(pollD, EPOLL_CTL_ADD, fd, &ev) == -1 ) {
+      errlog->writef("%s pipe could not watch connection. errno: %d", 
+		     LOG_ERROR, strName.c_str(), errno);
+      ::close(fd);
+      continue;
+    }
+    conns.push_back(fd);
+    errlog->writef("%s pipe accepted a connection", LOG_INFO, 
+		   strName.c_str());
+  }
+}
+
+/* CAP_SeqPacketTransport::drop()
+   Closes connection whose writer has gone away */
+void CAP_SeqPacketTransport::drop(int fd) {
+  epoll_ctl(pollD, EPOLL_CTL_DEL, fd, NULL);
+  ::close(fd);
+  conns.remove(fd);
+  if( currD == fd ) { currD = -1; }
+}
+
+/* CAP_SeqPacketTransport::available()
+   Returns size of next datagram, or what is left of the memory file which 
+   continued the last one; zero if nothing has arrived */
+int CAP_SeqPacketTransport::available() {
+  if( contD != -1 ) {
+    return contLeft;
+  }
+  if( pollD == -1 ) { return 0; }
+
+  /* level-triggered; connections holding datagrams keep reporting */
+  epoll_event evs[SEQPACKET_EVENTS];
+  int n = epoll_wait(pollD, evs, SEQPACKET_EVENTS, 0);
+  for( int i=0; i<n; i++ ) {
+    int fd = evs[i].data.fd;
+    if( fd == sockD ) {
+      accept();
+      continue;
+    }
+
+    ssize_t len = recv(fd, NULL, 0, MSG_PEEK|MSG_TRUNC|MSG_DONTWAIT);
+    if( len > 0 ) {
+      currD = fd;
+      return len;
+    }
+    else if( len == 0 || (errno != EAGAIN && errno != EINTR) ) {
+      /* writer closed its end; others may still be connected */
+      drop(fd);
+    }
+  }
+  return 0;
+}
+
+/* CAP_SeqPacketTransport::read()
+   Takes one whole datagram, or continues the memory file passed with the 
+   last one */
+int CAP_SeqPacketTransport::read(char* buf, int len) {
+  if( contD != -1 ) {
+    ssize_t n = ::read(contD, buf, len < contLeft ? len : contLeft);
+    if( n <= 0 ) {
+      errlog->writef("%s pipe failed to read continued message. errno: %d", 
+		     LOG_ERROR, strName.c_str(), errno);
+      n = -1;
+      errno = EIO;
+    }
+    else {
+      contLeft -= n;
+    }
+    if( n == -1 || !contLeft ) {
+      ::close(contD);
+      contD = -1;
+      contLeft = 0;
+    }
+    return n;
+  }
+
+  if( currD == -1 && !available() ) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  /* room for one descriptor passed with datagram */
+  char control[CMSG_SPACE(sizeof(int))];
+  iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  int fd = currD;
+  currD = -1;
+  ssize_t n = recvmsg(fd, &msg, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+  if( n <= 0 ) {
+    if( n == 0 ) { drop(fd); }
+    errno = EAGAIN; /* another connection may have data */
+    return -1;
+  }
+  if( msg.msg_flags & MSG_TRUNC ) {
+    errlog->writef("%s pipe lost end of a %d character datagram", 
+		   LOG_ERROR, strName.c_str(), (int)n);
+  }
+
+  /* rest of message follows in memory file */
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if( cmsg && cmsg->cmsg_level == SOL_SOCKET && 
+      cmsg->cmsg_type == SCM_RIGHTS ) {
+    memcpy(&contD, CMSG_DATA(cmsg), sizeof(int));
+    struct stat st;
+    if( fstat(contD, &st) == -1 || st.st_size <= 0 ) {
+      ::close(contD);
+      contD = -1;
+    }
+    else {
+      contLeft = st.st_size;
+    }
+  }
+  return n;
+}
+
+/* CAP_SeqPacketTransport::sendLarge()
+   Sends first PIPE_INLINE_MAX characters as a datagram along with a memory 
+   file holding the rest, so message stays whole without passing through 
+   socket buffer */
+int CAP_SeqPacketTransport::sendLarge(const char* buf, int len) {
+  int memD = memfd_create(strName.c_str(), MFD_CLOEXEC);
+  if( memD == -1 ) { return -1; }
+
+  const char* rest = buf+PIPE_INLINE_MAX;
+  int restlen = len-PIPE_INLINE_MAX;
+  while( restlen > 0 ) {
+    ssize_t n = ::write(memD, rest, restlen);
+    if( n == -1 ) {
+      if( errno == EINTR ) { continue; }
+      int err = errno;
+      ::close(memD);
+      errno = err;
+      return -1;
+    }
+    rest += n;
+    restlen -= n;
+  }
+  lseek(memD, 0, SEEK_SET); /* reader shares file offset */
+
+  char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+  iovec iov;
+  iov.iov_base = (void*)buf;
+  iov.iov_len = PIPE_INLINE_MAX;
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &memD, sizeof(int));
+
+  ssize_t n = sendmsg(sockD, &msg, MSG_DONTWAIT|MSG_NOSIGNAL);
+  int err = errno;
+  ::close(memD); /* reader holds its own reference */
+  errno = err;
+  return n == -1 ? -1 : len;
+}
+
+/* CAP_SeqPacketTransport::write()
+   Sends whole message as one datagram; returns -1 with errno EAGAIN if 
+   socket has no room for it, or EPIPE if reader has gone away */
+int CAP_SeqPacketTransport::write(const char* buf, int len) {
+  ssize_t n;
+  if( len > PIPE_INLINE_MAX ) {
+    n = sendLarge(buf, len);
+  }
+  else {
+    n = send(sockD, buf, len, MSG_DONTWAIT|MSG_NOSIGNAL);
+  }
+
+  if( n == -1 && (errno==ECONNRESET || errno==ENOTCONN) ) {
+    errno = EPIPE;
+  }
+  return n;
+}
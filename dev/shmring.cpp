@@ -0,0 +1,460 @@
+/*******************************************************************************
+  File Name: shmring.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_ShmRingTransport class
+*******************************************************************************/
+#include "pipe.h"
+#include "transport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+using namespace std;
+
+#define RING_EVENTS 16 /* max. number of descriptors checked at once */
+#define RING_MAPSIZE(size) (sizeof(CAP_RingHeader)+(size))
+
+/* ring_copyout()
+   Copies *n* characters starting at ring position *pos*, which may wrap */
+static void ring_copyout(const CAP_Ring& r, uint64_t pos, char* dst,
+  uint32_t n)
+{
+  uint32_t mask = r.size-1;
+  uint32_t off = pos & mask;
+  uint32_t first = r.size-off;
+  if( first > n ) { first = n; }
+  memcpy(dst, r.base+off, first);
+  memcpy(dst+first, r.base, n-first);
+}
+
+/* ring_copyin()
+   Copies *n* characters into ring starting at position *pos* */
+static void ring_copyin(CAP_Ring& r, uint64_t pos, const char* src,
+  uint32_t n)
+{
+  uint32_t mask = r.size-1;
+  uint32_t off = pos & mask;
+  uint32_t first = r.size-off;
+  if( first > n ) { first = n; }
+  memcpy(r.base+off, src, first);
+  memcpy(r.base, src+first, n-first);
+}
+
+/* ring_valid()
+   Checks that a record of *len* characters at ring position *pos* lies 
+   wholly within what writer has added, which is no more than ring holds */
+static bool ring_valid(const CAP_Ring& r, uint64_t head, uint64_t pos,
+  uint32_t len)
+{
+  return head-pos <= r.size && len <= head-pos-sizeof(len);
+}
+
+/* ring_raise()
+   Wakes other side of ring */
+static void ring_raise(CAP_Ring& r) {
+  uint64_t one=1;
+  if( ::write(r.eventD, &one, sizeof(one)) == -1 ) {
+    /* counter is already raised */
+  }
+}
+
+/* CAP_ShmRingTransport::CAP_ShmRingTransport()
+   Class constructor */
+CAP_ShmRingTransport::CAP_ShmRingTransport(const string& _name,
+  CAP_Log* _errlog)
+  : CAP_SeqPacketTransport(_name, _errlog), currR(NULL), partLeft(0)
+{
+}
+
+/* CAP_ShmRingTransport::~CAP_ShmRingTransport()
+   Class destructor */
+CAP_ShmRingTransport::~CAP_ShmRingTransport() {
+  close();
+}
+
+/* CAP_ShmRingTransport::open()
+   Connects to reader's control socket and hands it a new ring; returns
+   false if nobody is listening */
+bool CAP_ShmRingTransport::open() {
+  if( !CAP_SeqPacketTransport::open() ) {
+    return false;
+  }
+
+  CAP_Ring r;
+  r.connD = sockD;
+  r.eventD = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+  r.hdr = NULL;
+  int memD = memfd_create(strName.c_str(), MFD_CLOEXEC);
+  if( memD == -1 || r.eventD == -1 ||
+      ftruncate(memD, RING_MAPSIZE(PIPE_RING_SIZE)) == -1 ||
+      (r.hdr=(CAP_RingHeader*)mmap(NULL, RING_MAPSIZE(PIPE_RING_SIZE),
+        PROT_READ|PROT_WRITE, MAP_SHARED, memD, 0)) == MAP_FAILED ) {
+    errlog->writef("%s pipe could not create ring. errno: %d", LOG_ERROR,
+		   strName.c_str(), errno);
+    if( memD != -1 ) { ::close(memD); }
+    if( r.eventD != -1 ) { ::close(r.eventD); }
+    CAP_SeqPacketTransport::close();
+    throw CAP_PipeException(EXCPIPE_OPENFAIL);
+  }
+  r.hdr->magic = PIPE_RING_MAGIC;
+  r.hdr->size = PIPE_RING_SIZE;
+  r.size = PIPE_RING_SIZE;
+  r.hdr->head = 0;
+  r.hdr->tail = 0;
+  r.base = (char*)r.hdr+sizeof(CAP_RingHeader);
+
+  /* pass memory file and eventfd to reader */
+  int fds[2] = { memD, r.eventD };
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  char tag = 'R';
+  iovec iov;
+  iov.iov_base = &tag;
+  iov.iov_len = 1;
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  ssize_t n = sendmsg(sockD, &msg, MSG_DONTWAIT|MSG_NOSIGNAL);
+  ::close(memD); /* mapping and reader keep it alive */
+  rings.push_back(r);
+  if( n == -1 ) {
+    errlog->writef("%s pipe could not pass ring to reader. errno: %d",
+		   LOG_WARNING, strName.c_str(), errno);
+    close();
+    return false;
+  }
+  return true;
+}
+
+/* CAP_ShmRingTransport::detach()
+   Unmaps ring and closes its eventfd */
+void CAP_ShmRingTransport::detach(list<CAP_Ring>::iterator it) {
+  if( currR == &*it ) {
+    currR = NULL;
+    partLeft = 0;
+  }
+  if( mode==PIPE_RDONLY && pollD != -1 ) {
+    epoll_ctl(pollD, EPOLL_CTL_DEL, it->eventD, NULL);
+  }
+  munmap(it->hdr, RING_MAPSIZE(it->size));
+  ::close(it->eventD);
+  rings.erase(it);
+}
+
+/* CAP_ShmRingTransport::reject()
+   Drops a ring whose writer broke its records, along with its connection; 
+   nothing more in it can be trusted */
+void CAP_ShmRingTransport::reject(CAP_Ring& r) {
+  errlog->writef("%s pipe dropped a ring holding an invalid record", 
+		 LOG_ERROR, strName.c_str());
+  for( list<CAP_Ring>::iterator it=rings.begin(); it!=rings.end(); it++ ) {
+    if( &*it == &r ) {
+      if( it->connD != -1 ) { CAP_SeqPacketTransport::drop(it->connD); }
+      detach(it);
+      return;
+    }
+  }
+}
+
+/* CAP_ShmRingTransport::close()
+   Releases every ring, then control socket */
+void CAP_ShmRingTransport::close() {
+  while( !rings.empty() ) {
+    detach(rings.begin());
+  }
+  CAP_SeqPacketTransport::close();
+}
+
+/* CAP_ShmRingTransport::drop()
+   Closes control connection of a writer which has gone away; its ring is
+   kept until everything in it has been read */
+void CAP_ShmRingTransport::drop(int fd) {
+  for( list<CAP_Ring>::iterator it=rings.begin(); it!=rings.end(); it++ ) {
+    if( it->connD == fd ) { it->connD = -1; }
+  }
+  CAP_SeqPacketTransport::drop(fd);
+}
+
+/* CAP_ShmRingTransport::attach()
+   Takes ring passed by a writer on control connection *fd*; returns false
+   if writer has closed connection */
+bool CAP_ShmRingTransport::attach(int fd) {
+  int fds[2] = { -1, -1 };
+  char control[CMSG_SPACE(sizeof(fds))];
+  char tag;
+  iovec iov;
+  iov.iov_base = &tag;
+  iov.iov_len = 1;
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n = recvmsg(fd, &msg, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+  if( n == 0 ) { return false; }
+  if( n == -1 ) { return errno == EAGAIN || errno == EINTR; }
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if( !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds)) ) {
+    errlog->writef("%s pipe received control message without a ring",
+		   LOG_WARNING, strName.c_str());
+    return true;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+  /* map ring after checking it is as large as it claims */
+  CAP_Ring r;
+  r.connD = fd;
+  r.eventD = fds[1];
+  r.hdr = NULL;
+  struct stat st;
+  void* p = MAP_FAILED;
+  if( fstat(fds[0], &st) == 0 && st.st_size > (off_t)sizeof(CAP_RingHeader) ) {
+    p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fds[0], 0);
+  }
+  ::close(fds[0]);
+  r.hdr = (CAP_RingHeader*)p;
+  /* size is read once; writer could change header after it is checked */
+  r.size = p != MAP_FAILED ? r.hdr->size : 0;
+  if( p == MAP_FAILED || r.hdr->magic != PIPE_RING_MAGIC ||
+      !r.size || (r.size & (r.size-1)) ||
+      RING_MAPSIZE(r.size) != (uint64_t)st.st_size ) {
+    errlog->writef("%s pipe received an invalid ring", LOG_WARNING,
+		   strName.c_str());
+    if( p != MAP_FAILED ) { munmap(p, st.st_size); }
+    ::close(fds[1]);
+    return true;
+  }
+  r.base = (char*)r.hdr+sizeof(CAP_RingHeader);
+
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = r.eventD;
+  if( epoll_ctl(pollD, EPOLL_CTL_ADD, r.eventD, &ev) == -1 ) {
+    errlog->writef("%s pipe could not watch ring. errno: %d", LOG_ERROR,
+		   strName.c_str(), errno);
+    munmap(r.hdr, st.st_size);
+    ::close(r.eventD);
+    return true;
+  }
+
+  rings.push_back(r);
+  errlog->writef("%s pipe attached a ring", LOG_INFO, strName.c_str());
+  return true;
+}
+
+/* CAP_ShmRingTransport::whole()
+   Returns characters held by messages at front of ring which fit in *max*;
+   at least the first message, however large. Returns -1 if a record runs 
+   past what writer has added. */
+int CAP_ShmRingTransport::whole(CAP_Ring& r, int max) {
+  uint64_t head = __atomic_load_n(&r.hdr->head, __ATOMIC_ACQUIRE);
+  uint64_t pos = r.hdr->tail;
+  int total=0;
+
+  while( head-pos >= sizeof(uint32_t) ) {
+    uint32_t len;
+    ring_copyout(r, pos, (char*)&len, sizeof(len));
+    if( !ring_valid(r, head, pos, len) ) { return -1; }
+    if( total && total+(long)len > max ) { break; }
+    total += len;
+    pos += sizeof(len)+len;
+  }
+
+  /* writer adds whole records only */
+  if( head-pos && head-pos < sizeof(uint32_t) ) { return -1; }
+  return total;
+}
+
+/* CAP_ShmRingTransport::available()
+   Takes new rings and wakeups, then returns size of whole messages waiting
+   in next ring with any; zero if nothing has arrived */
+int CAP_ShmRingTransport::available() {
+  if( partLeft ) {
+    return partLeft;
+  }
+  if( pollD == -1 ) { return 0; }
+
+  epoll_event evs[RING_EVENTS];
+  int n = epoll_wait(pollD, evs, RING_EVENTS, 0);
+  for( int i=0; i<n; i++ ) {
+    int fd = evs[i].data.fd;
+    if( fd == sockD ) {
+      accept();
+      continue;
+    }
+
+    /* eventfd; reset it, ring is checked below */
+    bool isEvent=false;
+    for( list<CAP_Ring>::iterator it=rings.begin(); it!=rings.end(); it++ ) {
+      if( it->eventD == fd ) {
+	uint64_t count;
+	if( ::read(fd, &count, sizeof(count)) == -1 ) { /* already reset */ }
+	isEvent=true;
+	break;
+      }
+    }
+
+    /* control connection; a new ring, or writer has gone */
+    if( !isEvent && !attach(fd) ) {
+      drop(fd);
+    }
+  }
+
+  /* first ring holding anything; rings read are moved to the back */
+  list<CAP_Ring>::iterator it=rings.begin();
+  while( it != rings.end() ) {
+    if( __atomic_load_n(&it->hdr->head, __ATOMIC_ACQUIRE) != it->hdr->tail ) {
+      int n = whole(*it, PIPE_READ_MAX);
+      if( n == -1 ) {
+	reject(*it++);
+	continue;
+      }
+      currR = &*it;
+      return n;
+    }
+    else if( it->connD == -1 ) {
+      /* writer gone and ring drained */
+      detach(it++);
+      continue;
+    }
+    it++;
+  }
+  return 0;
+}
+
+/* CAP_ShmRingTransport::read()
+   Copies whole messages from ring without their lengths, or continues one
+   read only in part */
+int CAP_ShmRingTransport::read(char* buf, int len) {
+  if( !currR && !available() ) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  CAP_Ring& r = *currR;
+  uint64_t head = __atomic_load_n(&r.hdr->head, __ATOMIC_ACQUIRE);
+  uint64_t pos = r.hdr->tail;
+  int total=0;
+
+  if( partLeft ) {
+    uint32_t n = partLeft < (uint32_t)len ? partLeft : len;
+    ring_copyout(r, pos, buf, n);
+    pos += n;
+    total = n;
+    partLeft -= n;
+  }
+  else {
+    while( head-pos >= sizeof(uint32_t) && total < len ) {
+      uint32_t msglen;
+      ring_copyout(r, pos, (char*)&msglen, sizeof(msglen));
+      if( !ring_valid(r, head, pos, msglen) ) {
+	/* messages already copied are whole; rest of ring is lost */
+	reject(r);
+	if( total ) { return total; }
+	errno = EAGAIN;
+	return -1;
+      }
+      if( total+(long)msglen > len ) {
+	if( total ) { break; }
+
+	/* larger than room given; rest follows before any other ring */
+	ring_copyout(r, pos+sizeof(msglen), buf, len);
+	pos += sizeof(msglen)+len;
+	partLeft = msglen-len;
+	total = len;
+	break;
+      }
+      ring_copyout(r, pos+sizeof(msglen), buf+total, msglen);
+      pos += sizeof(msglen)+msglen;
+      total += msglen;
+    }
+  }
+
+  /* hand space back to writer, then look again; writer raises eventfd
+     only when it saw ring empty, so anything it added meanwhile must wake
+     loop from here */
+  __atomic_store_n(&r.hdr->tail, pos, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if( __atomic_load_n(&r.hdr->head, __ATOMIC_ACQUIRE) != pos && !partLeft ) {
+    ring_raise(r);
+  }
+
+  if( !partLeft ) {
+    /* let other rings go first next time */
+    for( list<CAP_Ring>::iterator it=rings.begin(); it!=rings.end(); it++ ) {
+      if( &*it == currR ) {
+	rings.splice(rings.end(), rings, it);
+	break;
+      }
+    }
+    currR = NULL;
+  }
+  return total;
+}
+
+/* CAP_ShmRingTransport::write()
+   Copies whole message into ring; returns -1 with errno EAGAIN if ring has
+   no room for it, or EPIPE if reader has gone away */
+int CAP_ShmRingTransport::write(const char* buf, int len) {
+  if( rings.empty() ) {
+    errno = EPIPE;
+    return -1;
+  }
+
+  CAP_Ring& r = rings.front();
+  uint32_t msglen = len;
+  uint64_t need = sizeof(msglen)+msglen;
+  if( need > r.size ) {
+    errlog->writef("%s pipe cannot fit a %d character message in its ring",
+		   LOG_ERROR, strName.c_str(), len);
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  uint64_t head = r.hdr->head;
+  uint64_t tail = __atomic_load_n(&r.hdr->tail, __ATOMIC_ACQUIRE);
+  if( r.size-(head-tail) < need ) {
+    /* full; tell a slow reader from one which has gone away */
+    char c;
+    if( recv(sockD, &c, 1, MSG_PEEK|MSG_DONTWAIT) == 0 ) {
+      errno = EPIPE;
+    }
+    else {
+      errno = EAGAIN;
+    }
+    return -1;
+  }
+
+  ring_copyin(r, head, (const char*)&msglen, sizeof(msglen));
+  ring_copyin(r, head+sizeof(msglen), buf, msglen);
+  __atomic_store_n(&r.hdr->head, head+need, __ATOMIC_RELEASE);
+
+  /* reader may be idle only if ring was empty before this message */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if( __atomic_load_n(&r.hdr->tail, __ATOMIC_ACQUIRE) == head ) {
+    ring_raise(r);
+  }
+  return len;
+}
@@ -0,0 +1,386 @@
+/*******************************************************************************
+  File Name: spool.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_Spool class
+*******************************************************************************/
+#include "spool.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+using namespace std;
+
+static unsigned crc_table[256]; /* filled on first use */
+static bool crc_ready=false;
+
+/* spool_crc()
+   Continues CRC-32 *crc* over *len* bytes at *buf*; start with zero */
+static unsigned spool_crc(unsigned crc, const void* buf, size_t len) {
+  if( !crc_ready ) {
+    for( unsigned i=0; i<256; i++ ) {
+      unsigned c = i;
+      for( int k=0; k<8; k++ ) {
+        c = c & 1 ? 0xedb88320U ^ (c >> 1) : c >> 1;
+      }
+      crc_table[i] = c;
+    }
+    crc_ready = true;
+  }
+
+  const unsigned char* p = (const unsigned char*)buf;
+  crc = ~crc;
+  while( len-- ) { crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8); }
+  return ~crc;
+}
+
+/* record_crc()
+   CRC of a record; covers its header after the CRC field, then its body */
+static unsigned record_crc(const CAP_SpoolHead& head, const char* body) {
+  const size_t skip = offsetof(CAP_SpoolHead, key);
+  unsigned crc = spool_crc(0, (const char*)&head + skip, sizeof(head)-skip);
+  return spool_crc(crc, body, head.len);
+}
+
+/* CAP_Spool::CAP_Spool()
+   Constructor; file is not opened until open(). *_applied* is called with
+   each request once database has it. */
+CAP_Spool::CAP_Spool(CAP_Log* _errlog, CAP_DbExecutor* _db,
+  const string& _file, PCAP_DbDoneProc _applied, void* _ctx)
+  : errlog(_errlog), db(_db), events(NULL), strFile(_file), fd(-1),
+    retryD(-1), retrying(false), stopped(false), nPending(0), synced(0),
+    drained(0), nextKey(0), applied(_applied), ctx(_ctx), appended(0),
+    syncs(0), retries(0), dropped(0)
+{
+  if( !errlog ) { throw CAP_Exception(CAPEXC_NOERRLOG); }
+  if( !db ) { throw CAP_Exception(CAPEXC_INVALPARAM); }
+}
+
+/* CAP_Spool::~CAP_Spool()
+   Destructor; whatever database does not yet have stays in file for next
+   start */
+CAP_Spool::~CAP_Spool() {
+  if( fd != -1 ) { ::close(fd); }
+}
+
+/* CAP_Spool::open()
+   Opens spool file, creating it if need be, and finds every request in it
+   to be replayed; throws -1 on failure. A record cut short by a crash
+   while it was written, and anything after it, is dropped. */
+void CAP_Spool::open() {
+  fd = ::open(strFile.c_str(), O_RDWR|O_CREAT|O_APPEND|O_CLOEXEC, 0600);
+  struct stat st;
+  if( fd == -1 || fstat(fd, &st) == -1 ) {
+    errlog->writef("failed to open spool file %s: %d", LOG_FATAL,
+      strFile.c_str(), errno);
+    throw -1;
+  }
+
+  /* keys of a new file start above any a past file handed out, as long
+     as clock has moved on */
+  if( st.st_size == 0 ) {
+    nextKey = (unsigned long long)time(NULL) << 32;
+    writeBase();
+    errlog->writef("created spool file %s", LOG_INFO, strFile.c_str());
+    return;
+  }
+
+  CAP_SpoolHead head;
+  string body;
+  synced = st.st_size;
+  if( !readRecord(0, head, body) || head.kind != SPOOL_BASE ) {
+    errlog->writef("%s is not a spool file", LOG_FATAL, strFile.c_str());
+    throw -1;
+  }
+  nextKey = head.key;
+
+  off_t off = sizeof(head);
+  unsigned long count=0;
+  while( off < st.st_size ) {
+    if( !readRecord(off, head, body) ) {
+      errlog->writef("dropping %ld bytes at end of spool file %s which are "
+        "not a whole record", LOG_WARNING, (long)(st.st_size-off),
+        strFile.c_str());
+      if( ftruncate(fd, off) == -1 || fdatasync(fd) == -1 ) {
+        errlog->writef("failed to truncate spool file %s: %d", LOG_FATAL,
+          strFile.c_str(), errno);
+        throw -1;
+      }
+      break;
+    }
+    nextKey = head.key + 1;
+    off += sizeof(head) + head.len;
+    count++;
+  }
+
+  synced = off;
+  drained = sizeof(head);
+  errlog->writef("spool file %s holds %lu requests to replay", LOG_INFO,
+    strFile.c_str(), count);
+}
+
+/* CAP_Spool::start()
+   Creates retry timer in event loop and starts replaying what open()
+   found */
+void CAP_Spool::start(CAP_EventLoop* _events) {
+  events = _events;
+  retryD = events->addTimer(0, onRetry, this);
+  drain();
+}
+
+/* CAP_Spool::writeBase()
+   Writes first record of an empty file and syncs it; throws -1 on
+   failure */
+void CAP_Spool::writeBase() {
+  CAP_SpoolHead head;
+  memset(&head, 0, sizeof(head));
+  head.magic = CAP_SPOOL_MAGIC;
+  head.key = nextKey;
+  head.kind = SPOOL_BASE;
+  head.crc = record_crc(head, NULL);
+
+  if( write(fd, &head, sizeof(head)) != (ssize_t)sizeof(head) ||
+      fdatasync(fd) == -1 ) {
+    errlog->writef("failed to write spool file %s: %d", LOG_FATAL,
+      strFile.c_str(), errno);
+    throw -1;
+  }
+  synced = drained = sizeof(head);
+}
+
+/* CAP_Spool::readRecord()
+   Reads record at *off* into *head* and *body*; false if it is not whole
+   or its CRC does not match */
+bool CAP_Spool::readRecord(off_t off, CAP_SpoolHead& head, string& body) {
+  if( off + (off_t)sizeof(head) > synced ) { return false; }
+  if( pread(fd, &head, sizeof(head), off) != (ssize_t)sizeof(head) ) {
+    return false;
+  }
+  if( head.magic != CAP_SPOOL_MAGIC ||
+      head.len > synced - off - sizeof(head) ) {
+    return false;
+  }
+
+  body.resize(head.len);
+  if( head.len && pread(fd, &body[0], head.len, off + sizeof(head)) !=
+      (ssize_t)head.len ) {
+    return false;
+  }
+  return head.crc == record_crc(head, body.data());
+}
+
+/* CAP_Spool::append()
+   Spools a request; it goes to database once synced. Message body is
+   copied, as pipe's buffer is reused. */
+void CAP_Spool::append(DbOpKind kind, int user_id, const CAP_StrRef& body) {
+  CAP_SpoolHead head;
+  memset(&head, 0, sizeof(head));
+  head.magic = CAP_SPOOL_MAGIC;
+  head.key = nextKey++;
+  head.kind = kind;
+  head.user_id = user_id;
+  head.len = body.len;
+  head.crc = record_crc(head, body.ptr);
+
+  pending.append((const char*)&head, sizeof(head));
+  pending.append(body.ptr, body.len);
+  appended++;
+  if( ++nPending >= CAP_SPOOL_SYNC_MAX ) { sync(); }
+}
+
+/* CAP_Spool::sync()
+   Writes every appended request with one fsync and hands them to
+   database; throws -1 if they cannot be written, as they were taken
+   from master pipe and would be lost */
+void CAP_Spool::sync() {
+  if( pending.empty() ) { return; }
+
+  const char* p = pending.data();
+  size_t left = pending.size();
+  while( left ) {
+    ssize_t n = write(fd, p, left);
+    if( n == -1 && errno == EINTR ) { continue; }
+    if( n == -1 ) {
+      errlog->writef("failed to write spool file %s: %d", LOG_FATAL,
+        strFile.c_str(), errno);
+      throw -1;
+    }
+    p += n;
+    left -= n;
+  }
+  if( fdatasync(fd) == -1 ) {
+    errlog->writef("failed to sync spool file %s: %d", LOG_FATAL,
+      strFile.c_str(), errno);
+    throw -1;
+  }
+
+  synced += pending.size();
+  pending.clear();
+  nPending = 0;
+  syncs++;
+  drain();
+}
+
+/* CAP_Spool::submit()
+   Reads request at slot's offset and hands it to database; fills slot's
+   key and returns offset of next record. Throws -1 if file no longer
+   reads back. */
+off_t CAP_Spool::submit(CAP_SpoolSlot& slot) {
+  CAP_SpoolHead head;
+  string body;
+  if( !readRecord(slot.start, head, body) ) {
+    errlog->writef("spool file %s is damaged at %ld", LOG_FATAL,
+      strFile.c_str(), (long)slot.start);
+    throw -1;
+  }
+
+  slot.key = head.key;
+  slot.tries++;
+  CAP_DbOp* op = new CAP_DbOp((DbOpKind)head.kind, onDone, this);
+  op->user_id = head.user_id;
+  op->key = head.key;
+  op->body.swap(body);
+  db->submit(op);
+  return slot.start + sizeof(head) + head.len;
+}
+
+/* CAP_Spool::drain()
+   Hands synced requests to database until CAP_SPOOL_INFLIGHT are out */
+void CAP_Spool::drain() {
+  while( !stopped && drained < synced &&
+         inflight.size() < CAP_SPOOL_INFLIGHT ) {
+    CAP_SpoolSlot slot;
+    slot.start = drained;
+    slot.done = false;
+    slot.failed = false;
+    slot.tries = 0;
+    drained = submit(slot);
+    inflight.push_back(slot);
+  }
+}
+
+/* CAP_Spool::settle()
+   Forgets requests database has, oldest first. Empties file once
+   everything in it is in database and it has grown large enough; keys
+   below the next are pruned only after that is synced, so nothing
+   replayed can miss its key. */
+void CAP_Spool::settle() {
+  while( !inflight.empty() && inflight.front().done ) {
+    inflight.pop_front();
+  }
+  if( stopped || !inflight.empty() || drained < synced ||
+      !pending.empty() || synced < CAP_SPOOL_TRUNCATE ) {
+    return;
+  }
+
+  if( ftruncate(fd, 0) == -1 ) {
+    errlog->writef("failed to truncate spool file %s: %d", LOG_FATAL,
+      strFile.c_str(), errno);
+    throw -1;
+  }
+  writeBase();
+
+  CAP_DbOp* op = new CAP_DbOp(DBOP_KEY_PRUNE);
+  op->key = nextKey;
+  db->submit(op);
+  errlog->writef("emptied spool file %s", LOG_INFO, strFile.c_str());
+}
+
+/* CAP_Spool::drop()
+   Gives up on a request database failed; logs enough of it for it to be 
+   found and sent again by hand */
+void CAP_Spool::drop(const CAP_SpoolSlot& slot, const CAP_DbOp& op) {
+  /* start of body on one line */
+  char sz[65];
+  int shown = op.body.length() < 64 ? (int)op.body.length() : 64;
+  for( int i=0; i<shown; i++ ) {
+    sz[i] = op.body[i]=='\n' ? ' ' : op.body[i];
+  }
+  sz[shown] = '\0';
+
+  errlog->writef("dropped spooled request %llu (operation %d, user %d) "
+    "after %u tries: %s", LOG_ERROR, slot.key, (int)op.kind, op.user_id,
+    slot.tries, sz);
+  dropped++;
+}
+
+/* CAP_Spool::onDone()
+   Completion of a spooled insert. One which failed while database was 
+   away or locked is retried after CAP_SPOOL_RETRY_MSEC, doubled for each 
+   try before, until CAP_SPOOL_RETRY_MAX tries; any other failure is 
+   dropped. */
+void CAP_Spool::onDone(CAP_DbOp& op, void* ctx) {
+  CAP_Spool* s = (CAP_Spool*)ctx;
+
+  deque<CAP_SpoolSlot>::iterator it;
+  for( it=s->inflight.begin(); it!=s->inflight.end(); it++ ) {
+    if( (*it).key == op.key ) { break; }
+  }
+  if( it == s->inflight.end() ) { return; }
+
+  if( op.ok ) {
+    (*it).done = true;
+    if( s->applied ) { s->applied(op, s->ctx); }
+  }
+  else if( op.transient && (*it).tries < CAP_SPOOL_RETRY_MAX ) {
+    (*it).failed = true;
+    if( !s->retrying && s->retryD != -1 ) {
+      unsigned msec = CAP_SPOOL_RETRY_MSEC;
+      for( unsigned i=1; i<(*it).tries && msec<CAP_SPOOL_RETRY_MAX_MSEC; 
+           i++ ) {
+        msec *= 2;
+      }
+      if( msec > CAP_SPOOL_RETRY_MAX_MSEC ) {
+        msec = CAP_SPOOL_RETRY_MAX_MSEC;
+      }
+      s->events->armTimer(s->retryD, msec);
+      s->retrying = true;
+    }
+  }
+  else {
+    if( op.transient ) {
+      s->errlog->writef("spooled request %llu still failing after %d tries",
+        LOG_ERROR, (*it).key, CAP_SPOOL_RETRY_MAX);
+    }
+    s->drop(*it, op);
+    (*it).done = true;
+  }
+  s->settle();
+  s->drain();
+}
+
+/* CAP_Spool::onRetry()
+   Timer handler; hands every failed request to database again */
+void CAP_Spool::onRetry(int fd, unsigned events, void* ctx) {
+  CAP_Spool* s = (CAP_Spool*)ctx;
+  s->retrying = false;
+  if( s->stopped ) { return; }
+
+  for( deque<CAP_SpoolSlot>::iterator it=s->inflight.begin();
+       it!=s->inflight.end(); it++ ) {
+    if( !(*it).failed ) { continue; }
+    (*it).failed = false;
+    s->retries++;
+    s->submit(*it);
+  }
+}
+
+/* CAP_Spool::stop()
+   Syncs what was appended and stops handing requests to database; those
+   already out are left to finish */
+void CAP_Spool::stop() {
+  sync();
+  stopped = true;
+  if( retryD != -1 ) { events->armTimer(retryD, 0); }
+}
+
+/* CAP_Spool::logStats()
+   Writes number of requests spooled and fsyncs they took to log */
+void CAP_Spool::logStats() {
+  errlog->writef("spooled %lu requests in %lu fsyncs; %lu retried; %lu "
+    "dropped; %ld bytes not yet handed to database", LOG_INFO, appended, 
+    syncs, retries, dropped, (long)(synced - drained));
+}
@@ -0,0 +1,103 @@
+/*******************************************************************************
+  File Name: spool.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Append-only file client and archive requests are kept in
+    until database has them
+*******************************************************************************/
+#ifndef _SPOOL_H_
+#define _SPOOL_H_
+
+#include "master.h"
+#include "log.h"
+#include "event.h"
+#include "dbexec.h"
+#include "strref.h"
+#include <sys/types.h>
+#include <deque>
+#include <string>
+using namespace std;
+
+#define CAP_SPOOL_MAGIC 0x4c4f4f50 /* "POOL" as it reads in a dump */
+#define SPOOL_BASE -1              /* kind of file's first record */
+
+/* header of a record in spool file; body follows. First record of file
+   has no body and holds base of keys handed out from it. */
+struct CAP_SpoolHead {
+  unsigned magic;         /* CAP_SPOOL_MAGIC */
+  unsigned crc;           /* CRC-32 of rest of header and of body */
+  unsigned long long key; /* request key */
+  int kind;               /* DbOpKind, or SPOOL_BASE */
+  int user_id;
+  unsigned len;           /* bytes of body */
+  unsigned pad;           /* zero */
+};
+
+/* spooled request handed to database */
+struct CAP_SpoolSlot {
+  off_t start;            /* offset of its record */
+  unsigned long long key; /* its key */
+  bool done;              /* database has it */
+  bool failed;            /* database failed; waits for retry */
+  unsigned tries;         /* times handed to database */
+};
+
+/* Requests are appended to the file, and the file synced, before they go
+   to database, so a request once read from master pipe survives a crash
+   and database being slow or away. Appends are synced together once per
+   batch of messages (sync()), or every CAP_SPOOL_SYNC_MAX. A drainer hands
+   synced records to database thread, at most CAP_SPOOL_INFLIGHT at once.
+   One which failed only because database was away or locked is retried,
+   less often each time, up to CAP_SPOOL_RETRY_MAX tries; any other
+   failure will not pass by trying again, so it is logged and dropped
+   rather than holding file open forever. Each record carries a key, recorded in
+   the same transaction as its insert, so a record replayed after a crash
+   is skipped if it already went in. Once everything is drained and file
+   has grown past CAP_SPOOL_TRUNCATE it is emptied, and keys below the next
+   one are pruned from database. Used only from event loop's thread. */
+class CAP_Spool {
+ protected:
+  CAP_Log* errlog;          /* log events are written to */
+  CAP_DbExecutor* db;       /* runs inserts */
+  CAP_EventLoop* events;    /* owns retry timer */
+  string strFile;           /* path of spool file */
+  int fd;                   /* spool file; -1 until open() */
+  int retryD;               /* retry timer; -1 until start() */
+  bool retrying;            /* retry timer is armed */
+  bool stopped;             /* nothing more goes to database */
+  string pending;           /* records appended; not yet written */
+  unsigned nPending;        /* records in above */
+  off_t synced;             /* bytes of file written and synced */
+  off_t drained;            /* records before this went to database */
+  deque<CAP_SpoolSlot> inflight; /* went to database; oldest first */
+  unsigned long long nextKey;    /* key of next request appended */
+  PCAP_DbDoneProc applied;  /* called once database has a request */
+  void* ctx;                /* passed to above */
+  unsigned long appended;   /* requests appended */
+  unsigned long syncs;      /* fsyncs of appended requests */
+  unsigned long retries;    /* requests handed to database again */
+  unsigned long dropped;    /* requests database would not take */
+
+  void writeBase();
+  bool readRecord(off_t off, CAP_SpoolHead& head, string& body);
+  off_t submit(CAP_SpoolSlot& slot);
+  void drain();
+  void settle();
+  void drop(const CAP_SpoolSlot& slot, const CAP_DbOp& op);
+  static void onDone(CAP_DbOp& op, void* ctx);
+  static void onRetry(int fd, unsigned events, void* ctx);
+
+ public:
+  CAP_Spool(CAP_Log* _errlog, CAP_DbExecutor* _db, const string& _file,
+    PCAP_DbDoneProc _applied, void* _ctx);
+  ~CAP_Spool();
+
+  void open();
+  void start(CAP_EventLoop* _events);
+  void append(DbOpKind kind, int user_id, const CAP_StrRef& body);
+  void sync();
+  void stop();
+  void logStats();
+};
+
+#endif /* _SPOOL_H_ */
@@ -1,8 +1,8 @@
 /*******************************************************************************
   File Name: sql.h
   Author: Grant Gipson
-  Date Last Edited: May 14, 2011
-  Description: Function prototypes for database access
+  Date Last Edited: October 16, 2026
+  Description: Function prototypes for MySQL database access
 *******************************************************************************/
 #ifndef _SQL_H_
 #define _SQL_H_
@@ -11,28 +11,29 @@
 #include <mysql_connection.h>
 #include <cppconn/exception.h>
 #include <cppconn/prepared_statement.h>
+#include "dbpool.h"
+#include "store.h"
+#include "strref.h"
+#include "tokens.h"
 #include <list>
+#include <vector>
 #include <string>
 using namespace std;
 using namespace sql;
 
-struct ContentRec {
-  unsigned id;
-  string title;
-};
-
-extern Connection* sqlconn;
-
-void dosql_archive_insert(const int user_id, list<string>& body);
-bool dosql_archive_select(unsigned& archive_id, int& user_id, 
-  list<ContentRec>& content);
-void dosql_archive_finish(const unsigned archive_id);
-void dosql_content_delete(list<string>& body);
-void dosql_content_rename(list<string>& body);
-bool dosql_content_insert(list<string>& body, int user_id, string& filename, unsigned& content_id);
-void dosql_job_insert(const int user_id, list<string>& body);
-bool dosql_job_select(unsigned& job_id, int& user_id, string& type, string& url);
-void dosql_job_failed(const int job_id);
-void dosql_job_finish(const int job_id);
+bool dosql_archive_insert(CAP_DbConn& db, const int user_id, 
+  const CAP_StrRef& body, unsigned long long key);
+bool dosql_archive_select(CAP_DbConn& db, CAP_DbOp& op);
+bool dosql_content_insert(CAP_DbConn& db, const CAP_Tokens& body, 
+  int user_id, unsigned& content_id);
+bool dosql_job_insert(CAP_DbConn& db, const int user_id, 
+  const CAP_Tokens& body, unsigned long long key);
+bool dosql_key_prune(CAP_DbConn& db, unsigned long long key);
+bool dosql_job_claim(CAP_DbConn& db, const unsigned max, 
+  list<JobRec>& jobs);
+bool dosql_job_retire(CAP_DbConn& db, const unsigned max, unsigned& moved);
+bool dosql_job_release(CAP_DbConn& db, const list<JobRec>& jobs, 
+  unsigned& moved);
+bool dosql_status_flush(CAP_DbConn& db, const CAP_StatusSet& set);
 
 #endif /* _SQL_H_ */
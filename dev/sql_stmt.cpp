@@ -1,7 +1,7 @@
 /*******************************************************************************
   File Name: sql_stmt.cpp
   Author: Grant Gipson
-  Date Last Edited: May 16, 2011
+  Date Last Edited: October 16, 2026
   Description: Series of functions for executing SQL statements
 *******************************************************************************/
 #include "log.h"
@@ -10,136 +10,207 @@
 #include <mysql/mysql.h>
 #include <mysql/mysql_time.h>
 #include <string.h>
+#include <stdio.h>
 #include <iostream>
 using namespace std;
 
 extern class CAP_Log* errlog;
 
+/* every statement, by SqlStmt; those with text are prepared on each 
+   connection as it connects */
+const CAP_SqlDef sql_defs[STMT_MAX] = {
+  { "archive_insert",
+    "insert into archive (id) values ((?))" },
+  { "archive_select",
+    "select pending.id, pending.user_id, item.id, item.title "
+    "from (select archive.id, content.user_id "
+      "from archive inner join content on content.id=archive.id "
+      "where archive.cmpl_date is null limit 1) pending "
+    "left join archive_content on archive_content.archive_id=pending.id "
+    "left join content item on item.id=archive_content.content_id" },
+  { "content_insert",
+    "insert into content (user_id,folder_id,add_date,status,title) "
+    "values ((?),(?),(?),'A',(?))" },
+  { "last_id",
+    "select last_insert_id()" },
+  { "job_insert",
+    "insert into job (user_id,type,status,url) values ((?),(?),\"P\",(?))" },
+  { "job_claim",
+    "select id, user_id, type, url from job where status=\"P\" "
+    "order by id limit ? for update skip locked" },
+  { "job_retire",
+    "select id from job where status in (\"C\",\"F\") "
+    "and id < (select max(id) from job) limit ? for update" },
+  { "request_key",
+    "insert ignore into request_key (id) values ((?))" },
+  { "key_prune",
+    "delete from request_key where id < (?)" },
+  { "archive_items", NULL },
+  { "job_mark", NULL },
+  { "status_jobs", NULL },
+  { "status_archives", NULL },
+  { "status_delete", NULL },
+  { "status_rename", NULL },
+  { "job_history", NULL },
+  { "job_purge", NULL },
+  { "job_release", NULL }
+};
+
+/* dosql_request_key()
+   Records request key *key* inside caller's transaction; false if it was 
+   already there, meaning the request went in before */
+static bool dosql_request_key(CAP_DbConn& db, unsigned long long key) {
+  db.stmt(STMT_REQUEST_KEY)->setUInt64(1, key);
+  if( db.update(STMT_REQUEST_KEY) == 1 ) { return true; }
+
+  errlog->writef("request %llu was already applied; skipped", LOG_INFO, key);
+  return false;
+}
+
 /* dosql_archive_insert()
-   Inserts a new archive record into database */
-void dosql_archive_insert(const int user_id, list<string>& body) {
-  if( !errlog || !sqlconn ) { throw -1; } /* SCREW THAT JAZZ!! */
+   Inserts a new archive record into database; false if nothing was 
+   inserted */
+bool dosql_archive_insert(CAP_DbConn& db, const int user_id, 
+  const CAP_StrRef& body, unsigned long long key) 
+{
+  if( !errlog ) { throw -1; } /* SCREW THAT JAZZ!! */
+
+  /* first line is archive's title; any number of content IDs follow */
+  CAP_LineIter it(body);
+  CAP_StrRef line;
+  it.next(line);
 
   /* adding an archive is similar to adding content; duplicate the archive's 
      title and pass to function */
-  list<string> newbody;
-  list<string>::iterator it=body.begin();
-  newbody.push_front(*it);
-  newbody.push_front(*it);
-
-  string trash;
+  CAP_Tokens newbody;
+  newbody.tok[0] = line;
+  newbody.tok[1] = line;
+  newbody.count = 2;
+
+  /* archive, its content record and every archive-content pair go in 
+     together or not at all */
+  Connection* conn = db.get();
+  if( !conn ) { throw CAP_Exception(CAPEXC_DBGONE); }
+
+  PreparedStatement* pstmt_archive_insert = db.stmt(STMT_ARCHIVE_INSERT);
+  unsigned long packetMax = db.packetMax();
   unsigned archive_id=0;
-  if( !dosql_content_insert(newbody, user_id, trash, archive_id) ) {
-    errlog->writef("failed to insert archive into database: call to "
-		   "dosql_content_insert() failed", LOG_ERROR);
-    return;
-  }
+  unsigned long rows=0;
 
-  /* prepare SQL statements */
-  static PreparedStatement* pstmt_archive_insert=NULL;
-  static PreparedStatement* pstmt_archcnt_insert=NULL;
+  try {
+    conn->setAutoCommit(false);
 
-  if( !pstmt_archive_insert ) {
-    /* has not been prepared yet--give it a shot */
-    try {
-      pstmt_archive_insert = sqlconn->prepareStatement(
-        "insert into archive (id) values ((?))");
-      pstmt_archcnt_insert = sqlconn->prepareStatement(
-	"insert into archive_content (archive_id,content_id) values "
-        "((?),(?))");
+    if( key && !dosql_request_key(db, key) ) {
+      conn->rollback();
+      conn->setAutoCommit(true);
+      return true;
     }
-    catch( SQLException err ) {
-      errlog->writef("failed to generate a prepared SQL statement: what: %s, "
-        "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
-        err.getSQLState().c_str());
-      throw -1;
+
+    if( !dosql_content_insert(db, newbody, user_id, archive_id) ) {
+      errlog->writef("failed to insert archive into database: call to "
+		     "dosql_content_insert() failed", LOG_ERROR);
+      conn->rollback();
+      conn->setAutoCommit(true);
+      return false;
     }
-  }
 
-  try {
     /* set parameters for SQL */
     pstmt_archive_insert->setUInt(1, archive_id);
 
     /* insert record into archive table to distinguish this from content */  
     int ret;
-    if( (ret=pstmt_archive_insert->executeUpdate()) != 1 ) {
+    if( (ret=db.update(STMT_ARCHIVE_INSERT)) != 1 ) {
       errlog->writef("insert into archive values (%d) returned %d "
         "when 1 was expected", LOG_WARNING, archive_id, ret);
     }
 
-    /* insert every archive-content pair into table */
-    for( ++it; it!=body.end(); it++ ) {
-      /* convert string to content ID */
-      unsigned long content_id = strtoul((*it).c_str(),NULL,0);
-
-      pstmt_archcnt_insert->setUInt(1, archive_id);
-      pstmt_archcnt_insert->setUInt(2, content_id);
+    /* insert archive-content pairs many rows to a statement; each 
+       statement stays clear of server's packet limit */
+    const string head("insert into archive_content (archive_id,content_id) "
+      "values ");
+    string sql(head);
+    unsigned long pending=0;
+    char sz[32];
 
-      if( (ret=pstmt_archcnt_insert->executeUpdate()) != 1 ) {
-	errlog->writef("insert into archive_content values (%d,%d) returned %d "
-	  "when 1 was expected", LOG_WARNING, archive_id, content_id, ret);
-      }      
+    for(;;) {
+      bool more = it.next(line);
+      int len = 0;
+      if( more ) {
+        len = sprintf(sz, "(%u,%lu)", archive_id, cap_touint(line));
+      }
+
+      /* send what has been built once input ends or next row won't fit */
+      if( pending && (!more || sql.length()+1+len > packetMax) ) {
+        if( (ret=db.update(STMT_ARCHIVE_ITEMS, sql)) != (int)pending ) {
+          errlog->writef("insert of %lu rows into archive_content returned "
+            "%d", LOG_WARNING, pending, ret);
+        }
+        rows += pending;
+        sql.assign(head);
+        pending=0;
+      }
+      if( !more ) { break; }
+
+      if( pending ) { sql.append(1, ','); }
+      sql.append(sz, len);
+      pending++;
     }
+
+    conn->commit();
+    conn->setAutoCommit(true);
   }
   catch( SQLException err ) {
-    errlog->writef("failed to execute an SQL statement to insert content: "
+    db.lost(err);
+    errlog->writef("failed to execute an SQL statement to insert archive: "
       "what: %s, code: %d, state: %s", LOG_FATAL, err.what(), 
       err.getErrorCode(), err.getSQLState().c_str());
-  }
-}
-
-/* dosql_archive_select()
-   Selects next archive which has yet to be created */
-bool dosql_archive_select(unsigned& archive_id, int& user_id, 
-  list<ContentRec>& content)
-{
-  static PreparedStatement* pstmt_select_archive=NULL;
-  static PreparedStatement* pstmt_select_content=NULL;
 
-  if( !pstmt_select_archive ) {
-    /* has not been prepared yet--give it a shot */
+    /* nothing was inserted */
     try {
-      pstmt_select_archive = sqlconn->prepareStatement(
-        "select archive.id, content.user_id "
-	"from archive inner join content on content.id=archive.id "
-	"where archive.cmpl_date is null limit 1");
-      pstmt_select_content = sqlconn->prepareStatement(
-        "select content_id, title "
-	"from archive_content inner join content "
-	  "on archive_content.content_id=content.id "
-	"where archive_id=(?)");
+      conn->rollback();
+      conn->setAutoCommit(true);
     }
-    catch( SQLException& err ) {
-      errlog->writef("failed to generate a prepared SQL statement: what: %s, "
-        "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
-        err.getSQLState().c_str());
-      throw -1;
+    catch( SQLException& err2 ) {
+      db.lost(err2);
     }
+    return false;
   }
 
-  /* execute query */
-  ResultSet* res=NULL;
-  try {
-    res = pstmt_select_archive->executeQuery();
+  errlog->writef("inserted archive %u with %lu items", LOG_INFO, 
+    archive_id, rows);
+  return true;
+}
 
-    /* if there is a job, then return its fields */
-    if( res->next() ) {
-      archive_id = res->getInt("id");
-      user_id = res->getInt("user_id");
-    }
-    else { return false; }
+/* dosql_archive_select()
+   Selects next archive which has yet to be created, with its content, in 
+   one query. Each row is handed to op's row callback as it arrives, so 
+   however many items there are only one is held at a time; rows are read 
+   by position. */
+bool dosql_archive_select(CAP_DbConn& db, CAP_DbOp& op) {
+  PreparedStatement* pstmt_archive_select = db.stmt(STMT_ARCHIVE_SELECT);
 
-    /* select all content within this archive */
-    pstmt_select_content->setUInt(1, archive_id);
-    res = pstmt_select_content->executeQuery();
-    while( res->next() ) {
-      ContentRec rec;
-      rec.id = res->getUInt("content_id");
-      rec.title = res->getString("title");
-      content.push_back(rec);
-    }
+  try {
+    /* rows come off the socket as they are read rather than all at once; 
+       nothing else runs on this connection until the last is read */
+    pstmt_archive_select->setResultSetType(ResultSet::TYPE_FORWARD_ONLY);
+    CAP_Result res(db.query(STMT_ARCHIVE_SELECT));
+
+    /* if there is an archive, then every row carries its fields */
+    if( !res->next() ) { return false; }
+    op.id = res->getUInt(1);
+    op.user_id = res->getInt(2);
+
+    ContentRec rec;
+    do {
+      /* an archive with no items, or an item since removed, is null */
+      if( res->isNull(3) ) { continue; }
+      rec.id = res->getUInt(3);
+      rec.title = res->getString(4);
+      op.emit(rec);
+    } while( res->next() );
   }
   catch( SQLException& err ) {
+    db.lost(err);
     errlog->writef("failed to select records from archive table: what: %s, "
       "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
       err.getSQLState().c_str());
@@ -148,194 +219,27 @@ bool dosql_archive_select(unsigned& archive_id, int& user_id,
   return true;
 }
 
-/* dosql_archive_finish()
-   Updates given archive ID in database with a completion date */
-void dosql_archive_finish(const unsigned archive_id) {
-  /* make sure caller is paying attention */
-  if( !archive_id ) { throw CAP_Exception(CAPEXC_INVALPARAM); }
-
-  static PreparedStatement* pstmt_archive_finish=NULL;
-
-  if( !pstmt_archive_finish ) {
-    /* has not been prepared yet--give it a shot */
-    try {
-      pstmt_archive_finish = sqlconn->prepareStatement(
-        "update archive set cmpl_date=(?) where id=(?)");
-    }
-    catch( SQLException& err ) {
-      errlog->writef("failed to generate a prepared SQL statement: what: %s, "
-        "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
-        err.getSQLState().c_str());
-      throw -1;
-    }
-  }
-
-  /* assign paramters to SQL and execute */
-  try {
-    /* format completion date */
-    time_t t = time(NULL);
-    tm* timeptr = localtime(&t);
-
-    char sz[32];
-    memset(sz,'\0',32);
-    strftime(sz,32,"%Y-%m-%d %H:%M:%S",timeptr);
-    string datetime(sz);
-
-    /* set parameters */
-    pstmt_archive_finish->setDateTime(1,datetime);
-    pstmt_archive_finish->setInt(2,archive_id);
-
-    /* update record */
-    int ret;
-    if( (ret=pstmt_archive_finish->executeUpdate()) != 1 ) {
-      errlog->writef("updating archive with ID %d returned %d "
-        "when 1 was expected", LOG_WARNING, archive_id, ret);
-    }
-  }
-  catch( SQLException err ) {
-    errlog->writef("failed to execute SQL to update archive record: "
-      "what: %s, code: %d, state: %s", LOG_FATAL, err.what(), 
-      err.getErrorCode(), err.getSQLState().c_str());
-  }  
-}
-
-/* dosql_content_delete()
-   Marks a content item deleted in database */
-void dosql_content_delete(list<string>& body)
-{
-  	if( !errlog || !sqlconn ) { throw -1; } /* SCREW THAT JAZZ!! */
-
-  	/* extract individual strings from body */
-  	list<string>::iterator it=body.begin();
-  	it++; /* ID of content */
-
-  	static PreparedStatement* pstmt_content_delete=NULL;
-
-	if( !pstmt_content_delete ) {
-	    /* has not been prepared yet--give it a shot */
-	    try {
-	      pstmt_content_delete = sqlconn->prepareStatement(
-	        "update content set status='D' where id=(?)");
-	    }
-	    catch( SQLException err ) {
-			errlog->writef("failed to generate a prepared SQL statement for "
-				"dosql_content_delete: what: %s, code: %d, state: %s", 
-				LOG_FATAL, err.what(), err.getErrorCode(), err.getSQLState().c_str());
-			throw -1;
-		}
-	}
-
-	/* convert ID to a number */
-	unsigned long uID = atol((*it).c_str());
-
-	/* set parameters for SQL */
-	try {
-		pstmt_content_delete->setUInt(1, uID);
-
-		/* execute update */
-		int ret;
-		if( (ret=pstmt_content_delete->executeUpdate()) != 1 ) {
-			errlog->writef("update of content values (%u) returned %d "
-        		"when 1 was expected", LOG_WARNING, uID, ret);
-    	}
-    }
-	catch( SQLException err ) {
-	errlog->writef("failed to execute an SQL statement to update content: "
-		"what: %s, code: %d, state: %s", LOG_FATAL, err.what(), 
-		err.getErrorCode(), err.getSQLState().c_str());
-	}  
-}
-
-/* dosql_content_rename()
-   Changes a content item's title */
-void dosql_content_rename(list<string>& body)
-{
-  	if( !errlog || !sqlconn ) { throw -1; } /* SCREW THAT JAZZ!! */
-
-  	/* extract individual strings from body */
-  	list<string>::iterator it=body.begin();
-  	it++; /* ID of content */
-
-  	static PreparedStatement* pstmt_content_rename=NULL;
-
-	if( !pstmt_content_rename ) {
-	    /* has not been prepared yet--give it a shot */
-	    try {
-	      pstmt_content_rename = sqlconn->prepareStatement(
-	        "update content set title=(?) where id=(?)");
-	    }
-	    catch( SQLException err ) {
-			errlog->writef("failed to generate a prepared SQL statement for "
-				"dosql_content_rename: what: %s, code: %d, state: %s", 
-				LOG_FATAL, err.what(), err.getErrorCode(), err.getSQLState().c_str());
-			throw -1;
-		}
-	}
-
-	/* check list of strings */
-	if( body.size() != 3 ) {
-		errlog->writef("message body parsing error in dosql_content_rename(): %d lines "
-			"when 3 were expected", LOG_ERROR, body.size());
-		return;
-	}
-
-	/* convert ID to a number */
-	unsigned long uID = atol((*it).c_str());
-	string strTitle = *(++it);
-
-	/* set parameters for SQL */
-	try {
-		pstmt_content_rename->setString(1, strTitle.c_str());
-		pstmt_content_rename->setUInt(2, uID);
-
-		/* execute update */
-		int ret;
-		if( (ret=pstmt_content_rename->executeUpdate()) != 1 ) {
-			errlog->writef("update of content values (%u, %s) returned %d "
-        		"when 1 was expected", LOG_WARNING, uID, strTitle.c_str(), ret);
-    	}
-    }
-	catch( SQLException err ) {
-		errlog->writef("failed to execute an SQL statement to update content in "
-			"dosql_content_rename(): what: %s, code: %d, state: %s", LOG_FATAL, err.what(), 
-			err.getErrorCode(), err.getSQLState().c_str());
-	}  
-}
-
 /* dosql_content_insert()
    Inserts a new content item into database */
-bool dosql_content_insert(list<string>& body, int user_id, string& filename, 
-			  unsigned& content_id)
+bool dosql_content_insert(CAP_DbConn& db, const CAP_Tokens& body, 
+			  int user_id, unsigned& content_id)
 {
-  if( !errlog || !sqlconn ) { throw -1; } /* SCREW THAT JAZZ!! */
+  if( !errlog ) { throw -1; } /* SCREW THAT JAZZ!! */
 
-  /* extract individual strings from body */
-  list<string>::iterator it=body.begin();
-  filename = *it;
-  it++; /* title of content */
-
-  static PreparedStatement* pstmt_content_insert=NULL;
-  static PreparedStatement* pstmt_get_id=NULL;
-
-  if( !pstmt_content_insert ) {
-    /* has not been prepared yet--give it a shot */
-    try {
-      pstmt_content_insert = sqlconn->prepareStatement(
-        "insert into content (user_id,folder_id,add_date,status,title) "
-	"values ((?),(?),(?),'A',(?))");
-      pstmt_get_id = sqlconn->prepareStatement("select last_insert_id()");
-    }
-    catch( SQLException err ) {
-      errlog->writef("failed to generate a prepared SQL statement: what: %s, "
-        "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
-        err.getSQLState().c_str());
-      throw -1;
-    }
+  /* first line is file name (used by caller), second is title */
+  if( body.size() < 2 ) {
+    errlog->writef("message body parsing error: %d lines when 2 were "
+      "expected", LOG_ERROR, body.size());
+    return false;
   }
+  const CAP_StrRef& title = body[1];
+
+  PreparedStatement* pstmt_content_insert = db.stmt(STMT_CONTENT_INSERT);
 
   /* format date added */
   time_t t = time(NULL);
-  tm* timeptr = localtime(&t);
+  tm tmnow;
+  tm* timeptr = localtime_r(&t, &tmnow);
 
   char sz[32];
   memset(sz,'\0',32);
@@ -347,17 +251,17 @@ bool dosql_content_insert(list<string>& body, int user_id, string& filename,
     pstmt_content_insert->setInt(1, user_id);
     pstmt_content_insert->setInt(2, 1);
     pstmt_content_insert->setDateTime(3, datetime);
-    pstmt_content_insert->setString(4, (*it).c_str());
+    pstmt_content_insert->setString(4, SQLString(title.ptr, title.len));
 
     int ret;
-    if( (ret=pstmt_content_insert->executeUpdate()) != 1 ) {
-      errlog->writef("insert into content values (%d,%d,%s,%s) returned %d "
+    if( (ret=db.update(STMT_CONTENT_INSERT)) != 1 ) {
+      errlog->writef("insert into content values (%d,%d,%s,%.*s) returned %d "
         "when 1 was expected", LOG_WARNING, user_id, 1, datetime.c_str(), 
-	(*it).c_str(), ret);
+	title.len, title.ptr, ret);
     }
 
     /* get ID of content just inserted */
-    ResultSet* rs = pstmt_get_id->executeQuery();
+    CAP_Result rs(db.query(STMT_LAST_ID));
     if( !rs->next() ) {
       errlog->write("failed to get ID of inserted content",LOG_ERROR);
       return false;
@@ -365,214 +269,402 @@ bool dosql_content_insert(list<string>& body, int user_id, string& filename,
     content_id = rs->getUInt(1);
   }
   catch( SQLException err ) {
+    db.lost(err);
     errlog->writef("failed to execute an SQL statement to insert content: "
       "what: %s, code: %d, state: %s", LOG_FATAL, err.what(), 
       err.getErrorCode(), err.getSQLState().c_str());
+    return false;
   }  
 
   return true;
 }
 
 /* dosql_job_insert()
-   Inserts a new record into *job* table */
-void dosql_job_insert(const int user_id, list<string>& body)
+   Inserts a new record into *job* table; with a request key, key and job 
+   go in together */
+bool dosql_job_insert(CAP_DbConn& db, const int user_id, 
+  const CAP_Tokens& body, unsigned long long key)
 {
-  static PreparedStatement* pstmt_insert_job=NULL;
   int ret=0; /* various uses */
 
-  if( !errlog || !sqlconn ) { throw -1; } /* SCREW THAT JAZZ!! */
-
-  if( !pstmt_insert_job ) {
-    /* has not been prepared yet--give it a shot */
-    try {
-      pstmt_insert_job = sqlconn->prepareStatement(
-        "insert into job (user_id,type,status,url) values ((?),(?),\"P\",(?))");
-    }
-    catch( SQLException err ) {
-      errlog->writef("failed to generate a prepared SQL statement: what: %s, "
-        "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
-        err.getSQLState().c_str());
-      throw -1;
-    }
-  }
+  if( !errlog ) { throw -1; } /* SCREW THAT JAZZ!! */
 
-  /* check list of strings */
-  if( body.size() != 3 ) {
-    errlog->writef("message body parsing error: %d lines when "
-      "3 were expected", LOG_ERROR, body.size());
-    return;
-  }
+  PreparedStatement* pstmt_insert_job = db.stmt(STMT_JOB_INSERT);
 
   /* create job type value from request */
-  char type[2];
-  list<string>::iterator it=body.begin(); /* type string */
-
-  if( *it == "download" ) { 
-    type[0]='d';
-    it++; /* mode string */
-
-    if( *it == "single" ) { type[1]='S'; }
-    else { /* unknown request type */
-      errlog->writef("discarded unknown client request %s,%s received",
-        LOG_WARNING, (*(--it)).c_str(), (*(++it)).c_str());
-      return;
-    }
-  }
-  else { /* unknown request type */
-    errlog->writef("discarded unknown client request %s,%s received",
-      LOG_WARNING, (*it).c_str(), (*(++it)).c_str());
-    return;
-  }
+  const char* type = CAP_Store::jobType(body, errlog);
+  if( !type ) { return false; }
+
+  Connection* conn = db.get();
+  if( !conn ) { throw CAP_Exception(CAPEXC_DBGONE); }
 
-  /* now assign values to prepared statement and execute */
+  /* now assign values to prepared statement and execute; URL is copied 
+     once, by the bind */
   try {
+    if( key ) {
+      conn->setAutoCommit(false);
+      if( !dosql_request_key(db, key) ) {
+        conn->rollback();
+        conn->setAutoCommit(true);
+        return true;
+      }
+    }
+
     pstmt_insert_job->setInt(1,user_id);
     pstmt_insert_job->setString(2,type);
-    pstmt_insert_job->setString(3,*(++it));
-    if( (ret=pstmt_insert_job->executeUpdate()) != 1 ) {
+    pstmt_insert_job->setString(3,SQLString(body[2].ptr, body[2].len));
+    if( (ret=db.update(STMT_JOB_INSERT)) != 1 ) {
       errlog->writef("insert into job values (%d,%s,...) returned %d "
         "when 1 was expected", LOG_WARNING, user_id, type, ret);
+      if( key ) {
+        conn->rollback();
+        conn->setAutoCommit(true);
+      }
+      return false;
+    }
+
+    if( key ) {
+      conn->commit();
+      conn->setAutoCommit(true);
     }
   }
   catch( SQLException err ) {
+    db.lost(err);
     errlog->writef("failed to generate a prepared SQL statement: "
       "what: %s, code: %d, state: %s", LOG_FATAL, err.what(), 
       err.getErrorCode(), err.getSQLState().c_str());
+
+    /* nothing was inserted */
+    if( key ) {
+      try {
+        conn->rollback();
+        conn->setAutoCommit(true);
+      }
+      catch( SQLException& err2 ) {
+        db.lost(err2);
+      }
+    }
+    return false;
+  }
+  return true;
+}
+
+/* dosql_key_prune()
+   Forgets request keys below *key*; no request that old can be replayed */
+bool dosql_key_prune(CAP_DbConn& db, unsigned long long key) {
+  try {
+    db.stmt(STMT_KEY_PRUNE)->setUInt64(1, key);
+    db.update(STMT_KEY_PRUNE);
+  }
+  catch( SQLException& err ) {
+    db.lost(err);
+    errlog->writef("failed to prune request keys: what: %s, code: %d, "
+      "state: %s", LOG_ERROR, err.what(), err.getErrorCode(), 
+      err.getSQLState().c_str());
+    return false;
   }
+  return true;
 }
 
-/* dosql_job_select()
-   Selects the next available job from *job table */
-bool dosql_job_select(unsigned& job_id, int& user_id, string& type, string& url)
+/* dosql_job_claim()
+   Moves up to *max* waiting jobs to in-progress and appends them to 
+   *jobs*, oldest first. Rows are locked as they are selected and rows 
+   another claim has locked are skipped, so no two claims take the same 
+   job. */
+bool dosql_job_claim(CAP_DbConn& db, const unsigned max, 
+  list<JobRec>& jobs)
 {
-  static PreparedStatement* pstmt_select_job=NULL;
+  PreparedStatement* pstmt_claim_select = db.stmt(STMT_JOB_CLAIM);
+  Connection* conn = db.get();
 
-  if( !pstmt_select_job ) {
-    /* has not been prepared yet--give it a shot */
-    try {
-      pstmt_select_job = sqlconn->prepareStatement(
-        "select * from job where status=\"P\" limit 1");
+  try {
+    conn->setAutoCommit(false);
+
+    /* columns are read by position */
+    pstmt_claim_select->setUInt(1, max);
+    CAP_Result res(db.query(STMT_JOB_CLAIM));
+
+    string ids;
+    char sz[16];
+    while( res->next() ) {
+      JobRec job;
+      job.id = res->getUInt(1);
+      job.user_id = res->getInt(2);
+      job.type = res->getString(3);
+      job.url = res->getString(4);
+      jobs.push_back(job);
+
+      sprintf(sz, "%s%u", ids.empty() ? "" : ",", job.id);
+      ids.append(sz);
     }
-    catch( SQLException& err ) {
-      errlog->writef("failed to generate a prepared SQL statement: what: %s, "
-        "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
-        err.getSQLState().c_str());
-      throw -1;
+    res.reset();
+
+    /* list is digits and commas only */
+    if( !ids.empty() ) {
+      int ret = db.update(STMT_JOB_MARK, 
+        "update job set status=\"I\" where id in (" + ids + ")");
+      if( ret != (int)jobs.size() ) {
+        errlog->writef("claiming %u jobs updated %d", LOG_WARNING, 
+          (unsigned)jobs.size(), ret);
+      }
     }
-  }
 
-  /* execute query */
-  ResultSet* res=NULL;
-  try {
-    res = pstmt_select_job->executeQuery();
-
-    /* if there is a job, then return its fields */
-    if( res->next() ) {
-      job_id = res->getInt("id");
-      user_id = res->getInt("user_id");
-      type = res->getString("type");
-      url = res->getString("url");
-    }
+    conn->commit();
+    conn->setAutoCommit(true);
   }
   catch( SQLException& err ) {
-    errlog->writef("failed to select records from job table: what: %s, "
+    db.lost(err);
+    errlog->writef("failed to claim records from job table: what: %s, "
       "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
       err.getSQLState().c_str());
+    jobs.clear();
+
+    /* nothing was claimed */
+    try {
+      conn->rollback();
+      conn->setAutoCommit(true);
+    }
+    catch( SQLException& err2 ) {
+      db.lost(err2);
+    }
     return false;
   }
   return true;
 }
 
-/* dosql_job_failed()
-   Updates given job ID in database indicating that it failed */
-void dosql_job_failed(const int job_id) {
-  /* make sure caller is paying attention */
-  if( !job_id ) { throw CAP_Exception(CAPEXC_INVALPARAM); }
+/* dosql_job_retire()
+   Moves up to *max* finished or failed jobs to *job_history* in one 
+   transaction and sets *moved* to how many went. Newest job always stays 
+   behind: InnoDB may restart its ID counter from the largest ID left in 
+   the table, and a reused ID would collide with one in history. */
+bool dosql_job_retire(CAP_DbConn& db, const unsigned max, unsigned& moved) {
+  PreparedStatement* pstmt_retire_select = db.stmt(STMT_JOB_RETIRE);
+  Connection* conn = db.get();
+  moved = 0;
+
+  try {
+    conn->setAutoCommit(false);
+
+    pstmt_retire_select->setUInt(1, max);
+    CAP_Result res(db.query(STMT_JOB_RETIRE));
+
+    string ids;
+    unsigned count=0;
+    char sz[16];
+    while( res->next() ) {
+      sprintf(sz, "%s%u", ids.empty() ? "" : ",", res->getUInt(1));
+      ids.append(sz);
+      count++;
+    }
+    res.reset();
+
+    /* list is digits and commas only */
+    if( count ) {
+      int ret = db.update(STMT_JOB_HISTORY, 
+        "insert into job_history select * from job where id in (" + ids + 
+        ")");
+      if( ret != (int)count ) {
+        errlog->writef("copying %u jobs to history inserted %d", LOG_ERROR, 
+          count, ret);
+        conn->rollback();
+        conn->setAutoCommit(true);
+        return false;
+      }
+      ret = db.update(STMT_JOB_PURGE, 
+        "delete from job where id in (" + ids + ")");
+      if( ret != (int)count ) {
+        errlog->writef("deleting %u jobs moved to history returned %d", 
+          LOG_WARNING, count, ret);
+      }
+    }
 
-  static PreparedStatement* pstmt_job_failed=NULL;
+    conn->commit();
+    conn->setAutoCommit(true);
+    moved = count;
+  }
+  catch( SQLException& err ) {
+    db.lost(err);
+    errlog->writef("failed to move records to job_history table: what: %s, "
+      "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
+      err.getSQLState().c_str());
 
-  if( !pstmt_job_failed ) {
-    /* has not been prepared yet--give it a shot */
+    /* nothing was moved */
     try {
-      pstmt_job_failed = sqlconn->prepareStatement(
-        "update job set status=\"F\" where id=(?)");
+      conn->rollback();
+      conn->setAutoCommit(true);
     }
-    catch( SQLException& err ) {
-		errlog->writef("failed to generate a prepared SQL statement in "
-			"dosql_job_failed(): what: %s, code: %d, state: %s", 
-			LOG_FATAL, err.what(), err.getErrorCode(), 
-        	err.getSQLState().c_str());
-      	throw -1;
+    catch( SQLException& err2 ) {
+      db.lost(err2);
     }
+    moved = 0;
+    return false;
   }
+  return true;
+}
 
-  /* assign paramters to SQL and execute */
-  try {
-    /* set parameters */
-    pstmt_job_failed->setInt(1,job_id);
+/* append_ids()
+   Appends "(id,id,...)" to *sql*; a list of numbers may be written into a 
+   statement as it is */
+static void append_ids(string& sql, const vector<unsigned>& ids) {
+  char sz[16];
+  sql.append(1, '(');
+  for( unsigned i=0; i<ids.size(); i++ ) {
+    sprintf(sz, "%s%u", i ? "," : "", ids[i]);
+    sql.append(sz);
+  }
+  sql.append(1, ')');
+}
 
-    /* update record */
-    int ret;
-    if( (ret=pstmt_job_failed->executeUpdate()) != 1 ) {
-      errlog->writef("updating job with ID %d returned %d "
-        "when 1 was expected", LOG_WARNING, job_id, ret);
+/* dosql_job_release()
+   Moves jobs in *jobs* still in progress back to waiting, or every job in 
+   progress if *jobs* is empty, and sets *moved* to how many went */
+bool dosql_job_release(CAP_DbConn& db, const list<JobRec>& jobs, 
+  unsigned& moved)
+{
+  string sql = "update job set status=\"P\" where status=\"I\"";
+  if( !jobs.empty() ) {
+    vector<unsigned> ids;
+    for( list<JobRec>::const_iterator it=jobs.begin(); it!=jobs.end(); 
+         it++ ) {
+      ids.push_back((*it).id);
     }
+    sql.append(" and id in ");
+    append_ids(sql, ids);
   }
-  catch( SQLException err ) {
-    errlog->writef("failed to execute SQL to update job record in "
-		"dosql_job_failed(): what: %s, code: %d, state: %s", 
-		LOG_FATAL, err.what(), err.getErrorCode(), 
-		err.getSQLState().c_str());
-  }  
+
+  try {
+    moved = db.update(STMT_JOB_RELEASE, sql);
+  }
+  catch( SQLException& err ) {
+    db.lost(err);
+    errlog->writef("failed to return jobs to job table: what: %s, code: %d, "
+      "state: %s", LOG_ERROR, err.what(), err.getErrorCode(), 
+      err.getSQLState().c_str());
+    moved = 0;
+    return false;
+  }
+  return true;
 }
 
-/* dosql_job_finish()
-   Updates given job ID in database with a completion date */
-void dosql_job_finish(const int job_id) {
-  /* make sure caller is paying attention */
-  if( !job_id ) { throw CAP_Exception(CAPEXC_INVALPARAM); }
+/* dosql_status_flush()
+   Writes every status change in *set* in one transaction; one statement 
+   per table, completion date formatted once */
+bool dosql_status_flush(CAP_DbConn& db, const CAP_StatusSet& set) {
+  if( !errlog ) { throw -1; } /* SCREW THAT JAZZ!! */
 
-  static PreparedStatement* pstmt_job_finish=NULL;
+  Connection* conn = db.get();
+  if( !conn ) { throw CAP_Exception(CAPEXC_DBGONE); }
 
-  if( !pstmt_job_finish ) {
-    /* has not been prepared yet--give it a shot */
-    try {
-      pstmt_job_finish = sqlconn->prepareStatement(
-        "update job set cmpl_date=(?), status=\"C\" where id=(?)");
+  /* format completion date */
+  time_t t = time(NULL);
+  tm tmnow;
+  char datetime[32];
+  memset(datetime,'\0',32);
+  strftime(datetime,32,"'%Y-%m-%d %H:%M:%S'",localtime_r(&t, &tmnow));
+
+  try {
+    conn->setAutoCommit(false);
+
+    /* finished and failed jobs together; failed ones keep their date */
+    if( !set.jobsFinished.empty() || !set.jobsFailed.empty() ) {
+      string sql("update job set status=");
+      if( set.jobsFailed.empty() ) {
+        sql.append("\"C\", cmpl_date=");
+        sql.append(datetime);
+      }
+      else if( set.jobsFinished.empty() ) {
+        sql.append("\"F\"");
+      }
+      else {
+        sql.append("case when id in ");
+        append_ids(sql, set.jobsFailed);
+        sql.append(" then \"F\" else \"C\" end, cmpl_date=case when id in ");
+        append_ids(sql, set.jobsFailed);
+        sql.append(" then cmpl_date else ");
+        sql.append(datetime);
+        sql.append(" end");
+      }
+      sql.append(" where id in ");
+      vector<unsigned> all(set.jobsFinished);
+      all.insert(all.end(), set.jobsFailed.begin(), set.jobsFailed.end());
+      append_ids(sql, all);
+
+      int ret = db.update(STMT_STATUS_JOBS, sql);
+      if( ret != (int)all.size() ) {
+        errlog->writef("updating %u jobs returned %d", LOG_WARNING, 
+          (unsigned)all.size(), ret);
+      }
     }
-    catch( SQLException& err ) {
-      errlog->writef("failed to generate a prepared SQL statement: what: %s, "
-        "code: %d, state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
-        err.getSQLState().c_str());
-      throw -1;
+
+    if( !set.archivesFinished.empty() ) {
+      string sql("update archive set cmpl_date=");
+      sql.append(datetime);
+      sql.append(" where id in ");
+      append_ids(sql, set.archivesFinished);
+
+      int ret = db.update(STMT_STATUS_ARCHIVES, sql);
+      if( ret != (int)set.archivesFinished.size() ) {
+        errlog->writef("updating %u archives returned %d", LOG_WARNING, 
+          (unsigned)set.archivesFinished.size(), ret);
+      }
     }
-  }
 
-  /* assign paramters to SQL and execute */
-  try {
-    /* format completion date */
-    time_t t = time(NULL);
-    tm* timeptr = localtime(&t);
+    if( !set.contentDeleted.empty() ) {
+      string sql("update content set status='D' where id in ");
+      append_ids(sql, set.contentDeleted);
 
-    char sz[32];
-    memset(sz,'\0',32);
-    strftime(sz,32,"%Y-%m-%d %H:%M:%S",timeptr);
-    string datetime(sz);
+      int ret = db.update(STMT_STATUS_DELETE, sql);
+      if( ret != (int)set.contentDeleted.size() ) {
+        errlog->writef("deleting %u content items returned %d", LOG_WARNING, 
+          (unsigned)set.contentDeleted.size(), ret);
+      }
+    }
 
-    /* set parameters */
-    pstmt_job_finish->setDateTime(1,datetime);
-    pstmt_job_finish->setInt(2,job_id);
+    /* titles are bound, never written into statement */
+    if( !set.contentRenamed.empty() ) {
+      string sql("update content set title=case id");
+      vector<unsigned> ids;
+      char sz[32];
+      for( list<ContentRec>::const_iterator it=set.contentRenamed.begin();
+           it!=set.contentRenamed.end(); it++ ) {
+        sprintf(sz, " when %u then ?", (*it).id);
+        sql.append(sz);
+        ids.push_back((*it).id);
+      }
+      sql.append(" end where id in ");
+      append_ids(sql, ids);
+
+      CAP_SqlPtr<PreparedStatement> pstmt(conn->prepareStatement(sql));
+      int n=1;
+      for( list<ContentRec>::const_iterator it=set.contentRenamed.begin();
+           it!=set.contentRenamed.end(); it++ ) {
+        pstmt->setString(n++, (*it).title);
+      }
+      int ret = db.update(STMT_STATUS_RENAME, pstmt.get());
+      if( ret != (int)ids.size() ) {
+        errlog->writef("renaming %u content items returned %d", LOG_WARNING, 
+          (unsigned)ids.size(), ret);
+      }
+    }
 
-    /* update record */
-    int ret;
-    if( (ret=pstmt_job_finish->executeUpdate()) != 1 ) {
-      errlog->writef("updating job with ID %d returned %d "
-        "when 1 was expected", LOG_WARNING, job_id, ret);
+    conn->commit();
+    conn->setAutoCommit(true);
+  }
+  catch( SQLException& err ) {
+    db.lost(err);
+    errlog->writef("failed to write status changes: what: %s, code: %d, "
+      "state: %s", LOG_FATAL, err.what(), err.getErrorCode(), 
+      err.getSQLState().c_str());
+
+    /* nothing was written */
+    try {
+      conn->rollback();
+      conn->setAutoCommit(true);
     }
+    catch( SQLException& err2 ) {
+      db.lost(err2);
+    }
+    return false;
   }
-  catch( SQLException err ) {
-    errlog->writef("failed to execute SQL to update job record: "
-      "what: %s, code: %d, state: %s", LOG_FATAL, err.what(), 
-      err.getErrorCode(), err.getSQLState().c_str());
-  }  
+  return true;
 }
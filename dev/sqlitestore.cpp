@@ -0,0 +1,587 @@
+/*******************************************************************************
+  File Name: sqlitestore.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_SqliteStore class
+*******************************************************************************/
+#include "sqlitestore.h"
+#include <time.h>
+#include <string.h>
+using namespace std;
+
+#define LITE_BUSY_MSEC 5000 /* how long a write waits on another process
+                               holding the file */
+
+/* tables, created if missing; same columns the MySQL store uses, and the 
+   indexes capmigrate adds to a MySQL database */
+static const char* const lite_schema =
+  "create table if not exists job ("
+    "id integer primary key autoincrement, user_id integer not null, "
+    "type char(2) not null, status char(1) not null, url text not null, "
+    "cmpl_date datetime);"
+  "create table if not exists job_history ("
+    "id integer primary key, user_id integer not null, "
+    "type char(2) not null, status char(1) not null, url text not null, "
+    "cmpl_date datetime);"
+  "create table if not exists request_key ("
+    "id integer primary key);"
+  "create table if not exists content ("
+    "id integer primary key autoincrement, user_id integer not null, "
+    "folder_id integer, add_date datetime, status char(1) not null, "
+    "title text);"
+  "create table if not exists archive ("
+    "id integer primary key, cmpl_date datetime);"
+  "create table if not exists archive_content ("
+    "archive_id integer not null, content_id integer not null);"
+  "create index if not exists job_status_id on job (status, id);"
+  "create index if not exists archive_pending on archive (cmpl_date);"
+  "create index if not exists archive_content_archive on archive_content "
+    "(archive_id, content_id);";
+
+/* every statement, by LiteStmt */
+static const CAP_SqlDef lite_defs[LITE_MAX] = {
+  { "begin", "begin immediate" },
+  { "commit", "commit" },
+  { "rollback", "rollback" },
+  { "job_insert",
+    "insert into job (user_id,type,status,url) values (?,?,'P',?)" },
+  { "job_claim",
+    "select id, user_id, type, url from job where status='P' "
+    "order by id limit ?" },
+  { "job_mark", "update job set status='I' where id=?" },
+  { "job_finish", "update job set status='C', cmpl_date=? where id=?" },
+  { "job_fail", "update job set status='F' where id=?" },
+  { "job_retire",
+    "select id from job where status in ('C','F') limit ?" },
+  { "job_history", "insert into job_history select * from job where id=?" },
+  { "job_purge", "delete from job where id=?" },
+  { "job_release", "update job set status='P' where id=? and status='I'" },
+  { "job_release_all", "update job set status='P' where status='I'" },
+  { "request_key", "insert or ignore into request_key (id) values (?)" },
+  { "key_prune", "delete from request_key where id<?" },
+  { "content_insert",
+    "insert into content (user_id,folder_id,add_date,status,title) "
+    "values (?,1,?,'A',?)" },
+  { "content_delete", "update content set status='D' where id=?" },
+  { "content_rename", "update content set title=? where id=?" },
+  { "archive_insert", "insert into archive (id) values (?)" },
+  { "archive_item",
+    "insert into archive_content (archive_id,content_id) values (?,?)" },
+  { "archive_select",
+    "select pending.id, pending.user_id, item.id, item.title "
+    "from (select archive.id, content.user_id "
+      "from archive inner join content on content.id=archive.id "
+      "where archive.cmpl_date is null limit 1) pending "
+    "left join archive_content on archive_content.archive_id=pending.id "
+    "left join content item on item.id=archive_content.content_id" },
+  { "archive_finish", "update archive set cmpl_date=? where id=?" }
+};
+
+/* usec_now()
+   Monotonic clock in microseconds */
+static unsigned long usec_now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000UL + ts.tv_nsec/1000;
+}
+
+/* format_now()
+   Current local time as SQL datetime */
+static void format_now(char* sz, int len) {
+  time_t t = time(NULL);
+  tm tmnow;
+  memset(sz, '\0', len);
+  strftime(sz, len, "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tmnow));
+}
+
+/* Resets a statement and drops its bindings when it goes out of scope, so
+   it is ready for next use whichever way this one ended */
+class CAP_LiteReset {
+ protected:
+  sqlite3_stmt* stmt;
+
+ public:
+  inline CAP_LiteReset(sqlite3_stmt* _stmt) : stmt(_stmt) {}
+  inline ~CAP_LiteReset() {
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
+};
+
+/* CAP_SqliteStore::CAP_SqliteStore()
+   Constructor; file is not opened until open() */
+CAP_SqliteStore::CAP_SqliteStore(CAP_Log* _errlog, const string& _file)
+  : CAP_Store(_errlog), strFile(_file), db(NULL), busy(false)
+{
+  for( int i=0; i<LITE_MAX; i++ ) { stmts[i]=NULL; }
+}
+
+/* CAP_SqliteStore::~CAP_SqliteStore()
+   Destructor; closes file */
+CAP_SqliteStore::~CAP_SqliteStore() {
+  for( int i=0; i<LITE_MAX; i++ ) {
+    sqlite3_finalize(stmts[i]);
+  }
+  sqlite3_close(db);
+}
+
+/* CAP_SqliteStore::open()
+   Opens database file, creating it and its tables if need be, and
+   prepares every statement; throws -1 on failure. *size* is ignored as
+   one thread does all the writing. */
+void CAP_SqliteStore::open(int size) {
+  int rc = sqlite3_open_v2(strFile.c_str(), &db, SQLITE_OPEN_READWRITE |
+    SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL);
+  if( rc != SQLITE_OK ) {
+    errlog->writef("failed to open database file %s: %s", LOG_FATAL,
+      strFile.c_str(), db ? sqlite3_errmsg(db) : sqlite3_errstr(rc));
+    throw -1;
+  }
+  sqlite3_busy_timeout(db, LITE_BUSY_MSEC);
+
+  /* WAL lets readers in while a write is going; a commit need only reach
+     the log, and the log is synced at checkpoints */
+  char* err=NULL;
+  if( sqlite3_exec(db, "pragma journal_mode=wal; pragma synchronous=normal;",
+        NULL, NULL, &err) != SQLITE_OK ||
+      sqlite3_exec(db, lite_schema, NULL, NULL, &err) != SQLITE_OK ) {
+    errlog->writef("failed to set up database file %s: %s", LOG_FATAL,
+      strFile.c_str(), err ? err : "");
+    sqlite3_free(err);
+    throw -1;
+  }
+
+  for( int i=0; i<LITE_MAX; i++ ) {
+    if( sqlite3_prepare_v2(db, lite_defs[i].text, -1, &stmts[i], NULL) !=
+        SQLITE_OK ) {
+      errlog->writef("failed to generate prepared SQL statement %s: %s",
+        LOG_FATAL, lite_defs[i].name, sqlite3_errmsg(db));
+      throw -1;
+    }
+  }
+  errlog->writef("opened database file %s", LOG_INFO, strFile.c_str());
+}
+
+/* CAP_SqliteStore::step()
+   Steps statement *id* once; *first* counts an execution rather than
+   another row of one. Returns SQLITE_ROW, SQLITE_DONE or an error, which
+   is logged; one from another process holding a lock is noted in busy. */
+int CAP_SqliteStore::step(LiteStmt id, bool first) {
+  unsigned long start = usec_now();
+  int rc = sqlite3_step(stmts[id]);
+  unsigned long spent = usec_now()-start;
+
+  CAP_SqlStat& stat = stats[id];
+  if( first ) { stat.calls++; }
+  stat.usecs += spent;
+  if( spent > stat.maxUsecs ) { stat.maxUsecs = spent; }
+  if( spent > CAP_DB_SLOW_MSEC*1000UL ) {
+    errlog->writef("statement %s took %lu usec", LOG_WARNING,
+      lite_defs[id].name, spent);
+  }
+
+  if( rc != SQLITE_ROW && rc != SQLITE_DONE ) {
+    stat.errors++;
+    if( (rc & 0xff) == SQLITE_BUSY || (rc & 0xff) == SQLITE_LOCKED ) {
+      busy = true;
+    }
+    errlog->writef("failed to execute SQL statement %s: %s", LOG_ERROR,
+      lite_defs[id].name, sqlite3_errmsg(db));
+  }
+  return rc;
+}
+
+/* CAP_SqliteStore::exec()
+   Runs statement *id*, which returns no rows, with parameters already
+   bound; false on failure */
+bool CAP_SqliteStore::exec(LiteStmt id) {
+  CAP_LiteReset reset(stmts[id]);
+  return step(id, true) == SQLITE_DONE;
+}
+
+/* CAP_SqliteStore::begin()
+   Starts a transaction, taking write lock at once */
+bool CAP_SqliteStore::begin() {
+  return exec(LITE_BEGIN);
+}
+
+/* CAP_SqliteStore::commit()
+   Commits transaction; rolls back if that fails */
+bool CAP_SqliteStore::commit() {
+  if( exec(LITE_COMMIT) ) { return true; }
+  rollback();
+  return false;
+}
+
+/* CAP_SqliteStore::rollback()
+   Abandons transaction, if one is still open */
+void CAP_SqliteStore::rollback() {
+  if( !sqlite3_get_autocommit(db) ) { exec(LITE_ROLLBACK); }
+}
+
+/* CAP_SqliteStore::run()
+   Runs one operation; failures are recorded in it, and are transient if
+   database was locked */
+void CAP_SqliteStore::run(CAP_DbOp& op) {
+  CAP_Tokens toks;
+  busy = false;
+
+  switch( op.kind ) {
+  case DBOP_JOB_INSERT:
+    cap_tokenize(op.body, toks);
+    op.ok = jobInsert(op.user_id, toks, op.key);
+    break;
+  case DBOP_JOB_CLAIM:
+    op.ok = jobClaim(op.id, op.jobs);
+    break;
+  case DBOP_CONTENT_INSERT:
+    cap_tokenize(op.body, toks);
+    op.ok = contentInsert(toks, op.user_id, op.id);
+    break;
+  case DBOP_ARCHIVE_INSERT:
+    op.ok = archiveInsert(op.user_id, op.body, op.key);
+    break;
+  case DBOP_ARCHIVE_SELECT:
+    op.ok = archiveSelect(op);
+    break;
+  case DBOP_STATUS_FLUSH:
+    op.ok = statusFlush(op.status);
+    break;
+  case DBOP_JOB_RETIRE:
+    {
+      unsigned moved=0;
+      op.ok = jobRetire(op.id, moved);
+      op.id = moved;
+    }
+    break;
+  case DBOP_KEY_PRUNE:
+    sqlite3_bind_int64(stmts[LITE_KEY_PRUNE], 1, op.key);
+    op.ok = exec(LITE_KEY_PRUNE);
+    break;
+  case DBOP_JOB_RELEASE:
+    {
+      unsigned moved=0;
+      op.ok = jobRelease(op.jobs, moved);
+      op.id = moved;
+    }
+    break;
+  default:
+    errlog->writef("unknown database operation %d", LOG_ERROR,
+      (int)op.kind);
+    op.ok = false;
+    break;
+  }
+  if( !op.ok ) { op.transient = busy; }
+}
+
+/* CAP_SqliteStore::requestKey()
+   Records request key *key* inside caller's transaction. Returns 1 if
+   recorded, 0 if it was already there, meaning the request went in
+   before, and -1 on failure. */
+int CAP_SqliteStore::requestKey(unsigned long long key) {
+  sqlite3_bind_int64(stmts[LITE_REQUEST_KEY], 1, key);
+  if( !exec(LITE_REQUEST_KEY) ) { return -1; }
+  if( sqlite3_changes(db) == 1 ) { return 1; }
+
+  errlog->writef("request %llu was already applied; skipped", LOG_INFO, key);
+  return 0;
+}
+
+/* CAP_SqliteStore::jobInsert()
+   Inserts a new record into *job* table; with a request key, key and job
+   go in together */
+bool CAP_SqliteStore::jobInsert(int user_id, const CAP_Tokens& body,
+  unsigned long long key)
+{
+  const char* type = jobType(body, errlog);
+  if( !type ) { return false; }
+
+  if( key ) {
+    if( !begin() ) { return false; }
+    int ret = requestKey(key);
+    if( ret != 1 ) {
+      rollback();
+      return ret == 0;
+    }
+  }
+
+  /* URL stays in op's body until statement is reset */
+  sqlite3_stmt* s = stmts[LITE_JOB_INSERT];
+  sqlite3_bind_int(s, 1, user_id);
+  sqlite3_bind_text(s, 2, type, -1, SQLITE_STATIC);
+  sqlite3_bind_text(s, 3, body[2].ptr, body[2].len, SQLITE_STATIC);
+  if( !exec(LITE_JOB_INSERT) ) {
+    rollback();
+    return false;
+  }
+  return !key || commit();
+}
+
+/* CAP_SqliteStore::jobClaim()
+   Moves up to *max* waiting jobs to in-progress and appends them to
+   *jobs*, oldest first. Write lock is held from the select on, so no
+   other process can claim the same jobs. */
+bool CAP_SqliteStore::jobClaim(unsigned max, list<JobRec>& jobs) {
+  if( !begin() ) { return false; }
+
+  {
+    sqlite3_stmt* s = stmts[LITE_JOB_CLAIM];
+    CAP_LiteReset reset(s);
+    sqlite3_bind_int64(s, 1, max);
+    int rc;
+    for( bool first=true; (rc=step(LITE_JOB_CLAIM, first)) == SQLITE_ROW;
+         first=false ) {
+      JobRec job;
+      job.id = sqlite3_column_int64(s, 0);
+      job.user_id = sqlite3_column_int(s, 1);
+      job.type.assign((const char*)sqlite3_column_text(s, 2));
+      job.url.assign((const char*)sqlite3_column_text(s, 3));
+      jobs.push_back(job);
+    }
+    if( rc != SQLITE_DONE ) {
+      rollback();
+      jobs.clear();
+      return false;
+    }
+  }
+
+  for( list<JobRec>::iterator it=jobs.begin(); it!=jobs.end(); it++ ) {
+    sqlite3_bind_int64(stmts[LITE_JOB_MARK], 1, (*it).id);
+    if( !exec(LITE_JOB_MARK) ) {
+      rollback();
+      jobs.clear();
+      return false;
+    }
+  }
+
+  if( !commit() ) {
+    jobs.clear();
+    return false;
+  }
+  return true;
+}
+
+/* CAP_SqliteStore::jobRetire()
+   Moves up to *max* finished or failed jobs to *job_history* in one
+   transaction and sets *moved* to how many went. IDs are never reused, so
+   history cannot collide with a later job. */
+bool CAP_SqliteStore::jobRetire(unsigned max, unsigned& moved) {
+  moved = 0;
+  if( !begin() ) { return false; }
+
+  vector<sqlite3_int64> ids;
+  {
+    sqlite3_stmt* s = stmts[LITE_JOB_RETIRE];
+    CAP_LiteReset reset(s);
+    sqlite3_bind_int64(s, 1, max);
+    int rc;
+    for( bool first=true; (rc=step(LITE_JOB_RETIRE, first)) == SQLITE_ROW;
+         first=false ) {
+      ids.push_back(sqlite3_column_int64(s, 0));
+    }
+    if( rc != SQLITE_DONE ) {
+      rollback();
+      return false;
+    }
+  }
+
+  for( unsigned i=0; i<ids.size(); i++ ) {
+    sqlite3_bind_int64(stmts[LITE_JOB_HISTORY], 1, ids[i]);
+    sqlite3_bind_int64(stmts[LITE_JOB_PURGE], 1, ids[i]);
+    if( !exec(LITE_JOB_HISTORY) || !exec(LITE_JOB_PURGE) ) {
+      rollback();
+      return false;
+    }
+  }
+
+  if( !commit() ) { return false; }
+  moved = ids.size();
+  return true;
+}
+
+/* CAP_SqliteStore::jobRelease()
+   Moves jobs in *jobs* still in progress back to waiting, or every job in
+   progress if *jobs* is empty, and sets *moved* to how many went */
+bool CAP_SqliteStore::jobRelease(const list<JobRec>& jobs, unsigned& moved) {
+  moved = 0;
+  if( jobs.empty() ) {
+    if( !exec(LITE_JOB_RELEASE_ALL) ) { return false; }
+    moved = sqlite3_changes(db);
+    return true;
+  }
+
+  if( !begin() ) { return false; }
+  unsigned count=0;
+  for( list<JobRec>::const_iterator it=jobs.begin(); it!=jobs.end(); it++ ) {
+    sqlite3_bind_int64(stmts[LITE_JOB_RELEASE], 1, (*it).id);
+    if( !exec(LITE_JOB_RELEASE) ) {
+      rollback();
+      return false;
+    }
+    count += sqlite3_changes(db);
+  }
+
+  if( !commit() ) { return false; }
+  moved = count;
+  return true;
+}
+
+/* CAP_SqliteStore::contentInsert()
+   Inserts a new content item; first line of body is file name (used by
+   caller), second is title */
+bool CAP_SqliteStore::contentInsert(const CAP_Tokens& body, int user_id,
+  unsigned& content_id)
+{
+  if( body.size() < 2 ) {
+    errlog->writef("message body parsing error: %d lines when 2 were "
+      "expected", LOG_ERROR, body.size());
+    return false;
+  }
+
+  char datetime[32];
+  format_now(datetime, 32);
+
+  sqlite3_stmt* s = stmts[LITE_CONTENT_INSERT];
+  sqlite3_bind_int(s, 1, user_id);
+  sqlite3_bind_text(s, 2, datetime, -1, SQLITE_STATIC);
+  sqlite3_bind_text(s, 3, body[1].ptr, body[1].len, SQLITE_STATIC);
+  if( !exec(LITE_CONTENT_INSERT) ) { return false; }
+
+  content_id = sqlite3_last_insert_rowid(db);
+  return true;
+}
+
+/* CAP_SqliteStore::archiveInsert()
+   Inserts a new archive; first line of body is its title, any number of
+   content IDs follow. Archive, its content record and its items go in
+   together or not at all. */
+bool CAP_SqliteStore::archiveInsert(int user_id, const CAP_StrRef& body,
+  unsigned long long key)
+{
+  CAP_LineIter it(body);
+  CAP_StrRef line;
+  it.next(line);
+
+  /* an archive is content whose file name and title are both its title */
+  CAP_Tokens newbody;
+  newbody.tok[0] = line;
+  newbody.tok[1] = line;
+  newbody.count = 2;
+
+  if( !begin() ) { return false; }
+
+  if( key ) {
+    int ret = requestKey(key);
+    if( ret != 1 ) {
+      rollback();
+      return ret == 0;
+    }
+  }
+
+  unsigned archive_id=0;
+  if( !contentInsert(newbody, user_id, archive_id) ) {
+    rollback();
+    return false;
+  }
+
+  sqlite3_bind_int64(stmts[LITE_ARCHIVE_INSERT], 1, archive_id);
+  if( !exec(LITE_ARCHIVE_INSERT) ) {
+    rollback();
+    return false;
+  }
+
+  unsigned long rows=0;
+  sqlite3_stmt* s = stmts[LITE_ARCHIVE_ITEM];
+  while( it.next(line) ) {
+    sqlite3_bind_int64(s, 1, archive_id);
+    sqlite3_bind_int64(s, 2, cap_touint(line));
+    if( !exec(LITE_ARCHIVE_ITEM) ) {
+      rollback();
+      return false;
+    }
+    rows++;
+  }
+
+  if( !commit() ) { return false; }
+  errlog->writef("inserted archive %u with %lu items", LOG_INFO,
+    archive_id, rows);
+  return true;
+}
+
+/* CAP_SqliteStore::archiveSelect()
+   Selects next archive which has yet to be created, with its content, in
+   one statement; each item goes to op's row callback as it is stepped */
+bool CAP_SqliteStore::archiveSelect(CAP_DbOp& op) {
+  sqlite3_stmt* s = stmts[LITE_ARCHIVE_SELECT];
+  CAP_LiteReset reset(s);
+  int rc = step(LITE_ARCHIVE_SELECT, true);
+  if( rc != SQLITE_ROW ) { return false; }
+  op.id = sqlite3_column_int64(s, 0);
+  op.user_id = sqlite3_column_int(s, 1);
+
+  ContentRec rec;
+  do {
+    /* an archive with no items, or an item since removed, is null */
+    if( sqlite3_column_type(s, 2) == SQLITE_NULL ) { continue; }
+    rec.id = sqlite3_column_int64(s, 2);
+    const unsigned char* title = sqlite3_column_text(s, 3);
+    rec.title.assign(title ? (const char*)title : "");
+    op.emit(rec);
+  } while( (rc=step(LITE_ARCHIVE_SELECT, false)) == SQLITE_ROW );
+  return rc == SQLITE_DONE;
+}
+
+/* CAP_SqliteStore::statusFlush()
+   Writes every status change in *set* in one transaction; completion
+   date formatted once */
+bool CAP_SqliteStore::statusFlush(const CAP_StatusSet& set) {
+  char datetime[32];
+  format_now(datetime, 32);
+
+  if( !begin() ) { return false; }
+
+  bool ok = true;
+  for( unsigned i=0; ok && i<set.jobsFinished.size(); i++ ) {
+    sqlite3_bind_text(stmts[LITE_JOB_FINISH], 1, datetime, -1,
+      SQLITE_STATIC);
+    sqlite3_bind_int64(stmts[LITE_JOB_FINISH], 2, set.jobsFinished[i]);
+    ok = exec(LITE_JOB_FINISH);
+  }
+  for( unsigned i=0; ok && i<set.jobsFailed.size(); i++ ) {
+    sqlite3_bind_int64(stmts[LITE_JOB_FAIL], 1, set.jobsFailed[i]);
+    ok = exec(LITE_JOB_FAIL);
+  }
+  for( unsigned i=0; ok && i<set.archivesFinished.size(); i++ ) {
+    sqlite3_bind_text(stmts[LITE_ARCHIVE_FINISH], 1, datetime, -1,
+      SQLITE_STATIC);
+    sqlite3_bind_int64(stmts[LITE_ARCHIVE_FINISH], 2,
+      set.archivesFinished[i]);
+    ok = exec(LITE_ARCHIVE_FINISH);
+  }
+  for( unsigned i=0; ok && i<set.contentDeleted.size(); i++ ) {
+    sqlite3_bind_int64(stmts[LITE_CONTENT_DELETE], 1, set.contentDeleted[i]);
+    ok = exec(LITE_CONTENT_DELETE);
+  }
+  for( list<ContentRec>::const_iterator it=set.contentRenamed.begin();
+       ok && it!=set.contentRenamed.end(); it++ ) {
+    const string& title = (*it).title;
+    sqlite3_bind_text(stmts[LITE_CONTENT_RENAME], 1, title.data(),
+      title.length(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmts[LITE_CONTENT_RENAME], 2, (*it).id);
+    ok = exec(LITE_CONTENT_RENAME);
+  }
+
+  if( !ok ) {
+    rollback();
+    return false;
+  }
+  return commit();
+}
+
+/* CAP_SqliteStore::logStats()
+   Writes counters of every statement which has run to log */
+void CAP_SqliteStore::logStats() const {
+  for( int i=0; i<LITE_MAX; i++ ) {
+    stats[i].logStats(errlog, lite_defs[i].name);
+  }
+}
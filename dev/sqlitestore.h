@@ -0,0 +1,85 @@
+/*******************************************************************************
+  File Name: sqlitestore.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Store kept in an embedded SQLite database file
+*******************************************************************************/
+#ifndef _SQLITESTORE_H_
+#define _SQLITESTORE_H_
+
+#include "store.h"
+#include <sqlite3.h>
+#include <string>
+using namespace std;
+
+/* statements SQLite store prepares; text is in sqlitestore.cpp */
+enum LiteStmt {
+  LITE_BEGIN=0,
+  LITE_COMMIT,
+  LITE_ROLLBACK,
+  LITE_JOB_INSERT,
+  LITE_JOB_CLAIM,
+  LITE_JOB_MARK,
+  LITE_JOB_FINISH,
+  LITE_JOB_FAIL,
+  LITE_JOB_RETIRE,
+  LITE_JOB_HISTORY,
+  LITE_JOB_PURGE,
+  LITE_JOB_RELEASE,
+  LITE_JOB_RELEASE_ALL,
+  LITE_REQUEST_KEY,
+  LITE_KEY_PRUNE,
+  LITE_CONTENT_INSERT,
+  LITE_CONTENT_DELETE,
+  LITE_CONTENT_RENAME,
+  LITE_ARCHIVE_INSERT,
+  LITE_ARCHIVE_ITEM,
+  LITE_ARCHIVE_SELECT,
+  LITE_ARCHIVE_FINISH,
+  LITE_MAX
+};
+
+/* One database file in WAL mode, so readers outside Master Program never
+   block its writes. Every statement is prepared once by open() and reset
+   after each use. There is no server to share work with, so operations
+   run one at a time on a single database thread; a statement costs a
+   function call rather than a round trip, so batches are written a row
+   per statement inside one transaction. Tables are created if the file
+   does not yet have them. */
+class CAP_SqliteStore : public CAP_Store {
+ protected:
+  string strFile;                /* path of database file */
+  sqlite3* db;                   /* NULL until open() */
+  sqlite3_stmt* stmts[LITE_MAX]; /* prepared by open() */
+  CAP_SqlStat stats[LITE_MAX];   /* counters by statement */
+  bool busy;                     /* current operation found database 
+                                    locked */
+
+  int step(LiteStmt id, bool first);
+  bool exec(LiteStmt id);
+  bool begin();
+  bool commit();
+  void rollback();
+  int requestKey(unsigned long long key);
+  bool jobInsert(int user_id, const CAP_Tokens& body,
+    unsigned long long key);
+  bool jobClaim(unsigned max, list<JobRec>& jobs);
+  bool jobRetire(unsigned max, unsigned& moved);
+  bool jobRelease(const list<JobRec>& jobs, unsigned& moved);
+  bool contentInsert(const CAP_Tokens& body, int user_id, unsigned& id);
+  bool archiveInsert(int user_id, const CAP_StrRef& body,
+    unsigned long long key);
+  bool archiveSelect(CAP_DbOp& op);
+  bool statusFlush(const CAP_StatusSet& set);
+
+ public:
+  CAP_SqliteStore(CAP_Log* _errlog, const string& _file);
+  ~CAP_SqliteStore();
+
+  void open(int size);
+  inline int threads() const { return 1; }
+  void run(CAP_DbOp& op);
+  void logStats() const;
+};
+
+#endif /* _SQLITESTORE_H_ */
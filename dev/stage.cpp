@@ -0,0 +1,218 @@
+/*******************************************************************************
+  File Name: stage.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_Stager class
+*******************************************************************************/
+#include "stage.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <limits.h>
+#include <sys/sendfile.h>
+using namespace std;
+
+/* CAP_Stager::CAP_Stager()
+   Constructor; thread is not started until start() */
+CAP_Stager::CAP_Stager(CAP_Log* _errlog, const string& _content_dir,
+  const string& _archive_dir)
+  : errlog(_errlog), content_dir(_content_dir), archive_dir(_archive_dir),
+    started(false), stopping(false), items(0), wakeD(-1), staged(NULL),
+    ctx(NULL)
+{
+  if( !errlog ) { throw CAP_Exception(CAPEXC_NOERRLOG); }
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&ready, NULL);
+  pthread_cond_init(&room, NULL);
+}
+
+/* CAP_Stager::~CAP_Stager()
+   Destructor; drops whatever is still queued */
+CAP_Stager::~CAP_Stager() {
+  stop();
+  pthread_cond_destroy(&room);
+  pthread_cond_destroy(&ready);
+  pthread_mutex_destroy(&lock);
+}
+
+/* CAP_Stager::start()
+   Registers completion wakeup with event loop and starts thread */
+void CAP_Stager::start(CAP_EventLoop* events, PCAP_StagedProc _staged,
+  void* _ctx)
+{
+  staged = _staged;
+  ctx = _ctx;
+  wakeD = events->addWakeup(onDone, this);
+
+  int err = pthread_create(&thread, NULL, threadMain, this);
+  if( err ) {
+    errlog->writef("failed to start staging thread: %d", LOG_FATAL, err);
+    throw -1;
+  }
+  started = true;
+}
+
+/* CAP_Stager::push()
+   Queues one content item; waits while queue is full. Called on a
+   database thread. */
+void CAP_Stager::push(const ContentRec& rec) {
+  CAP_StageItem item;
+  item.archive_id = 0;
+  item.failed = 0;
+  item.rec = rec;
+
+  pthread_mutex_lock(&lock);
+  while( items >= CAP_STAGE_QUEUE_MAX && !stopping ) {
+    pthread_cond_wait(&room, &lock);
+  }
+  if( !stopping ) {
+    queue.push_back(item);
+    items++;
+    pthread_cond_signal(&ready);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+/* CAP_Stager::finish()
+   Marks end of *archive_id*'s items; its completion is called once every
+   item queued before now has been copied. Never waits, as it is called
+   on event loop's thread. */
+void CAP_Stager::finish(unsigned archive_id) {
+  CAP_StageItem item;
+  item.archive_id = archive_id;
+  item.failed = 0;
+
+  pthread_mutex_lock(&lock);
+  queue.push_back(item);
+  pthread_cond_signal(&ready);
+  pthread_mutex_unlock(&lock);
+}
+
+/* CAP_Stager::complete()
+   Calls completion of every archive whose items have all been copied */
+void CAP_Stager::complete() {
+  deque<CAP_StageItem> batch;
+  pthread_mutex_lock(&lock);
+  batch.swap(done);
+  pthread_mutex_unlock(&lock);
+
+  for( deque<CAP_StageItem>::iterator it=batch.begin(); it!=batch.end();
+       it++ ) {
+    if( staged ) { (*staged)((*it).archive_id, (*it).failed, ctx); }
+  }
+}
+
+/* CAP_Stager::stop()
+   Waits for thread to finish the item it is copying and exit; anything
+   still queued is dropped and its completion never called. A database
+   thread waiting for room goes on without queuing. */
+void CAP_Stager::stop() {
+  pthread_mutex_lock(&lock);
+  stopping = true;
+  pthread_cond_broadcast(&ready);
+  pthread_cond_broadcast(&room);
+  pthread_mutex_unlock(&lock);
+
+  if( started ) {
+    pthread_join(thread, NULL);
+    started = false;
+  }
+  queue.clear();
+  items = 0;
+}
+
+/* CAP_Stager::threadMain()
+   Staging thread; copies items in the order queued until stopped */
+void* CAP_Stager::threadMain(void* arg) {
+  CAP_Stager* st = (CAP_Stager*)arg;
+  unsigned long failed=0; /* items of current archive not copied */
+
+  /* signals belong to event loop's signalfd */
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+  pthread_mutex_lock(&st->lock);
+  for(;;) {
+    while( st->queue.empty() && !st->stopping ) {
+      pthread_cond_wait(&st->ready, &st->lock);
+    }
+    if( st->stopping ) { break; }
+
+    CAP_StageItem item = st->queue.front();
+    st->queue.pop_front();
+
+    /* end of an archive; loop is raised only when done goes from empty */
+    if( item.archive_id ) {
+      item.failed = failed;
+      failed = 0;
+      bool idle = st->done.empty();
+      st->done.push_back(item);
+      if( idle && st->wakeD != -1 ) { CAP_EventLoop::wake(st->wakeD); }
+      continue;
+    }
+
+    st->items--;
+    pthread_cond_signal(&st->room);
+    pthread_mutex_unlock(&st->lock);
+
+    if( !st->copy(item.rec) ) { failed++; }
+
+    pthread_mutex_lock(&st->lock);
+  }
+  pthread_mutex_unlock(&st->lock);
+  return NULL;
+}
+
+/* CAP_Stager::onDone()
+   Wakeup handler; calls completions */
+void CAP_Stager::onDone(int fd, unsigned events, void* ctx) {
+  ((CAP_Stager*)ctx)->complete();
+}
+
+/* CAP_Stager::copy()
+   Copies one content item into directory for archiving, named for its ID
+   and title; false if it could not be. A slash in the title would reach
+   outside that directory, so it becomes an underscore. */
+bool CAP_Stager::copy(const ContentRec& rec) {
+  string title(rec.title);
+  for( string::size_type i=0; i<title.length(); i++ ) {
+    if( title[i] == '/' ) { title[i] = '_'; }
+  }
+
+  char src[PATH_MAX], dst[PATH_MAX];
+  if( snprintf(src, PATH_MAX, "%s%010u.html", content_dir.c_str(),
+        rec.id) >= PATH_MAX ||
+      snprintf(dst, PATH_MAX, "%s%u-%s.html", archive_dir.c_str(),
+        rec.id, title.c_str()) >= PATH_MAX ) {
+    errlog->writef("path of content %u is too long to archive", LOG_ERROR,
+      rec.id);
+    return false;
+  }
+
+  int inD = open(src, O_RDONLY|O_CLOEXEC);
+  if( inD == -1 ) {
+    errlog->writef("failed to open content %s: %d", LOG_ERROR, src, errno);
+    return false;
+  }
+  int outD = open(dst, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, CAP_FILE_MASK);
+  if( outD == -1 ) {
+    errlog->writef("failed to create %s: %d", LOG_ERROR, dst, errno);
+    close(inD);
+    return false;
+  }
+
+  /* kernel moves the bytes; nothing passes through a buffer of ours */
+  ssize_t n;
+  while( (n=sendfile(outD, inD, NULL, 1<<20)) > 0 ||
+         (n == -1 && errno == EINTR) ) {}
+  if( n == -1 ) {
+    errlog->writef("failed to copy %s to %s: %d", LOG_ERROR, src, dst,
+      errno);
+  }
+  close(inD);
+  if( close(outD) == -1 ) { n = -1; }
+  return n == 0;
+}
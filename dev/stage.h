@@ -0,0 +1,73 @@
+/*******************************************************************************
+  File Name: stage.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Copies content into the directory archives are built in on
+    a thread of its own, while the archive select is still reading rows
+*******************************************************************************/
+#ifndef _STAGE_H_
+#define _STAGE_H_
+
+#include "master.h"
+#include "log.h"
+#include "event.h"
+#include "store.h"
+#include <pthread.h>
+#include <deque>
+#include <string>
+using namespace std;
+
+/* called on event loop's thread once every item of an archive has been
+   copied; *failed* is how many could not be */
+typedef void (*PCAP_StagedProc)(unsigned archive_id, unsigned long failed,
+  void* ctx);
+
+/* one content item to copy, or the end of an archive's items */
+struct CAP_StageItem {
+  unsigned archive_id;  /* archive ended here; zero for an item */
+  unsigned long failed; /* items of that archive not copied */
+  ContentRec rec;       /* item to copy */
+};
+
+/* Queue of content items between archive select's row callback and a
+   thread which copies them. Queue holds at most CAP_STAGE_QUEUE_MAX items;
+   a select reading faster than files are copied waits for room, so rows
+   keep streaming without the whole archive held in memory. finish()
+   follows the last item of an archive, and its completion runs inside
+   event loop through a wakeup once the thread reaches it. */
+class CAP_Stager {
+ protected:
+  CAP_Log* errlog;          /* log events are written to */
+  string content_dir;       /* location of content */
+  string archive_dir;       /* location archives are built */
+  pthread_t thread;         /* copies items */
+  bool started;             /* thread is running */
+  bool stopping;            /* thread should exit; items left are dropped */
+  pthread_mutex_t lock;     /* guards queues and stopping */
+  pthread_cond_t ready;     /* signalled when queue gains an item */
+  pthread_cond_t room;      /* signalled when queue has room again */
+  deque<CAP_StageItem> queue; /* items and archive ends; not yet reached */
+  unsigned items;           /* items in queue, not counting archive ends */
+  deque<CAP_StageItem> done;  /* archive ends reached; completion not yet
+                                 called */
+  int wakeD;                /* event loop wakeup raised when done fills */
+  PCAP_StagedProc staged;   /* completion */
+  void* ctx;                /* passed to completion */
+
+  static void* threadMain(void* arg);
+  static void onDone(int fd, unsigned events, void* ctx);
+  bool copy(const ContentRec& rec);
+
+ public:
+  CAP_Stager(CAP_Log* _errlog, const string& _content_dir,
+    const string& _archive_dir);
+  ~CAP_Stager();
+
+  void start(CAP_EventLoop* events, PCAP_StagedProc _staged, void* _ctx);
+  void push(const ContentRec& rec);
+  void finish(unsigned archive_id);
+  void complete();
+  void stop();
+};
+
+#endif /* _STAGE_H_ */
@@ -0,0 +1,130 @@
+/*******************************************************************************
+  File Name: statusbatch.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_StatusBatch class
+*******************************************************************************/
+#include "statusbatch.h"
+using namespace std;
+
+/* CAP_StatusBatch::CAP_StatusBatch()
+   Constructor; changes are sent as they arrive until start() */
+CAP_StatusBatch::CAP_StatusBatch(CAP_Log* _errlog, CAP_DbExecutor* _db)
+  : errlog(_errlog), db(_db), events(NULL), timerD(-1), batches(0), 
+    changes(0)
+{
+  if( !errlog ) { throw CAP_Exception(CAPEXC_NOERRLOG); }
+  if( !db ) { throw CAP_Exception(CAPEXC_INVALPARAM); }
+}
+
+/* CAP_StatusBatch::~CAP_StatusBatch()
+   Destructor; sends anything still waiting */
+CAP_StatusBatch::~CAP_StatusBatch() {
+  flush();
+}
+
+/* CAP_StatusBatch::start()
+   Creates batch timer in event loop */
+void CAP_StatusBatch::start(CAP_EventLoop* _events) {
+  events = _events;
+  timerD = events->addTimer(0, onTimer, this);
+}
+
+/* CAP_StatusBatch::jobFinished()
+   Job completed */
+void CAP_StatusBatch::jobFinished(unsigned job_id) {
+  if( !job_id ) {
+    errlog->write("ignored job finished without an ID", LOG_WARNING);
+    return;
+  }
+  pending.jobsFinished.push_back(job_id);
+  added();
+}
+
+/* CAP_StatusBatch::jobFailed()
+   Job failed */
+void CAP_StatusBatch::jobFailed(unsigned job_id) {
+  if( !job_id ) {
+    errlog->write("ignored job failed without an ID", LOG_WARNING);
+    return;
+  }
+  pending.jobsFailed.push_back(job_id);
+  added();
+}
+
+/* CAP_StatusBatch::archiveFinished()
+   Archive created */
+void CAP_StatusBatch::archiveFinished(unsigned archive_id) {
+  if( !archive_id ) {
+    errlog->write("ignored archive finished without an ID", LOG_WARNING);
+    return;
+  }
+  pending.archivesFinished.push_back(archive_id);
+  added();
+}
+
+/* CAP_StatusBatch::contentDeleted()
+   Content item deleted by its user */
+void CAP_StatusBatch::contentDeleted(unsigned content_id) {
+  pending.contentDeleted.push_back(content_id);
+  added();
+}
+
+/* CAP_StatusBatch::contentRenamed()
+   Content item given a new title; a later rename in the same batch 
+   replaces an earlier one */
+void CAP_StatusBatch::contentRenamed(unsigned content_id, 
+  const string& title)
+{
+  for( list<ContentRec>::iterator it=pending.contentRenamed.begin();
+       it!=pending.contentRenamed.end(); it++ ) {
+    if( (*it).id == content_id ) {
+      (*it).title = title;
+      return;
+    }
+  }
+
+  ContentRec rec;
+  rec.id = content_id;
+  rec.title = title;
+  pending.contentRenamed.push_back(rec);
+  added();
+}
+
+/* CAP_StatusBatch::added()
+   Starts batch window on first change; sends a full batch at once */
+void CAP_StatusBatch::added() {
+  unsigned n = pending.size();
+  if( n >= CAP_STATUS_BATCH_MAX || timerD == -1 ) {
+    flush();
+  }
+  else if( n == 1 ) {
+    events->armTimer(timerD, CAP_STATUS_BATCH_MSEC);
+  }
+}
+
+/* CAP_StatusBatch::onTimer()
+   Batch window has closed */
+void CAP_StatusBatch::onTimer(int fd, unsigned events, void* ctx) {
+  ((CAP_StatusBatch*)ctx)->flush();
+}
+
+/* CAP_StatusBatch::flush()
+   Sends every waiting change to database thread as one operation */
+void CAP_StatusBatch::flush() {
+  if( pending.empty() ) { return; }
+  if( timerD != -1 ) { events->armTimer(timerD, 0); }
+
+  CAP_DbOp* op = new CAP_DbOp(DBOP_STATUS_FLUSH);
+  op->status.swap(pending);
+  batches++;
+  changes += op->status.size();
+  db->submit(op);
+}
+
+/* CAP_StatusBatch::logStats()
+   Writes number of changes and batches they were written in to log */
+void CAP_StatusBatch::logStats() {
+  errlog->writef("wrote %lu status changes in %lu transactions", LOG_INFO,
+    changes, batches);
+}
@@ -0,0 +1,51 @@
+/*******************************************************************************
+  File Name: statusbatch.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Collects job, archive and content status changes and writes
+    them to database a batch at a time
+*******************************************************************************/
+#ifndef _STATUSBATCH_H_
+#define _STATUSBATCH_H_
+
+#include "master.h"
+#include "log.h"
+#include "event.h"
+#include "dbexec.h"
+#include <string>
+using namespace std;
+
+/* Write-behind batch of status changes. The first change arms a timer; 
+   the batch goes to database thread as one transaction when the timer 
+   fires or CAP_STATUS_BATCH_MAX changes are waiting, whichever is first. 
+   flush() sends what is waiting right away, and must be called before 
+   anything which reads a status back (archive select) and before 
+   shutdown. Used only from event loop's thread. */
+class CAP_StatusBatch {
+ protected:
+  CAP_Log* errlog;        /* log events are written to */
+  CAP_DbExecutor* db;     /* runs the writes */
+  CAP_EventLoop* events;  /* owns timer */
+  int timerD;             /* fires once per batch; -1 until start() */
+  CAP_StatusSet pending;  /* changes not yet sent */
+  unsigned long batches;  /* batches sent */
+  unsigned long changes;  /* changes sent */
+
+  void added();
+  static void onTimer(int fd, unsigned events, void* ctx);
+
+ public:
+  CAP_StatusBatch(CAP_Log* _errlog, CAP_DbExecutor* _db);
+  ~CAP_StatusBatch();
+
+  void start(CAP_EventLoop* _events);
+  void jobFinished(unsigned job_id);
+  void jobFailed(unsigned job_id);
+  void archiveFinished(unsigned archive_id);
+  void contentDeleted(unsigned content_id);
+  void contentRenamed(unsigned content_id, const string& title);
+  void flush();
+  void logStats();
+};
+
+#endif /* _STATUSBATCH_H_ */
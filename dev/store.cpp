@@ -0,0 +1,42 @@
+/*******************************************************************************
+  File Name: store.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_Store base class
+*******************************************************************************/
+#include "store.h"
+using namespace std;
+
+/* CAP_SqlStat::logStats()
+   Writes statement's counters to log */
+void CAP_SqlStat::logStats(CAP_Log* errlog, const char* name) const {
+  if( !calls ) { return; }
+  errlog->writef("statement %s: %lu calls, %lu errors, %lu usec total, "
+    "%lu usec average, %lu usec longest", LOG_INFO, name, calls, errors,
+    usecs, usecs/calls, maxUsecs);
+}
+
+/* CAP_Store::CAP_Store()
+   Constructor */
+CAP_Store::CAP_Store(CAP_Log* _errlog) : errlog(_errlog) {
+  if( !errlog ) { throw CAP_Exception(CAPEXC_NOERRLOG); }
+}
+
+/* CAP_Store::jobType()
+   Job type stored for a client request body (request, kind, URL); NULL
+   if body is malformed or request is unknown */
+const char* CAP_Store::jobType(const CAP_Tokens& body, CAP_Log* errlog) {
+  if( body.size() != 3 || body.more ) {
+    errlog->writef("message body parsing error: %d lines when "
+      "3 were expected", LOG_ERROR, body.size());
+    return NULL;
+  }
+
+  if( body[0].equals("download") && body[1].equals("single") ) {
+    return "dS";
+  }
+
+  errlog->writef("discarded unknown client request %.*s,%.*s received",
+    LOG_WARNING, body[0].len, body[0].ptr, body[1].len, body[1].ptr);
+  return NULL;
+}
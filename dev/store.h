@@ -0,0 +1,174 @@
+/*******************************************************************************
+  File Name: store.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Storage the Master Program keeps jobs, content and archives
+    in, and the operations it runs against it
+*******************************************************************************/
+#ifndef _STORE_H_
+#define _STORE_H_
+
+#include "master.h"
+#include "log.h"
+#include "strref.h"
+#include "tokens.h"
+#include <list>
+#include <vector>
+#include <string>
+using namespace std;
+
+struct ContentRec {
+  unsigned id;
+  string title;
+};
+
+struct JobRec {
+  unsigned id;
+  int user_id;
+  string type;
+  string url;
+};
+
+/* status changes written together by one DBOP_STATUS_FLUSH */
+struct CAP_StatusSet {
+  vector<unsigned> jobsFinished;
+  vector<unsigned> jobsFailed;
+  vector<unsigned> archivesFinished;
+  vector<unsigned> contentDeleted;
+  list<ContentRec> contentRenamed; /* one per ID; newest title */
+
+  inline bool empty() const {
+    return jobsFinished.empty() && jobsFailed.empty() &&
+      archivesFinished.empty() && contentDeleted.empty() &&
+      contentRenamed.empty();
+  }
+  inline unsigned size() const {
+    return jobsFinished.size() + jobsFailed.size() +
+      archivesFinished.size() + contentDeleted.size() +
+      contentRenamed.size();
+  }
+  inline void swap(CAP_StatusSet& other) {
+    jobsFinished.swap(other.jobsFinished);
+    jobsFailed.swap(other.jobsFailed);
+    archivesFinished.swap(other.archivesFinished);
+    contentDeleted.swap(other.contentDeleted);
+    contentRenamed.swap(other.contentRenamed);
+  }
+};
+
+/* operations a store runs */
+enum DbOpKind {
+  DBOP_JOB_INSERT=0,      // add job from body; user_id. With key, skipped
+                          // (and ok) if key was already recorded
+  DBOP_JOB_CLAIM=1,       // move at most id waiting jobs to in-progress;
+                          // fills jobs
+  DBOP_CONTENT_INSERT=2,  // add content from body; user_id; fills id
+  DBOP_ARCHIVE_INSERT=3,  // add archive and its items from body; user_id;
+                          // key as for DBOP_JOB_INSERT
+  DBOP_ARCHIVE_SELECT=4,  // next archive not yet created; fills id, user_id;
+                          // its content goes to row as it is read
+  DBOP_STATUS_FLUSH=5,    // write status
+  DBOP_JOB_RETIRE=6,      // move at most id finished jobs to job_history;
+                          // sets id to number moved
+  DBOP_KEY_PRUNE=7,       // forget request keys below key
+  DBOP_JOB_RELEASE=8      // move in-progress jobs in jobs back to waiting,
+                          // or every one if jobs is empty; sets id to
+                          // number moved
+};
+
+struct CAP_DbOp;
+
+/* completion called on event loop's thread once operation has run;
+   executor deletes operation after it returns */
+typedef void (*PCAP_DbDoneProc)(CAP_DbOp& op, void* ctx);
+
+/* called on a database thread with each row an operation reads, while
+   the next is still coming; op's id and user_id are already filled. It 
+   must not touch anything event loop's thread uses. */
+typedef void (*PCAP_DbRowProc)(const CAP_DbOp& op, const ContentRec& rec,
+  void* ctx);
+
+/* one queued operation. Body is copied out of pipe's buffer, which is
+   reused as soon as the message handler returns. */
+struct CAP_DbOp {
+  DbOpKind kind;        /* what to run */
+  int user_id;          /* in, or out of a select */
+  unsigned id;          /* job, content or archive ID; in, or out */
+  unsigned long long key; /* request key of a spooled insert, or zero */
+  string body;          /* message body for inserts */
+  list<JobRec> jobs;    /* jobs claimed */
+  CAP_StatusSet status; /* status changes to write */
+  unsigned long rows;   /* rows passed to row callback */
+  bool ok;              /* false if store reported failure */
+  bool transient;       /* failure may pass if run again; connection lost, 
+                           deadlock or lock wait */
+  int fatal;            /* exit status thrown by store; zero if none */
+  PCAP_DbDoneProc done; /* completion; may be NULL */
+  PCAP_DbRowProc row;   /* row callback; may be NULL */
+  void* ctx;            /* passed to completion and row callback */
+
+  inline CAP_DbOp(DbOpKind _kind, PCAP_DbDoneProc _done=NULL,
+    void* _ctx=NULL) : kind(_kind), user_id(0), id(0), key(0), rows(0),
+    ok(false), transient(false), fatal(0), done(_done), row(NULL), ctx(_ctx) {}
+
+  /* emit()
+     Hands one row to row callback; called by store as rows are read */
+  inline void emit(const ContentRec& rec) {
+    rows++;
+    if( row ) { row(*this, rec, ctx); }
+  }
+};
+
+/* a statement a store prepares */
+struct CAP_SqlDef {
+  const char* name; /* shown in log */
+  const char* text; /* prepared on connect; NULL if built per call */
+};
+
+/* how often a statement ran and how long it took */
+struct CAP_SqlStat {
+  unsigned long calls;    /* executions */
+  unsigned long errors;   /* executions which failed */
+  unsigned long usecs;    /* total time spent executing */
+  unsigned long maxUsecs; /* longest execution */
+
+  inline CAP_SqlStat() : calls(0), errors(0), usecs(0), maxUsecs(0) {}
+  inline void add(const CAP_SqlStat& other) {
+    calls += other.calls;
+    errors += other.errors;
+    usecs += other.usecs;
+    if( other.maxUsecs > maxUsecs ) { maxUsecs = other.maxUsecs; }
+  }
+  void logStats(CAP_Log* errlog, const char* name) const;
+};
+
+/* backends a store may be kept in */
+enum StoreBackend {
+  STORE_MYSQL=0,
+  STORE_SQLITE=1,
+  STORE_MEMORY=2
+};
+
+/* base class. open() throws -1 if the store cannot be used at all. run()
+   is called by database threads, at most threads() of them at once; it
+   records failure in op (ok false) and throws an exit status only when
+   Master Program cannot go on. */
+class CAP_Store {
+ protected:
+  CAP_Log* errlog; /* log events are written to */
+
+ public:
+  CAP_Store(CAP_Log* _errlog);
+  virtual ~CAP_Store() {}
+
+  virtual void open(int size) = 0;
+  virtual int threads() const = 0;
+  virtual void threadInit() {}
+  virtual void threadEnd() {}
+  virtual void run(CAP_DbOp& op) = 0;
+  virtual void logStats() const {}
+
+  static const char* jobType(const CAP_Tokens& body, CAP_Log* errlog);
+};
+
+#endif /* _STORE_H_ */
@@ -0,0 +1,33 @@
+/*******************************************************************************
+  File Name: strref.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Non-owning reference to a run of characters held elsewhere
+    (usually a pipe's data buffer)
+*******************************************************************************/
+#ifndef _STRREF_H_
+#define _STRREF_H_
+
+#include <string.h>
+#include <string>
+using namespace std;
+
+/* characters are NOT null-terminated; print with "%.*s", len, ptr */
+struct CAP_StrRef {
+  const char* ptr; /* first character */
+  int len;         /* number of characters */
+
+  inline CAP_StrRef() : ptr(""), len(0) {}
+  inline CAP_StrRef(const char* _ptr, int _len) : ptr(_ptr), len(_len) {}
+  inline CAP_StrRef(const char* sz) : ptr(sz), len(strlen(sz)) {}
+  inline CAP_StrRef(const string& str) : ptr(str.data()), len(str.length()) {}
+
+  inline bool equals(const char* sz) const
+    { return strlen(sz)==(size_t)len && !memcmp(ptr, sz, len); }
+  inline bool empty() const
+    { return len==0; }
+  inline string str() const
+    { return string(ptr, len); }
+};
+
+#endif /* _STRREF_H_ */
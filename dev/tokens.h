@@ -0,0 +1,89 @@
+/*******************************************************************************
+  File Name: tokens.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Splits a message body into lines without copying them; every
+    line is a CAP_StrRef into the body
+*******************************************************************************/
+#ifndef _TOKENS_H_
+#define _TOKENS_H_
+
+#include "strref.h"
+#include <string.h>
+
+#define CAP_TOKENS_MAX 8 /* most lines kept by cap_tokenize() */
+
+/* lines of a body; kept on the stack */
+struct CAP_Tokens {
+  CAP_StrRef tok[CAP_TOKENS_MAX]; /* lines found */
+  int count;                      /* number of lines in tok */
+  bool more;                      /* body held lines which did not fit */
+
+  inline CAP_Tokens() : count(0), more(false) {}
+  inline const CAP_StrRef& operator[](int i) const { return tok[i]; }
+  inline int size() const { return count; }
+};
+
+/* walks lines of a body one at a time, for bodies of any length */
+class CAP_LineIter {
+ protected:
+  const char* p;   /* start of next line */
+  const char* end; /* end of body */
+  bool done;       /* last line has been returned */
+
+ public:
+  inline CAP_LineIter(const CAP_StrRef& body)
+    : p(body.ptr), end(body.ptr+body.len), done(false) {}
+
+  /* next()
+     Sets *line* to next line; returns false once every line has been 
+     returned. Like the bodies senders write, a body of n delimiters holds 
+     n+1 lines, the last of them possibly empty. */
+  inline bool next(CAP_StrRef& line, char delim='\n') {
+    if( done ) { return false; }
+    const char* nl = (const char*)memchr(p, delim, end-p);
+    if( nl ) {
+      line = CAP_StrRef(p, nl-p);
+      p = nl+1;
+    }
+    else {
+      line = CAP_StrRef(p, end-p);
+      done = true;
+    }
+    return true;
+  }
+};
+
+/* cap_tokenize()
+   Splits body into at most CAP_TOKENS_MAX lines; returns number found. 
+   memchr() finds each delimiter several characters at a time. */
+inline int cap_tokenize(const CAP_StrRef& body, CAP_Tokens& toks, 
+  char delim='\n')
+{
+  CAP_LineIter it(body);
+  CAP_StrRef line;
+  toks.count = 0;
+  toks.more = false;
+  while( it.next(line, delim) ) {
+    if( toks.count == CAP_TOKENS_MAX ) {
+      toks.more = true;
+      break;
+    }
+    toks.tok[toks.count++] = line;
+  }
+  return toks.count;
+}
+
+/* cap_touint()
+   Converts leading decimal digits of str to a number */
+inline unsigned long cap_touint(const CAP_StrRef& str) {
+  unsigned long n=0;
+  int i=0;
+  while( i<str.len && (str.ptr[i]==' ' || str.ptr[i]=='\t') ) { i++; }
+  for( ; i<str.len && str.ptr[i]>='0' && str.ptr[i]<='9'; i++ ) {
+    n = n*10 + (str.ptr[i]-'0');
+  }
+  return n;
+}
+
+#endif /* _TOKENS_H_ */
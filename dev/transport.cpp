@@ -0,0 +1,58 @@
+/*******************************************************************************
+  File Name: transport.cpp
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Implementation of CAP_Transport base class
+*******************************************************************************/
+#include "pipe.h"
+#include "transport.h"
+using namespace std;
+
+/* CAP_Transport::CAP_Transport()
+   Class constructor */
+CAP_Transport::CAP_Transport(const string& _name, CAP_Log* _errlog)
+  : errlog(_errlog), strName(_name), strPathname(""), mode(PIPE_RDONLY)
+{
+  if( !errlog ) { throw CAP_PipeException(EXCPIPE_NOERRLOG); }
+}
+
+/* CAP_Transport::create()
+   Checks and records pathname and mode of pipe */
+void CAP_Transport::create(const string& pathname, PipeMode _mode) {
+  // check current file descriptor
+  if( isOpen() ) {
+    errlog->writef("pipe %s is already open", LOG_WARNING, strName.c_str());
+    throw CAP_PipeException(EXCPIPE_ISOPEN);
+  }
+
+  // check parameters
+  if( pathname == "" ) {
+    errlog->writef("no pathname specified when opening pipe %s", LOG_ERROR, 
+		   strName.c_str());
+    throw CAP_PipeException(EXCPIPE_CREATEFAIL);
+  }
+  if( !(_mode==PIPE_RDONLY || _mode==PIPE_WRONLY) ) {
+    errlog->writef("invalid mode specified when opening pipe %s", LOG_ERROR, 
+		   strName.c_str());
+    throw CAP_PipeException(EXCPIPE_CREATEFAIL);
+  }
+
+  strPathname = pathname;
+  mode = _mode;
+}
+
+/* CAP_Transport::make()
+   Creates transport of given kind */
+CAP_Transport* CAP_Transport::make(PipeTransport kind, const string& _name, 
+  CAP_Log* _errlog)
+{
+  switch( kind ) {
+  case PIPE_SHMRING:
+    return new CAP_ShmRingTransport(_name, _errlog);
+  case PIPE_SEQPACKET:
+    return new CAP_SeqPacketTransport(_name, _errlog);
+  case PIPE_FIFO:
+  default:
+    return new CAP_FifoTransport(_name, _errlog);
+  }
+}
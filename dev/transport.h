@@ -0,0 +1,180 @@
+/*******************************************************************************
+  File Name: transport.h
+  Author: Grant Gipson
+  Date Last Edited: October 16, 2026
+  Description: Transports which carry a CAP_Pipe's bytes; FIFOs, Unix
+    domain SOCK_SEQPACKET sockets and shared memory rings
+*******************************************************************************/
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+#include "master.h"
+#include "log.h"
+#include <stdint.h>
+#include <limits.h>
+#include <string>
+#include <list>
+using namespace std;
+
+// modes in which a pipe may be open--mutually exclusive
+enum PipeMode {
+  PIPE_WRONLY=0,
+  PIPE_RDONLY=1
+};
+
+// transports a pipe may be carried over
+enum PipeTransport {
+  PIPE_FIFO=0,
+  PIPE_SEQPACKET=1,
+  PIPE_SHMRING=2
+};
+
+/* base class; reads and writes return the number of characters moved, or
+   -1 with errno set (EAGAIN when nothing can be moved right now, EPIPE
+   when reader has gone away). open() returns false when nobody is reading
+   yet; other failures to open or create throw CAP_PipeException. 
+   available() is the size of what the next read() would take and 
+   pending() is true while data already taken from the kernel awaits 
+   read(). atomicMax() is the largest write which cannot be interleaved 
+   with other writers' data; zero if every write stays whole. 
+   pollsWritable() is false if a writer's getFd() does not become 
+   writable when there is room again. */
+class CAP_Transport {
+ protected:
+  CAP_Log* errlog;   /* log events are written to */
+  string strName;    /* name of pipe passed to errlog */
+  string strPathname;/* path name of FIFO or socket */
+  PipeMode mode;     /* mode in which pipe is to be opened */
+
+ public:
+  CAP_Transport(const string& _name, CAP_Log* _errlog);
+  virtual ~CAP_Transport() {}
+
+  virtual void create(const string& pathname, PipeMode _mode);
+  virtual bool open() = 0;
+  virtual void close() = 0;
+  virtual void listen() = 0;
+  virtual bool isOpen() const = 0;
+  virtual int getFd() const = 0;
+  virtual int available() = 0;
+  virtual int read(char* buf, int len) = 0;
+  virtual int write(const char* buf, int len) = 0;
+  virtual bool pending() const { return false; }
+  virtual int atomicMax() const { return 0; }
+  virtual bool pollsWritable() const { return true; }
+
+  static CAP_Transport* make(PipeTransport kind, const string& _name,
+    CAP_Log* _errlog);
+};
+
+/* named FIFO; reader holds a write end so it never sees end-of-file */
+class CAP_FifoTransport : public CAP_Transport {
+ protected:
+  int fileD;  /* FIFO descriptor */
+  int holdD;  /* write end held open by listen() */
+
+ public:
+  CAP_FifoTransport(const string& _name, CAP_Log* _errlog);
+  ~CAP_FifoTransport();
+
+  void create(const string& pathname, PipeMode _mode);
+  bool open();
+  void close();
+  void listen();
+  inline bool isOpen() const { return fileD != 0; }
+  inline int getFd() const { return fileD; }
+  int available();
+  int read(char* buf, int len);
+  int write(const char* buf, int len);
+  inline int atomicMax() const { return PIPE_BUF; }
+};
+
+/* Unix domain SOCK_SEQPACKET socket. Reader listens and accepts one
+   connection per writer; every datagram holds whole messages. Data too
+   large for one datagram continues in a memory file whose descriptor is
+   passed along with it. Reader's connections are watched by an epoll
+   descriptor of its own, which is what getFd() gives to an event loop. */
+class CAP_SeqPacketTransport : public CAP_Transport {
+ protected:
+  int sockD;        /* listening socket, or connection when writing */
+  int pollD;        /* epoll descriptor watching connections */
+  list<int> conns;  /* connections accepted by reader */
+  int currD;        /* connection whose datagram is read next */
+  int contD;        /* memory file continuing last datagram */
+  long contLeft;    /* characters not yet read from contD */
+
+  void accept();
+  virtual void drop(int fd);
+  int sendLarge(const char* buf, int len);
+
+ public:
+  CAP_SeqPacketTransport(const string& _name, CAP_Log* _errlog);
+  ~CAP_SeqPacketTransport();
+
+  bool open();
+  void close();
+  void listen();
+  inline bool isOpen() const { return sockD != -1; }
+  int getFd() const;
+  int available();
+  int read(char* buf, int len);
+  int write(const char* buf, int len);
+  inline bool pending() const { return contD != -1; }
+};
+
+#define PIPE_RING_MAGIC 0x52504143 /* "CAPR" */
+
+/* shared header of a ring; head and tail sit in cache lines of their own 
+   so producer and consumer do not fight over one line */
+struct CAP_RingHeader {
+  uint32_t magic;       /* PIPE_RING_MAGIC */
+  uint32_t size;        /* characters in data area; a power of two */
+  char pad0[56];
+  uint64_t head;        /* total characters written; producer only */
+  char pad1[56];
+  uint64_t tail;        /* total characters read; consumer only */
+  char pad2[56];
+};
+
+/* ring shared by exactly one writer and the reader */
+struct CAP_Ring {
+  int connD;            /* control connection; -1 once writer has gone */
+  int eventD;           /* eventfd raised when ring goes from empty */
+  CAP_RingHeader* hdr;  /* mapped header */
+  char* base;           /* mapped data area */
+  uint32_t size;        /* size of data area, fixed when ring is mapped */
+};
+
+/* single-producer/single-consumer ring in shared memory. Writer connects 
+   to reader's control socket (same as CAP_SeqPacketTransport) and passes 
+   a memory file and an eventfd over it; after that messages move through 
+   mapped memory and the eventfd is raised only when reader may be idle. 
+   Each message is a 4 character length and its bytes, and is written 
+   whole or not at all; a message larger than reader's buffer read is 
+   delivered over several reads before any other ring is read. */
+class CAP_ShmRingTransport : public CAP_SeqPacketTransport {
+ protected:
+  list<CAP_Ring> rings; /* reader: one per writer; writer: its own */
+  CAP_Ring* currR;      /* ring read next */
+  uint32_t partLeft;    /* characters of a message read only in part */
+
+  bool attach(int fd);
+  void detach(list<CAP_Ring>::iterator it);
+  void drop(int fd);
+  int whole(CAP_Ring& r, int max);
+  void reject(CAP_Ring& r);
+
+ public:
+  CAP_ShmRingTransport(const string& _name, CAP_Log* _errlog);
+  ~CAP_ShmRingTransport();
+
+  bool open();
+  void close();
+  int available();
+  int read(char* buf, int len);
+  int write(const char* buf, int len);
+  inline bool pending() const { return partLeft > 0; }
+  inline bool pollsWritable() const { return false; }
+};
+
+#endif /* _TRANSPORT_H_ */